@@ -3,78 +3,217 @@
 
 #include <memory> // unique_ptr
 #include <string_view>
-#include <string_view>
 #include <functional> // hash
+#include <utility>
+#include <algorithm> // max
 
+// Open addressing map from names to values using robin hood probing
+// Entries live directly in one array and keep their hash, so probing rarely touches the key and rehashing never recomputes it
 template <typename ValT>
 class HashMap {
 public:
-	struct ListEntry {
+	struct Entry {
 		std::string_view id;
 		ValT val;
-		ListEntry* next = nullptr;
 	};
 
 private:
-	constexpr static int DEFAULT_BUCKET_COUNT = 10;
+	struct Slot {
+		std::size_t hash = 0;
+		int distance = -1; // How far this entry is from the slot its hash maps to, -1 if empty
+		Entry entry;
+	};
+
+	constexpr static std::size_t MIN_BUCKET_COUNT = 8;
+
+	std::unique_ptr<Slot[]> buckets;
+	std::size_t bucketCount = 0; // Always a power of two
+	std::size_t count = 0;
+
+	std::size_t mask() const {
+		return bucketCount - 1;
+	}
+
+	// Index of the entry with this id, or -1
+	std::ptrdiff_t findIndex(std::string_view id, std::size_t hash) const {
+		if (bucketCount == 0) {
+			return -1;
+		}
 
-	int bucketCount = 0;
-	std::unique_ptr<ListEntry[]> buckets;
+		std::size_t i = hash & mask();
 
-	int hash(std::string_view id) {
-		std::size_t hash = std::hash<std::string_view>{}(id);
-		return hash % bucketCount;
+		for (int distance = 0; ; distance++) {
+			const Slot& slot = buckets[i];
+
+			// Robin hood order means the entry would have been placed before any slot that is closer to home than we are
+			if (slot.distance < distance) {
+				return -1;
+			}
+
+			if (slot.hash == hash && slot.entry.id == id) {
+				return i;
+			}
+
+			i = (i + 1) & mask();
+		}
+	}
+
+	// Places an entry that is known not to be in the map yet
+	Entry* insertNew(Slot incoming) {
+		std::size_t i = incoming.hash & mask();
+		Entry* placed = nullptr;
+
+		incoming.distance = 0;
+
+		while (true) {
+			Slot& slot = buckets[i];
+
+			if (slot.distance < 0) {
+				slot = std::move(incoming);
+				count++;
+				return placed ? placed : &slot.entry;
+			}
+
+			// Take the slot from an entry that is closer to home, then keep looking for a place for that entry instead
+			if (slot.distance < incoming.distance) {
+				std::swap(slot, incoming);
+				if (!placed) {
+					placed = &slot.entry;
+				}
+			}
+
+			incoming.distance++;
+			i = (i + 1) & mask();
+		}
+	}
+
+	void growIfNeeded() {
+		// Keep the load factor under 7/8
+		if ((count + 1) * 8 > bucketCount * 7) {
+			resize(std::max(bucketCount * 2, MIN_BUCKET_COUNT));
+		}
 	}
 
 public:
-	HashMap(int bucketCount_ = DEFAULT_BUCKET_COUNT) {
-		resize(bucketCount_);
+	// Nothing is allocated until the first insertion unless a bucket count is given
+	HashMap(std::size_t bucketCount_ = 0) {
+		if (bucketCount_) {
+			resize(bucketCount_);
+		}
 	}
 
-	void resize(int newBucketCount) {
-		auto oldPtr = std::move(buckets);
-		buckets = std::make_unique<ListEntry[]>(newBucketCount);
+	static std::size_t hashOf(std::string_view id) {
+		return std::hash<std::string_view>{}(id);
+	}
+
+	// Moves every entry into a table of at least newBucketCount buckets
+	void resize(std::size_t newBucketCount) {
+		std::size_t size = 1;
+		while (size < newBucketCount || size * 7 < count * 8) {
+			size *= 2;
+		}
 
-		//todo: rehash every element
+		auto oldBuckets = std::move(buckets);
+		std::size_t oldBucketCount = bucketCount;
 
-		bucketCount = newBucketCount;
+		buckets = std::make_unique<Slot[]>(size);
+		bucketCount = size;
+		count = 0;
+
+		for (std::size_t i = 0; i < oldBucketCount; i++) {
+			if (oldBuckets[i].distance >= 0) {
+				insertNew(std::move(oldBuckets[i]));
+			}
+		}
+	}
+
+	void reserve(std::size_t entries) {
+		if (entries * 8 > bucketCount * 7) {
+			resize(entries * 8 / 7 + 1);
+		}
 	}
 
 	// Inserts a new element, returning whether it replaced an existing one
 	bool update(std::string_view id, ValT entry) {
-		int hash = this->hash(id);
-		ListEntry* ptr = buckets[hash];
+		std::size_t hash = hashOf(id);
+		std::ptrdiff_t i = findIndex(id, hash);
+
+		if (i >= 0) {
+			buckets[i].entry.val = std::move(entry);
+			return true;
+		}
 
-		if (ptr == nullptr) {
-			auto newEntry = new ListEntry{ id, entry };
-			buckets[hash] = newEntry;
+		growIfNeeded();
+		insertNew(Slot{ hash, 0, Entry{ id, std::move(entry) } });
+		return false;
+	}
+
+	// Inserts a new element unless the id is already present, returning whether it was inserted
+	bool insert(std::string_view id, ValT entry) {
+		std::size_t hash = hashOf(id);
+
+		if (findIndex(id, hash) >= 0) {
 			return false;
 		}
-		else {
-			while (ptr->id != id && ptr->next) {
-				ptr = ptr->next;
-			}
 
-			if (ptr->id == id) {
-				ptr->val = entry;
-				return true;
-			}
-			else {
-				ptr->next = new ListEntry{ id, entry };
-				return false;
-			}
+		growIfNeeded();
+		insertNew(Slot{ hash, 0, Entry{ id, std::move(entry) } });
+		return true;
+	}
+
+	// Removes an element, returning whether it was present
+	bool erase(std::string_view id) {
+		std::ptrdiff_t i = findIndex(id, hashOf(id));
+		if (i < 0) {
+			return false;
+		}
+
+		// Shift the following entries back a slot so no gap is left in their probe sequences
+		std::size_t hole = i;
+		std::size_t next = (hole + 1) & mask();
+
+		while (buckets[next].distance > 0) {
+			buckets[hole] = std::move(buckets[next]);
+			buckets[hole].distance--;
+
+			hole = next;
+			next = (next + 1) & mask();
 		}
+
+		buckets[hole] = Slot{};
+		count--;
+		return true;
 	}
 
 	ValT* get(std::string_view id) {
-		ListEntry* ptr = buckets[hash(id)];
+		return get(id, hashOf(id));
+	}
 
-		while (ptr != nullptr && ptr->id != id) {
-			ptr = ptr->next;
+	// Lookup with a hash computed beforehand by hashOf, for searching several maps for the same id
+	ValT* get(std::string_view id, std::size_t hash) {
+		std::ptrdiff_t i = findIndex(id, hash);
+		return i < 0 ? nullptr : &buckets[i].entry.val;
+	}
+
+	void clear() {
+		for (std::size_t i = 0; i < bucketCount; i++) {
+			buckets[i] = Slot{};
 		}
+		count = 0;
+	}
 
-		return ptr;
+	std::size_t size() const {
+		return count;
+	}
+
+	template <typename FuncT>
+	void forEach(FuncT&& func) {
+		for (std::size_t i = 0; i < bucketCount; i++) {
+			if (buckets[i].distance >= 0) {
+				func(buckets[i].entry);
+			}
+		}
 	}
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,55 @@
+#ifndef COMPILER_ARENA_H
+#define COMPILER_ARENA_H
+
+#include <vector>
+#include <memory>
+#include <utility>
+
+// Owns the AST nodes made while it is active, so that a function's body can be freed as soon as it has been emitted
+struct NodeArena {
+	using Owner = std::unique_ptr<void, void(*)(void*)>;
+
+	std::vector<Owner> nodes;
+
+	// Arena that makeNode allocates into, if any
+	static inline NodeArena* active = nullptr;
+
+	// Makes this the active arena and restores the previous one upon leaving scope
+	struct Activation {
+		NodeArena* _prev;
+
+		~Activation() {
+			active = _prev;
+		}
+	};
+
+	Activation activate() {
+		NodeArena* prev = active;
+		active = this;
+		return { prev };
+	}
+
+	template <typename T>
+	void adopt(T* node) {
+		nodes.emplace_back(node, [](void* ptr) { delete static_cast<T*>(ptr); });
+	}
+
+	// Deletes every node made in this arena
+	void release() {
+		nodes.clear();
+	}
+};
+
+// Allocates a node that lives as long as the active arena, or forever when there is none
+template <typename T, typename... ArgsT>
+T* makeNode(ArgsT&&... args) {
+	T* node = new T(std::forward<ArgsT>(args)...);
+
+	if (NodeArena::active) {
+		NodeArena::active->adopt(node);
+	}
+
+	return node;
+}
+
+#endif // ifndef COMPILER_ARENA_H
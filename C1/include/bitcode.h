@@ -0,0 +1,1448 @@
+#ifndef COMPILER_BITCODE_H
+#define COMPILER_BITCODE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <optional>
+#include <charconv>
+#include <cstdint>
+#include <cctype>
+#include <algorithm>
+
+#include "llvmType.h"
+#include "bitstream.h"
+#include "outputBuffer.h"
+#include "error.h"
+
+// Textual names of the operations written here and their codes in LLVM's LLVMBitCodes.h
+using BcCodeName = std::pair<std::string_view, unsigned>;
+
+constexpr BcCodeName BC_BINARY_OPS[] = {
+	{ "add", 0 }, { "sub", 1 }, { "mul", 2 }, { "udiv", 3 }, { "sdiv", 4 }, { "urem", 5 }, { "srem", 6 },
+	{ "shl", 7 }, { "lshr", 8 }, { "ashr", 9 }, { "and", 10 }, { "or", 11 }, { "xor", 12 },
+	{ "fadd", 0 }, { "fsub", 1 }, { "fmul", 2 }, { "fdiv", 4 }, { "frem", 6 }
+};
+
+constexpr BcCodeName BC_CASTS[] = {
+	{ "trunc", 0 }, { "zext", 1 }, { "sext", 2 }, { "fptoui", 3 }, { "fptosi", 4 }, { "uitofp", 5 },
+	{ "sitofp", 6 }, { "fptrunc", 7 }, { "fpext", 8 }, { "ptrtoint", 9 }, { "inttoptr", 10 }, { "bitcast", 11 }
+};
+
+constexpr BcCodeName BC_ICMP_PREDICATES[] = {
+	{ "eq", 32 }, { "ne", 33 }, { "ugt", 34 }, { "uge", 35 }, { "ult", 36 },
+	{ "ule", 37 }, { "sgt", 38 }, { "sge", 39 }, { "slt", 40 }, { "sle", 41 }
+};
+
+constexpr BcCodeName BC_LINKAGES[] = {
+	{ "external", 0 }, { "appending", 2 }, { "internal", 3 }, { "extern_weak", 7 }, { "common", 8 },
+	{ "private", 9 }, { "available_externally", 12 }, { "weak", 16 }, { "weak_odr", 17 },
+	{ "linkonce", 18 }, { "linkonce_odr", 19 }
+};
+
+template <size_t N>
+std::optional<unsigned> findBcCode(const BcCodeName (&codes)[N], std::string_view name) {
+	for (auto& i : codes) {
+		if (i.first == name) {
+			return i.second;
+		}
+	}
+	return std::nullopt;
+}
+
+
+// The module FuncEmitter wrote, read back with just what bitcode needs
+struct BcValue {
+	LlvmType* type = nullptr; // Null or void for instructions that don't produce a value
+	uint32_t id = 0; // Index in the value table, given out as the module is written
+};
+
+struct BcConstant : public BcValue {
+	enum class Kind {
+		INT,
+		NULL_VALUE, // null, or zeroinitializer
+		UNDEF,
+		STRING,
+		GEP
+	};
+
+	Kind kind = Kind::INT;
+	int64_t value = 0;
+	std::string bytes;
+
+	// getelementptr only
+	LlvmType* sourceType = nullptr;
+	bool inBounds = false;
+	std::vector<BcValue*> operands;
+};
+
+struct BcGlobal : public BcValue {
+	std::string_view name;
+	LlvmType* valueType = nullptr;
+	BcConstant* init = nullptr;
+	bool constant = false;
+
+	unsigned linkage = 0;
+	unsigned unnamedAddr = 0;
+	unsigned align = 0; // log2 + 1, 0 if not given
+	bool dsoLocal = false;
+};
+
+struct BcInstruction : public BcValue {
+	enum class Op {
+		ALLOCA,
+		LOAD,
+		STORE,
+		BINARY,
+		CMP,
+		BR,
+		RET,
+		CALL,
+		GEP,
+		CAST
+	};
+
+	Op op;
+	unsigned code = 0; // Operator, predicate or cast from the tables above
+	unsigned flags = 0; // nuw and nsw, exact, or inbounds
+	unsigned align = 0;
+
+	// Allocated, loaded or indexed type, cast destination, or called function type
+	LlvmType* explicitType = nullptr;
+
+	std::vector<BcValue*> operands;
+
+	// Branch targets, by name until the whole function has been read
+	std::vector<std::string_view> labels;
+	std::vector<uint64_t> blocks;
+
+	BcInstruction(Op op_) : op(op_) {}
+
+	bool producesValue() const {
+		return type && type->kind != LlvmType::Kind::VOID;
+	}
+};
+
+struct BcFunction : public BcValue {
+	std::string_view name;
+	LlvmTypeFunction* fnType = nullptr;
+	bool defined = false;
+
+	unsigned linkage = 0;
+	unsigned visibility = 0;
+	unsigned dllStorage = 0;
+	bool dsoLocal = false;
+
+	std::vector<std::string_view> argNames;
+	std::deque<BcValue> args;
+	std::deque<BcInstruction> body;
+	unsigned blockCount = 0;
+
+	// Lines of the text between the braces
+	size_t firstLine = 0;
+	size_t endLine = 0;
+};
+
+struct BcModule {
+	std::string_view sourceFilename;
+	std::string_view triple;
+	std::string_view dataLayout;
+
+	std::deque<BcGlobal> globals;
+	std::deque<BcFunction> functions;
+	std::deque<BcConstant> constants;
+
+	std::unordered_map<std::string_view, BcValue*> globalNames;
+
+	// Integer and null constants are shared by every use
+	std::map<std::pair<LlvmType*, int64_t>, BcConstant*> ints;
+	std::unordered_map<LlvmType*, BcConstant*> nulls;
+};
+
+
+// Reads back the textual IR this compiler writes
+// Only the forms FuncEmitter and LlvmAsmGenerator produce are understood, anything else is reported as unsupported
+class IrTextReader {
+	struct Token {
+		enum class Kind {
+			END,
+			WORD,
+			LOCAL,
+			GLOBAL,
+			INT,
+			STRING,
+			PUNCT
+		};
+
+		Kind kind = Kind::END;
+		std::string_view text;
+	};
+
+	BcModule& module;
+	std::vector<std::string_view> lines;
+
+	std::string_view line;
+	size_t pos = 0;
+	Token tok;
+
+	std::unordered_map<std::string_view, BcValue*> locals;
+
+	[[noreturn]] void unsupported() {
+		throw SourceError(DiagId::BITCODE_UNSUPPORTED, line);
+	}
+
+	static bool isNameChar(char c) {
+		return std::isalnum((unsigned char)c) || c == '.' || c == '_' || c == '$' || c == '-';
+	}
+
+	// Everything up to the closing quote, which is skipped
+	std::string_view lexQuoted() {
+		size_t begin = ++pos;
+		while (pos < line.size() && line[pos] != '"') {
+			pos++;
+		}
+		if (pos >= line.size()) {
+			unsupported();
+		}
+		return line.substr(begin, pos++ - begin);
+	}
+
+	void advance() {
+		while (pos < line.size() && std::isspace((unsigned char)line[pos])) {
+			pos++;
+		}
+
+		if (pos >= line.size() || line[pos] == ';') {
+			tok = { Token::Kind::END, {} };
+			return;
+		}
+
+		char c = line[pos];
+		size_t begin = pos;
+
+		if (c == '%' || c == '@') {
+			Token::Kind kind = c == '%' ? Token::Kind::LOCAL : Token::Kind::GLOBAL;
+			pos++;
+
+			if (pos < line.size() && line[pos] == '"') {
+				tok = { kind, lexQuoted() };
+				return;
+			}
+
+			begin = pos;
+			while (pos < line.size() && isNameChar(line[pos])) {
+				pos++;
+			}
+			tok = { kind, line.substr(begin, pos - begin) };
+		}
+		else if (std::isdigit((unsigned char)c) || (c == '-' && pos + 1 < line.size() && std::isdigit((unsigned char)line[pos + 1]))) {
+			pos++;
+			while (pos < line.size() && std::isdigit((unsigned char)line[pos])) {
+				pos++;
+			}
+			tok = { Token::Kind::INT, line.substr(begin, pos - begin) };
+		}
+		else if (c == 'c' && pos + 1 < line.size() && line[pos + 1] == '"') {
+			pos++;
+			tok = { Token::Kind::STRING, lexQuoted() };
+		}
+		else if (c == '"') {
+			tok = { Token::Kind::STRING, lexQuoted() };
+		}
+		else if (std::isalpha((unsigned char)c) || c == '_' || c == '#') {
+			pos++;
+			while (pos < line.size() && isNameChar(line[pos]) && line[pos] != '-') {
+				pos++;
+			}
+			tok = { Token::Kind::WORD, line.substr(begin, pos - begin) };
+		}
+		else if (line.substr(pos, 3) == "...") {
+			pos += 3;
+			tok = { Token::Kind::PUNCT, "..." };
+		}
+		else {
+			pos++;
+			tok = { Token::Kind::PUNCT, line.substr(begin, 1) };
+		}
+	}
+
+	void start(std::string_view line_) {
+		line = line_;
+		pos = 0;
+		advance();
+	}
+
+	bool is(std::string_view text) {
+		return (tok.kind == Token::Kind::WORD || tok.kind == Token::Kind::PUNCT) && tok.text == text;
+	}
+
+	bool accept(std::string_view text) {
+		if (is(text)) {
+			advance();
+			return true;
+		}
+		return false;
+	}
+
+	void expect(std::string_view text) {
+		if (!accept(text)) {
+			unsupported();
+		}
+	}
+
+	std::string_view expectKind(Token::Kind kind) {
+		if (tok.kind != kind) {
+			unsupported();
+		}
+
+		std::string_view text = tok.text;
+		advance();
+		return text;
+	}
+
+	int64_t expectInt() {
+		std::string_view text = expectKind(Token::Kind::INT);
+
+		int64_t val = 0;
+		if (std::from_chars(text.data(), text.data() + text.size(), val).ec != std::errc()) {
+			unsupported();
+		}
+		return val;
+	}
+
+	// ", align N", returned as log2(N) + 1
+	unsigned parseAlign() {
+		if (!accept("align")) {
+			return 0;
+		}
+
+		int64_t bytes = expectInt();
+		unsigned encoded = 1;
+		while (bytes > 1) {
+			bytes >>= 1;
+			encoded++;
+		}
+		return encoded;
+	}
+
+	LlvmType* parseType() {
+		LlvmType* type = nullptr;
+
+		if (tok.kind == Token::Kind::WORD) {
+			std::string_view name = tok.text;
+
+			if (name == "void") {
+				type = llvmTypes().voidType();
+			}
+			else if (name == "label") {
+				type = llvmTypes().labelType();
+			}
+			else if (name.size() > 1 && name[0] == 'i' && std::all_of(name.begin() + 1, name.end(), [](char c) { return std::isdigit((unsigned char)c); })) {
+				type = llvmTypes().intType(std::atoi(std::string(name.substr(1)).c_str()));
+			}
+			else {
+				for (int i = 0; i < LlvmTypeFloat::COUNT; i++) {
+					if (name == LlvmTypeFloat::FLOAT_TYPES_STR[i]) {
+						type = llvmTypes().floatType((LlvmTypeFloat::FLOAT_TYPES)i);
+					}
+				}
+
+				if (!type) {
+					unsupported();
+				}
+			}
+
+			advance();
+		}
+		else if (tok.kind == Token::Kind::LOCAL) {
+			// Every named struct this compiler makes is called struct.Name
+			constexpr std::string_view prefix = "struct.";
+			if (!tok.text.starts_with(prefix)) {
+				unsupported();
+			}
+
+			type = llvmTypes().identifiedStruct(tok.text.substr(prefix.size()));
+			advance();
+		}
+		else if (accept("[")) {
+			int size = (int)expectInt();
+			expect("x");
+			type = llvmTypes().arrayOf(size, parseType());
+			expect("]");
+		}
+		else if (accept("<")) {
+			if (is("{")) {
+				type = parseStructBody(true);
+				expect(">");
+			}
+			else {
+				int size = (int)expectInt();
+				expect("x");
+				type = llvmTypes().vectorOf(size, parseType());
+				expect(">");
+			}
+		}
+		else if (is("{")) {
+			type = parseStructBody(false);
+		}
+		else {
+			unsupported();
+		}
+
+		while (true) {
+			if (accept("*")) {
+				type = llvmTypes().pointerTo(type);
+			}
+			else if (accept("(")) {
+				std::vector<LlvmType*> params;
+				bool varArg = false;
+
+				while (!accept(")")) {
+					if (accept("...")) {
+						varArg = true;
+					}
+					else {
+						params.push_back(parseType());
+					}
+					accept(",");
+				}
+
+				type = llvmTypes().functionType(type, params, varArg);
+			}
+			else {
+				return type;
+			}
+		}
+	}
+
+	LlvmTypeLiteralStruct* parseStructBody(bool packed) {
+		expect("{");
+
+		std::vector<LlvmType*> members;
+		while (!accept("}")) {
+			members.push_back(parseType());
+			accept(",");
+		}
+
+		return llvmTypes().literalStruct(members, packed);
+	}
+
+	BcConstant* intConstant(LlvmType* type, int64_t val) {
+		BcConstant*& slot = module.ints[{ type, val }];
+		if (!slot) {
+			slot = &module.constants.emplace_back();
+			slot->type = type;
+			slot->value = val;
+		}
+		return slot;
+	}
+
+	BcConstant* nullConstant(LlvmType* type) {
+		BcConstant*& slot = module.nulls[type];
+		if (!slot) {
+			slot = &module.constants.emplace_back();
+			slot->kind = BcConstant::Kind::NULL_VALUE;
+			slot->type = type;
+		}
+		return slot;
+	}
+
+	static std::string unescape(std::string_view text) {
+		std::string out;
+
+		for (size_t i = 0; i < text.size(); i++) {
+			if (text[i] == '\\' && i + 2 < text.size() && std::isxdigit((unsigned char)text[i + 1]) && std::isxdigit((unsigned char)text[i + 2])) {
+				unsigned val = 0;
+				std::from_chars(text.data() + i + 1, text.data() + i + 3, val, 16);
+				out += (char)val;
+				i += 2;
+			}
+			else if (text[i] == '\\' && i + 1 < text.size() && text[i + 1] == '\\') {
+				out += '\\';
+				i++;
+			}
+			else {
+				out += text[i];
+			}
+		}
+
+		return out;
+	}
+
+	// Type of what indices after the first select inside source
+	LlvmType* indexedType(LlvmType* source, const std::vector<BcValue*>& indices) {
+		LlvmType* type = source;
+
+		for (size_t i = 1; i < indices.size(); i++) {
+			if (type->kind == LlvmType::Kind::ARRAY) {
+				type = static_cast<LlvmTypeArray*>(type)->dataType;
+			}
+			else if (type->kind == LlvmType::Kind::VECTOR) {
+				type = static_cast<LlvmTypeVec*>(type)->dataType;
+			}
+			else if (type->kind == LlvmType::Kind::LITERAL_STRUCT || type->kind == LlvmType::Kind::IDENTIFIED_STRUCT) {
+				LlvmTypeLiteralStruct* body = type->kind == LlvmType::Kind::LITERAL_STRUCT ?
+					static_cast<LlvmTypeLiteralStruct*>(type) : static_cast<LlvmTypeIdentifiedStruct*>(type)->type;
+				BcConstant* index = static_cast<BcConstant*>(indices[i]);
+
+				if (!body || index->kind != BcConstant::Kind::INT || index->value < 0 || index->value >= (int64_t)body->members.size()) {
+					unsupported();
+				}
+				type = body->members[index->value];
+			}
+			else {
+				unsupported();
+			}
+		}
+
+		return type;
+	}
+
+	BcValue* parseValue(LlvmType* type) {
+		switch (tok.kind) {
+		case Token::Kind::LOCAL: {
+			// Values are always defined before they're used, since only branches refer forward
+			auto found = locals.find(tok.text);
+			if (found == locals.end()) {
+				unsupported();
+			}
+			advance();
+			return found->second;
+		}
+		case Token::Kind::GLOBAL: {
+			auto found = module.globalNames.find(tok.text);
+			if (found == module.globalNames.end()) {
+				unsupported();
+			}
+			advance();
+			return found->second;
+		}
+		case Token::Kind::INT:
+			return intConstant(type, expectInt());
+		case Token::Kind::STRING: {
+			BcConstant* str = &module.constants.emplace_back();
+			str->kind = BcConstant::Kind::STRING;
+			str->type = type;
+			str->bytes = unescape(tok.text);
+			advance();
+			return str;
+		}
+		default:
+			break;
+		}
+
+		if (accept("true")) {
+			return intConstant(type, 1);
+		}
+		if (accept("false")) {
+			return intConstant(type, 0);
+		}
+		if (accept("null") || accept("zeroinitializer")) {
+			return nullConstant(type);
+		}
+		if (accept("undef")) {
+			BcConstant* undef = &module.constants.emplace_back();
+			undef->kind = BcConstant::Kind::UNDEF;
+			undef->type = type;
+			return undef;
+		}
+
+		if (accept("getelementptr")) {
+			BcConstant* gep = &module.constants.emplace_back();
+			gep->kind = BcConstant::Kind::GEP;
+			gep->inBounds = accept("inbounds");
+
+			expect("(");
+			gep->sourceType = parseType();
+			while (accept(",")) {
+				gep->operands.push_back(parseTypedValue());
+			}
+			expect(")");
+
+			std::vector<BcValue*> indices(gep->operands.begin() + 1, gep->operands.end());
+			gep->type = llvmTypes().pointerTo(indexedType(gep->sourceType, indices));
+			return gep;
+		}
+
+		unsupported();
+	}
+
+	BcValue* parseTypedValue() {
+		LlvmType* type = parseType();
+		return parseValue(type);
+	}
+
+	// Linkage, visibility and the like, wherever they come in a global's line
+	bool parseGlobalAttribute(unsigned& linkage, bool& dsoLocal, unsigned* unnamedAddr, unsigned* visibility, unsigned* dllStorage) {
+		if (tok.kind != Token::Kind::WORD) {
+			return false;
+		}
+
+		if (auto code = findBcCode(BC_LINKAGES, tok.text)) {
+			linkage = *code;
+		}
+		else if (tok.text == "dso_local") {
+			dsoLocal = true;
+		}
+		else if (tok.text == "dso_preemptable" || tok.text.starts_with("#")) {
+		}
+		else if (unnamedAddr && (tok.text == "unnamed_addr" || tok.text == "local_unnamed_addr")) {
+			*unnamedAddr = tok.text == "unnamed_addr" ? 1 : 2;
+		}
+		else if (visibility && (tok.text == "default" || tok.text == "hidden" || tok.text == "protected")) {
+			*visibility = tok.text == "default" ? 0 : tok.text == "hidden" ? 1 : 2;
+		}
+		else if (dllStorage && (tok.text == "dllimport" || tok.text == "dllexport")) {
+			*dllStorage = tok.text == "dllimport" ? 1 : 2;
+		}
+		else {
+			return false;
+		}
+
+		advance();
+		return true;
+	}
+
+	// @name = private unnamed_addr constant [4 x i8] c"...", align 1
+	void parseGlobal() {
+		BcGlobal& global = module.globals.emplace_back();
+		global.name = expectKind(Token::Kind::GLOBAL);
+		expect("=");
+
+		while (parseGlobalAttribute(global.linkage, global.dsoLocal, &global.unnamedAddr, nullptr, nullptr)) {
+		}
+
+		if (accept("constant")) {
+			global.constant = true;
+		}
+		else {
+			expect("global");
+		}
+
+		global.valueType = parseType();
+		global.type = llvmTypes().pointerTo(global.valueType);
+
+		// Only a declaration of a global defined elsewhere has no initializer
+		if (tok.kind != Token::Kind::END && !is(",")) {
+			global.init = static_cast<BcConstant*>(parseValue(global.valueType));
+		}
+
+		if (accept(",")) {
+			global.align = parseAlign();
+		}
+
+		module.globalNames[global.name] = &global;
+	}
+
+	// define or declare, up to the opening brace
+	void parseFunctionHeader(bool defined) {
+		BcFunction& fn = module.functions.emplace_back();
+		fn.defined = defined;
+		advance();
+
+		while (parseGlobalAttribute(fn.linkage, fn.dsoLocal, nullptr, &fn.visibility, &fn.dllStorage)) {
+		}
+
+		LlvmType* returns = parseType();
+		fn.name = expectKind(Token::Kind::GLOBAL);
+
+		std::vector<LlvmType*> params;
+		bool varArg = false;
+
+		expect("(");
+		while (!accept(")")) {
+			if (accept("...")) {
+				varArg = true;
+			}
+			else {
+				params.push_back(parseType());
+				fn.argNames.push_back(tok.kind == Token::Kind::LOCAL ? expectKind(Token::Kind::LOCAL) : std::string_view());
+			}
+			accept(",");
+		}
+
+		unsigned unnamedAddr = 0;
+		while (parseGlobalAttribute(fn.linkage, fn.dsoLocal, &unnamedAddr, &fn.visibility, &fn.dllStorage)) {
+		}
+
+		if (defined) {
+			expect("{");
+		}
+
+		fn.fnType = llvmTypes().functionType(returns, params, varArg);
+		fn.type = llvmTypes().pointerTo(fn.fnType);
+
+		module.globalNames[fn.name] = &fn;
+	}
+
+	BcInstruction& parseInstruction(BcFunction& fn, std::string_view opcode) {
+		if (opcode == "alloca") {
+			BcInstruction& inst = fn.body.emplace_back(BcInstruction::Op::ALLOCA);
+			inst.explicitType = parseType();
+			inst.type = llvmTypes().pointerTo(inst.explicitType);
+
+			while (accept(",")) {
+				if (is("align")) {
+					inst.align = parseAlign();
+				}
+				else {
+					inst.operands.push_back(parseTypedValue());
+				}
+			}
+
+			if (inst.operands.empty()) {
+				inst.operands.push_back(intConstant(llvmTypes().intType(32), 1));
+			}
+			return inst;
+		}
+
+		if (opcode == "load") {
+			BcInstruction& inst = fn.body.emplace_back(BcInstruction::Op::LOAD);
+			inst.explicitType = parseType();
+			inst.type = inst.explicitType;
+			expect(",");
+			inst.operands.push_back(parseTypedValue());
+
+			if (accept(",")) {
+				inst.align = parseAlign();
+			}
+			return inst;
+		}
+
+		if (opcode == "store") {
+			BcInstruction& inst = fn.body.emplace_back(BcInstruction::Op::STORE);
+			BcValue* val = parseTypedValue();
+			expect(",");
+			inst.operands = { parseTypedValue(), val };
+
+			if (accept(",")) {
+				inst.align = parseAlign();
+			}
+			return inst;
+		}
+
+		if (auto code = findBcCode(BC_BINARY_OPS, opcode)) {
+			BcInstruction& inst = fn.body.emplace_back(BcInstruction::Op::BINARY);
+			inst.code = *code;
+
+			while (true) {
+				if (accept("nuw") || accept("exact")) {
+					inst.flags |= 1;
+				}
+				else if (accept("nsw")) {
+					inst.flags |= 2;
+				}
+				else {
+					break;
+				}
+			}
+
+			inst.type = parseType();
+			inst.operands.push_back(parseValue(inst.type));
+			expect(",");
+			inst.operands.push_back(parseValue(inst.type));
+			return inst;
+		}
+
+		if (opcode == "icmp") {
+			BcInstruction& inst = fn.body.emplace_back(BcInstruction::Op::CMP);
+
+			auto code = findBcCode(BC_ICMP_PREDICATES, tok.text);
+			if (!code) {
+				unsupported();
+			}
+			inst.code = *code;
+			advance();
+
+			LlvmType* type = parseType();
+			inst.operands.push_back(parseValue(type));
+			expect(",");
+			inst.operands.push_back(parseValue(type));
+			inst.type = llvmTypes().intType(1);
+			return inst;
+		}
+
+		if (opcode == "br") {
+			BcInstruction& inst = fn.body.emplace_back(BcInstruction::Op::BR);
+
+			if (!is("label")) {
+				inst.operands.push_back(parseTypedValue());
+				expect(",");
+			}
+
+			expect("label");
+			inst.labels.push_back(expectKind(Token::Kind::LOCAL));
+
+			if (accept(",")) {
+				expect("label");
+				inst.labels.push_back(expectKind(Token::Kind::LOCAL));
+			}
+			return inst;
+		}
+
+		if (opcode == "ret") {
+			BcInstruction& inst = fn.body.emplace_back(BcInstruction::Op::RET);
+			if (!accept("void")) {
+				inst.operands.push_back(parseTypedValue());
+			}
+			return inst;
+		}
+
+		if (opcode == "call") {
+			BcInstruction& inst = fn.body.emplace_back(BcInstruction::Op::CALL);
+			LlvmType* type = parseType();
+
+			if (tok.kind != Token::Kind::GLOBAL) {
+				unsupported();
+			}
+
+			auto found = module.globalNames.find(tok.text);
+			if (found == module.globalNames.end() || found->second->type->kind != LlvmType::Kind::POINTER ||
+				static_cast<LlvmTypePtr*>(found->second->type)->destType->kind != LlvmType::Kind::FUNCTION) {
+				unsupported();
+			}
+			advance();
+
+			// The function type is only written out for calls to varargs functions
+			LlvmTypeFunction* fnType = type->kind == LlvmType::Kind::FUNCTION ?
+				static_cast<LlvmTypeFunction*>(type) : static_cast<BcFunction*>(found->second)->fnType;
+
+			inst.explicitType = fnType;
+			inst.type = fnType->returns;
+			inst.operands.push_back(found->second);
+
+			expect("(");
+			while (!accept(")")) {
+				inst.operands.push_back(parseTypedValue());
+				accept(",");
+			}
+			return inst;
+		}
+
+		if (opcode == "getelementptr") {
+			BcInstruction& inst = fn.body.emplace_back(BcInstruction::Op::GEP);
+			inst.flags = accept("inbounds");
+			inst.explicitType = parseType();
+
+			while (accept(",")) {
+				inst.operands.push_back(parseTypedValue());
+			}
+
+			std::vector<BcValue*> indices(inst.operands.begin() + 1, inst.operands.end());
+			inst.type = llvmTypes().pointerTo(indexedType(inst.explicitType, indices));
+			return inst;
+		}
+
+		if (auto code = findBcCode(BC_CASTS, opcode)) {
+			BcInstruction& inst = fn.body.emplace_back(BcInstruction::Op::CAST);
+			inst.code = *code;
+			inst.operands.push_back(parseTypedValue());
+			expect("to");
+			inst.explicitType = parseType();
+			inst.type = inst.explicitType;
+			return inst;
+		}
+
+		unsupported();
+	}
+
+	void parseBody(BcFunction& fn) {
+		locals.clear();
+
+		for (size_t i = 0; i < fn.fnType->args.size(); i++) {
+			BcValue& arg = fn.args.emplace_back();
+			arg.type = fn.fnType->args[i];
+			locals[fn.argNames[i]] = &arg;
+		}
+
+		std::unordered_map<std::string_view, uint64_t> blocks;
+		bool inBlock = false;
+
+		for (size_t i = fn.firstLine; i < fn.endLine; i++) {
+			start(lines[i]);
+			if (tok.kind == Token::Kind::END) {
+				continue;
+			}
+
+			// name: begins a block
+			std::string_view trimmed = line.substr(pos - tok.text.size());
+			while (!trimmed.empty() && std::isspace((unsigned char)trimmed.back())) {
+				trimmed.remove_suffix(1);
+			}
+			if (tok.kind == Token::Kind::WORD && trimmed.size() == tok.text.size() + 1 && trimmed.back() == ':') {
+				if (inBlock) {
+					unsupported();
+				}
+
+				blocks[tok.text] = fn.blockCount++;
+				inBlock = true;
+				continue;
+			}
+
+			std::string_view result;
+			if (tok.kind == Token::Kind::LOCAL) {
+				result = expectKind(Token::Kind::LOCAL);
+				expect("=");
+			}
+
+			accept("tail");
+			std::string_view opcode = expectKind(Token::Kind::WORD);
+
+			// An instruction after a terminator starts an unnamed block
+			if (!inBlock) {
+				fn.blockCount++;
+				inBlock = true;
+			}
+
+			BcInstruction& inst = parseInstruction(fn, opcode);
+			if (tok.kind != Token::Kind::END) {
+				unsupported();
+			}
+
+			if (!result.empty()) {
+				if (!inst.producesValue()) {
+					unsupported();
+				}
+				locals[result] = &inst;
+			}
+
+			if (inst.op == BcInstruction::Op::BR || inst.op == BcInstruction::Op::RET) {
+				inBlock = false;
+			}
+		}
+
+		if (inBlock) {
+			line = lines[fn.endLine];
+			unsupported();
+		}
+
+		for (auto& inst : fn.body) {
+			for (auto& label : inst.labels) {
+				auto found = blocks.find(label);
+				if (found == blocks.end()) {
+					line = label;
+					unsupported();
+				}
+				inst.blocks.push_back(found->second);
+			}
+		}
+	}
+
+public:
+	IrTextReader(BcModule& module_) : module(module_) {}
+
+	// The module refers into text, which has to outlive it
+	void read(std::string_view text) {
+		while (!text.empty()) {
+			size_t end = text.find('\n');
+			lines.push_back(text.substr(0, end));
+			text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+		}
+
+		// Everything global first, so that bodies can refer to functions defined after them
+		for (size_t i = 0; i < lines.size(); i++) {
+			start(lines[i]);
+
+			if (tok.kind == Token::Kind::END || is("attributes") || is("!")) {
+				continue;
+			}
+
+			if (accept("source_filename")) {
+				expect("=");
+				module.sourceFilename = expectKind(Token::Kind::STRING);
+			}
+			else if (accept("target")) {
+				bool isTriple = accept("triple");
+				if (!isTriple) {
+					expect("datalayout");
+				}
+				expect("=");
+				(isTriple ? module.triple : module.dataLayout) = expectKind(Token::Kind::STRING);
+			}
+			else if (tok.kind == Token::Kind::LOCAL) {
+				// %struct.Name = type { ... }, whose struct already exists in the type table
+				LlvmType* type = parseType();
+				expect("=");
+				expect("type");
+
+				if (type->kind != LlvmType::Kind::IDENTIFIED_STRUCT) {
+					unsupported();
+				}
+				if (!accept("opaque")) {
+					static_cast<LlvmTypeIdentifiedStruct*>(type)->type = parseStructBody(false);
+				}
+			}
+			else if (tok.kind == Token::Kind::GLOBAL) {
+				parseGlobal();
+			}
+			else if (is("declare")) {
+				parseFunctionHeader(false);
+			}
+			else if (is("define")) {
+				parseFunctionHeader(true);
+
+				BcFunction& fn = module.functions.back();
+				fn.firstLine = i + 1;
+
+				for (i++; i < lines.size(); i++) {
+					std::string_view trimmed = lines[i].substr(std::min(lines[i].size(), lines[i].find_first_not_of(" \t\r")));
+					if (trimmed.starts_with("}")) {
+						break;
+					}
+				}
+
+				if (i >= lines.size()) {
+					unsupported();
+				}
+				fn.endLine = i;
+				continue;
+			}
+			else {
+				unsupported();
+			}
+
+			if (tok.kind != Token::Kind::END) {
+				unsupported();
+			}
+		}
+
+		for (auto& fn : module.functions) {
+			if (fn.defined) {
+				parseBody(fn);
+			}
+		}
+	}
+};
+
+
+// Writes a module as LLVM bitcode without going through LLVM
+// Names of values inside functions, attributes and metadata aren't kept, none of which change the generated code
+class BitcodeWriter {
+	enum BlockId : unsigned {
+		MODULE_BLOCK = 8,
+		CONSTANTS_BLOCK = 11,
+		FUNCTION_BLOCK = 12,
+		IDENTIFICATION_BLOCK = 13,
+		TYPE_BLOCK = 17,
+		STRTAB_BLOCK = 23
+	};
+
+	constexpr static unsigned ABBREV_WIDTH = 4;
+	constexpr static uint32_t PENDING = UINT32_MAX;
+
+	BcModule& module;
+	BitstreamWriter out;
+
+	std::vector<LlvmType*> typeList;
+	std::unordered_map<LlvmType*, uint32_t> typeIds;
+
+	// Names of every global and function, which their records refer to by offset
+	std::string strtab;
+
+	// Values declared at module level, which come before those of every function
+	uint32_t moduleValues = 0;
+
+	[[noreturn]] static void unsupported(std::string_view what) {
+		throw SourceError(DiagId::BITCODE_UNSUPPORTED, what);
+	}
+
+	// Types a type is built from, which have to be numbered before it
+	static std::vector<LlvmType*> subtypes(LlvmType* type) {
+		switch (type->kind) {
+		case LlvmType::Kind::POINTER:
+			return { static_cast<LlvmTypePtr*>(type)->destType };
+		case LlvmType::Kind::ARRAY:
+			return { static_cast<LlvmTypeArray*>(type)->dataType };
+		case LlvmType::Kind::VECTOR:
+			return { static_cast<LlvmTypeVec*>(type)->dataType };
+		case LlvmType::Kind::LITERAL_STRUCT:
+			return static_cast<LlvmTypeLiteralStruct*>(type)->members;
+		case LlvmType::Kind::IDENTIFIED_STRUCT: {
+			LlvmTypeLiteralStruct* body = static_cast<LlvmTypeIdentifiedStruct*>(type)->type;
+			return body ? body->members : std::vector<LlvmType*>();
+		}
+		case LlvmType::Kind::FUNCTION: {
+			auto* fn = static_cast<LlvmTypeFunction*>(type);
+			std::vector<LlvmType*> out = { fn->returns };
+			out.insert(out.end(), fn->args.begin(), fn->args.end());
+			return out;
+		}
+		default:
+			return {};
+		}
+	}
+
+	// Numbers a type after everything it's built from
+	// Named structs may be referred to before they are numbered, which is what lets them contain pointers to themselves
+	void enumerateType(LlvmType* type) {
+		if (!type || typeIds.contains(type)) {
+			return;
+		}
+
+		if (type->kind == LlvmType::Kind::IDENTIFIED_STRUCT) {
+			typeIds[type] = PENDING;
+		}
+
+		for (auto& i : subtypes(type)) {
+			enumerateType(i);
+		}
+
+		auto found = typeIds.find(type);
+		if (found != typeIds.end() && found->second != PENDING) {
+			return;
+		}
+
+		typeIds[type] = (uint32_t)typeList.size();
+		typeList.push_back(type);
+	}
+
+	uint64_t typeId(LlvmType* type) {
+		return typeIds.at(type);
+	}
+
+	void enumerate() {
+		for (auto& i : module.globals) {
+			enumerateType(i.valueType);
+			enumerateType(i.type);
+		}
+
+		for (auto& i : module.functions) {
+			enumerateType(i.fnType);
+			enumerateType(i.type);
+
+			for (auto& inst : i.body) {
+				enumerateType(inst.type);
+				enumerateType(inst.explicitType);
+				for (auto& op : inst.operands) {
+					enumerateType(op->type);
+				}
+			}
+		}
+
+		for (auto& i : module.constants) {
+			enumerateType(i.type);
+			enumerateType(i.sourceType);
+		}
+
+		// Globals, then functions, then constants, in the order their records are written
+		for (auto& i : module.globals) {
+			i.id = moduleValues++;
+		}
+		for (auto& i : module.functions) {
+			i.id = moduleValues++;
+		}
+		for (auto& i : module.constants) {
+			i.id = moduleValues++;
+		}
+	}
+
+	void writeIdentification() {
+		out.enterBlock(IDENTIFICATION_BLOCK, ABBREV_WIDTH);
+		out.emitRecord(1, "C1"); // Producer
+		out.emitRecord(2, std::vector<uint64_t>{ 0 }); // Epoch
+		out.exitBlock();
+	}
+
+	void writeTypes() {
+		out.enterBlock(TYPE_BLOCK, ABBREV_WIDTH);
+		out.emitRecord(1, std::vector<uint64_t>{ typeList.size() }); // NUMENTRY
+
+		for (auto& type : typeList) {
+			switch (type->kind) {
+			case LlvmType::Kind::VOID:
+				out.emitRecord(2, std::vector<uint64_t>{});
+				break;
+			case LlvmType::Kind::LABEL:
+				out.emitRecord(5, std::vector<uint64_t>{});
+				break;
+			case LlvmType::Kind::INT:
+				out.emitRecord(7, std::vector<uint64_t>{ (uint64_t)static_cast<LlvmTypeInt*>(type)->width });
+				break;
+			case LlvmType::Kind::FLOAT: {
+				constexpr unsigned FLOAT_CODES[] = { 10, 23, 3, 4, 14, 13, 15 };
+				out.emitRecord(FLOAT_CODES[static_cast<LlvmTypeFloat*>(type)->type], std::vector<uint64_t>{});
+				break;
+			}
+			case LlvmType::Kind::POINTER:
+				out.emitRecord(8, std::vector<uint64_t>{ typeId(static_cast<LlvmTypePtr*>(type)->destType), 0 });
+				break;
+			case LlvmType::Kind::ARRAY: {
+				auto* array = static_cast<LlvmTypeArray*>(type);
+				out.emitRecord(11, std::vector<uint64_t>{ (uint64_t)array->size, typeId(array->dataType) });
+				break;
+			}
+			case LlvmType::Kind::VECTOR: {
+				auto* vec = static_cast<LlvmTypeVec*>(type);
+				out.emitRecord(12, std::vector<uint64_t>{ (uint64_t)vec->size, typeId(vec->dataType) });
+				break;
+			}
+			case LlvmType::Kind::FUNCTION: {
+				auto* fn = static_cast<LlvmTypeFunction*>(type);
+				std::vector<uint64_t> ops = { fn->varArg, typeId(fn->returns) };
+				for (auto& i : fn->args) {
+					ops.push_back(typeId(i));
+				}
+				out.emitRecord(21, ops);
+				break;
+			}
+			case LlvmType::Kind::LITERAL_STRUCT: {
+				auto* literal = static_cast<LlvmTypeLiteralStruct*>(type);
+				std::vector<uint64_t> ops = { literal->packed };
+				for (auto& i : literal->members) {
+					ops.push_back(typeId(i));
+				}
+				out.emitRecord(18, ops);
+				break;
+			}
+			case LlvmType::Kind::IDENTIFIED_STRUCT: {
+				auto* named = static_cast<LlvmTypeIdentifiedStruct*>(type);
+				out.emitRecord(19, "struct." + named->prettyName);
+
+				if (!named->type) {
+					out.emitRecord(6, std::vector<uint64_t>{ 0 }); // Opaque
+					break;
+				}
+
+				std::vector<uint64_t> ops = { named->type->packed };
+				for (auto& i : named->type->members) {
+					ops.push_back(typeId(i));
+				}
+				out.emitRecord(20, ops);
+				break;
+			}
+			default:
+				unsupported(type->name());
+			}
+		}
+
+		out.exitBlock();
+	}
+
+	std::vector<uint64_t> strtabName(std::string_view name) {
+		std::vector<uint64_t> ops = { strtab.size(), name.size() };
+		strtab += name;
+		return ops;
+	}
+
+	void writeGlobals() {
+		for (auto& i : module.globals) {
+			// The value type is given explicitly rather than as the pointer's, in address space 0
+			std::vector<uint64_t> ops = strtabName(i.name);
+			ops.insert(ops.end(), {
+				typeId(i.valueType), 2ull | i.constant, i.init ? i.init->id + 1ull : 0ull, i.linkage, i.align,
+				0, 0, 0, i.unnamedAddr, 0, 0, 0, 0, i.dsoLocal
+			});
+			out.emitRecord(7, ops);
+		}
+
+		for (auto& i : module.functions) {
+			std::vector<uint64_t> ops = strtabName(i.name);
+			ops.insert(ops.end(), {
+				typeId(i.fnType), 0, !i.defined, i.linkage, 0, 0, 0, i.visibility, 0, 0, 0, i.dllStorage,
+				0, 0, 0, i.dsoLocal, 0
+			});
+			out.emitRecord(8, ops);
+		}
+	}
+
+	static uint64_t encodeSigned(int64_t val) {
+		return val >= 0 ? (uint64_t)val << 1 : ((uint64_t)-val << 1) | 1;
+	}
+
+	void writeConstants() {
+		if (module.constants.empty()) {
+			return;
+		}
+
+		out.enterBlock(CONSTANTS_BLOCK, ABBREV_WIDTH);
+		LlvmType* lastType = nullptr;
+
+		for (auto& i : module.constants) {
+			if (i.type != lastType) {
+				out.emitRecord(1, std::vector<uint64_t>{ typeId(i.type) }); // SETTYPE
+				lastType = i.type;
+			}
+
+			switch (i.kind) {
+			case BcConstant::Kind::INT:
+				out.emitRecord(4, std::vector<uint64_t>{ encodeSigned(i.value) });
+				break;
+			case BcConstant::Kind::NULL_VALUE:
+				out.emitRecord(2, std::vector<uint64_t>{});
+				break;
+			case BcConstant::Kind::UNDEF:
+				out.emitRecord(3, std::vector<uint64_t>{});
+				break;
+			case BcConstant::Kind::STRING: {
+				// CSTRING leaves off the null terminator
+				std::string_view bytes = i.bytes;
+				bool terminated = !bytes.empty() && bytes.back() == '\0';
+				if (terminated) {
+					bytes.remove_suffix(1);
+				}
+				out.emitRecord(terminated ? 9 : 8, std::vector<uint64_t>(bytes.begin(), bytes.end()));
+				break;
+			}
+			case BcConstant::Kind::GEP: {
+				std::vector<uint64_t> ops = { typeId(i.sourceType) };
+				for (auto& op : i.operands) {
+					ops.push_back(typeId(op->type));
+					ops.push_back(op->id);
+				}
+				out.emitRecord(i.inBounds ? 20 : 12, ops);
+				break;
+			}
+			}
+		}
+
+		out.exitBlock();
+	}
+
+	// Operands of instructions are numbered back from the instruction
+	static uint64_t relative(BcValue* value, uint32_t instId) {
+		if (value->id >= instId) {
+			unsupported("a forward reference");
+		}
+		return instId - value->id;
+	}
+
+	void writeFunction(BcFunction& fn) {
+		out.enterBlock(FUNCTION_BLOCK, ABBREV_WIDTH);
+		out.emitRecord(1, std::vector<uint64_t>{ fn.blockCount }); // DECLAREBLOCKS
+
+		uint32_t next = moduleValues;
+		for (auto& i : fn.args) {
+			i.id = next++;
+		}
+
+		for (auto& inst : fn.body) {
+			std::vector<uint64_t> ops;
+			unsigned code = 0;
+
+			switch (inst.op) {
+			case BcInstruction::Op::ALLOCA:
+				// The size is given absolutely, and bit 6 of the alignment marks the type as explicit
+				code = 19;
+				ops = { typeId(inst.explicitType), typeId(inst.operands[0]->type), inst.operands[0]->id, inst.align | (1u << 6) };
+				break;
+			case BcInstruction::Op::LOAD:
+				code = 20;
+				ops = { relative(inst.operands[0], next), typeId(inst.explicitType), inst.align, 0 };
+				break;
+			case BcInstruction::Op::STORE:
+				code = 44;
+				ops = { relative(inst.operands[0], next), relative(inst.operands[1], next), inst.align, 0 };
+				break;
+			case BcInstruction::Op::BINARY:
+				code = 2;
+				ops = { relative(inst.operands[0], next), relative(inst.operands[1], next), inst.code };
+				if (inst.flags) {
+					ops.push_back(inst.flags);
+				}
+				break;
+			case BcInstruction::Op::CMP:
+				code = 28;
+				ops = { relative(inst.operands[0], next), relative(inst.operands[1], next), inst.code };
+				break;
+			case BcInstruction::Op::BR:
+				code = 11;
+				ops = inst.blocks;
+				if (!inst.operands.empty()) {
+					ops.push_back(relative(inst.operands[0], next));
+				}
+				break;
+			case BcInstruction::Op::RET:
+				code = 10;
+				if (!inst.operands.empty()) {
+					ops.push_back(relative(inst.operands[0], next));
+				}
+				break;
+			case BcInstruction::Op::CALL:
+				// No attributes, the C calling convention, and an explicit function type
+				code = 34;
+				ops = { 0, 1u << 15, typeId(inst.explicitType) };
+				for (auto& i : inst.operands) {
+					ops.push_back(relative(i, next));
+				}
+				break;
+			case BcInstruction::Op::GEP:
+				code = 43;
+				ops = { inst.flags, typeId(inst.explicitType) };
+				for (auto& i : inst.operands) {
+					ops.push_back(relative(i, next));
+				}
+				break;
+			case BcInstruction::Op::CAST:
+				code = 3;
+				ops = { relative(inst.operands[0], next), typeId(inst.explicitType), inst.code };
+				break;
+			}
+
+			out.emitRecord(code, ops);
+
+			if (inst.producesValue()) {
+				inst.id = next++;
+			}
+		}
+
+		out.exitBlock();
+	}
+
+	void writeStrtab() {
+		out.enterBlock(STRTAB_BLOCK, ABBREV_WIDTH);
+		unsigned abbrev = out.defineBlobAbbrev(1);
+		out.emitBlob(abbrev, strtab);
+		out.exitBlock();
+	}
+
+public:
+	BitcodeWriter(BcModule& module_) : module(module_) {}
+
+	OutputBuffer write() {
+		enumerate();
+
+		for (char c : std::string_view("BC\xC0\xDE")) {
+			out.emit((unsigned char)c, 8);
+		}
+
+		writeIdentification();
+
+		out.enterBlock(MODULE_BLOCK, ABBREV_WIDTH);
+		out.emitRecord(1, std::vector<uint64_t>{ 2 }); // Version 2 keeps names in the string table
+
+		writeTypes();
+
+		out.emitRecord(2, module.triple);
+		out.emitRecord(3, module.dataLayout);
+		out.emitRecord(16, module.sourceFilename);
+
+		writeGlobals();
+		writeConstants();
+
+		for (auto& i : module.functions) {
+			if (i.defined) {
+				writeFunction(i);
+			}
+		}
+
+		out.exitBlock();
+
+		writeStrtab();
+
+		OutputBuffer bytes;
+		bytes << out.bytes();
+		return bytes;
+	}
+};
+
+// Makes bitcode from the text of a whole module
+inline OutputBuffer assembleBitcode(std::string_view ir) {
+	BcModule module;
+	IrTextReader(module).read(ir);
+	return BitcodeWriter(module).write();
+}
+
+#endif // ifndef COMPILER_BITCODE_H
@@ -0,0 +1,169 @@
+#ifndef COMPILER_BITSTREAM_H
+#define COMPILER_BITSTREAM_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+// Writes the bit-level container LLVM bitcode is stored in
+// Fields are packed from the least significant bit up into little endian 32 bit words
+class BitstreamWriter {
+public:
+	// Abbreviation ids that mean the same thing in every block
+	enum BuiltinAbbrev : unsigned {
+		END_BLOCK = 0,
+		ENTER_SUBBLOCK = 1,
+		DEFINE_ABBREV = 2,
+		UNABBREV_RECORD = 3,
+
+		// Given to the first abbreviation a block defines
+		FIRST_APPLICATION_ABBREV = 4
+	};
+
+	// How an abbreviation encodes one operand
+	enum class Encoding : unsigned {
+		FIXED = 1,
+		VBR = 2,
+		ARRAY = 3,
+		CHAR6 = 4,
+		BLOB = 5
+	};
+
+private:
+	std::string out;
+
+	// Bits not yet written, filled from the least significant
+	uint32_t current = 0;
+	unsigned currentBits = 0;
+
+	unsigned abbrevWidth = 2;
+	unsigned nextAbbrev = FIRST_APPLICATION_ABBREV;
+
+	struct Block {
+		unsigned outerAbbrevWidth;
+		unsigned outerNextAbbrev;
+		size_t lengthOffset; // Where the word holding the block's length in words is
+	};
+
+	std::vector<Block> blocks;
+
+	void writeWord(uint32_t word) {
+		for (int i = 0; i < 4; i++) {
+			out += (char)((word >> (i * 8)) & 0xFF);
+		}
+	}
+
+public:
+	// Writes the low bits of val, at most 32 at once
+	void emit(uint32_t val, unsigned bits) {
+		current |= val << currentBits;
+
+		if (currentBits + bits < 32) {
+			currentBits += bits;
+			return;
+		}
+
+		writeWord(current);
+		current = currentBits ? val >> (32 - currentBits) : 0;
+		currentBits = (currentBits + bits) & 31;
+	}
+
+	// Variable width: chunks of bits - 1 value bits, each with a high bit set if another chunk follows
+	void emitVbr(uint64_t val, unsigned bits) {
+		uint64_t threshold = 1ull << (bits - 1);
+
+		while (val >= threshold) {
+			emit((uint32_t)((val & (threshold - 1)) | threshold), bits);
+			val >>= bits - 1;
+		}
+
+		emit((uint32_t)val, bits);
+	}
+
+	void alignTo32() {
+		if (currentBits > 0) {
+			writeWord(current);
+			current = 0;
+			currentBits = 0;
+		}
+	}
+
+	void enterBlock(unsigned id, unsigned width) {
+		emit(ENTER_SUBBLOCK, abbrevWidth);
+		emitVbr(id, 8);
+		emitVbr(width, 4);
+		alignTo32();
+
+		// The length is filled in once the block ends
+		blocks.push_back({ abbrevWidth, nextAbbrev, out.size() });
+		writeWord(0);
+
+		abbrevWidth = width;
+		nextAbbrev = FIRST_APPLICATION_ABBREV;
+	}
+
+	void exitBlock() {
+		emit(END_BLOCK, abbrevWidth);
+		alignTo32();
+
+		Block block = blocks.back();
+		blocks.pop_back();
+
+		uint32_t words = (uint32_t)((out.size() - block.lengthOffset - 4) / 4);
+		for (int i = 0; i < 4; i++) {
+			out[block.lengthOffset + i] = (char)((words >> (i * 8)) & 0xFF);
+		}
+
+		abbrevWidth = block.outerAbbrevWidth;
+		nextAbbrev = block.outerNextAbbrev;
+	}
+
+	// A record with every operand written as a 6 bit VBR, which needs no abbreviation
+	void emitRecord(unsigned code, const std::vector<uint64_t>& ops) {
+		emit(UNABBREV_RECORD, abbrevWidth);
+		emitVbr(code, 6);
+		emitVbr(ops.size(), 6);
+
+		for (auto& i : ops) {
+			emitVbr(i, 6);
+		}
+	}
+
+	void emitRecord(unsigned code, std::string_view chars) {
+		emitRecord(code, std::vector<uint64_t>(chars.begin(), chars.end()));
+	}
+
+	// Defines an abbreviation for a record made of code followed by one blob, returning its id
+	// Blobs can only be written through an abbreviation
+	unsigned defineBlobAbbrev(unsigned code) {
+		emit(DEFINE_ABBREV, abbrevWidth);
+		emitVbr(2, 5);
+
+		emit(1, 1); // Literal
+		emitVbr(code, 8);
+
+		emit(0, 1);
+		emit((uint32_t)Encoding::BLOB, 3);
+
+		return nextAbbrev++;
+	}
+
+	void emitBlob(unsigned abbrev, std::string_view blob) {
+		emit(abbrev, abbrevWidth);
+		emitVbr(blob.size(), 6);
+		alignTo32();
+
+		out += blob;
+		while (out.size() % 4) {
+			out += '\0';
+		}
+	}
+
+	const std::string& bytes() {
+		alignTo32();
+		return out;
+	}
+};
+
+#endif // ifndef COMPILER_BITSTREAM_H
@@ -0,0 +1,367 @@
+#ifndef COMPILER_CONSTEVAL_H
+#define COMPILER_CONSTEVAL_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <variant>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+
+#include "cppType.h"
+#include "forward.h"
+#include "type.h"
+
+// A call to evaluate, by the function and the values of its arguments
+struct ConstCallKey {
+	Function* fn;
+	std::vector<int64_t> args;
+
+	bool operator==(const ConstCallKey&) const = default;
+};
+
+struct ConstCallKeyHash {
+	std::size_t operator()(const ConstCallKey& key) const noexcept {
+		std::size_t hash = std::hash<Function*>{}(key.fn);
+		for (auto& i : key.args) {
+			hash = hash * 31 + std::hash<int64_t>{}(i);
+		}
+		return hash;
+	}
+};
+
+// Shared by every thread emitting functions: the limits on one evaluation, and the outcome of each call made from a
+// function being emitted so far. Those calls start with the whole of the limits, so their outcome doesn't depend on
+// which thread got to them first. A call that failed is kept with its error, so a consteval call can still report why
+class ConstCache {
+	using Result = std::variant<int64_t, SourceError>;
+
+	std::mutex lock;
+	std::unordered_map<ConstCallKey, Result, ConstCallKeyHash> results;
+
+public:
+	// AST nodes evaluated, including the calls they make
+	size_t maxSteps = 1 << 20;
+
+	// Nested calls, since each one is a frame of the compiler's own stack
+	size_t maxDepth = 512;
+
+	// Bytes of the frames alive at once and of the results an evaluation remembers
+	size_t maxMemory = 1 << 20;
+
+	// Calls kept, after which new outcomes are evaluated every time
+	size_t maxEntries = 1 << 16;
+
+	static ConstCache& global() {
+		static ConstCache cache;
+		return cache;
+	}
+
+	// Returns the value, throws the error it failed with, or returns false if it hasn't been evaluated
+	bool find(const ConstCallKey& key, int64_t& value) {
+		std::lock_guard guard(lock);
+
+		auto found = results.find(key);
+		if (found == results.end()) {
+			return false;
+		}
+
+		if (auto err = std::get_if<SourceError>(&found->second)) {
+			throw *err;
+		}
+
+		value = std::get<int64_t>(found->second);
+		return true;
+	}
+
+	void insert(const ConstCallKey& key, Result result) {
+		std::lock_guard guard(lock);
+		if (results.size() < maxEntries) {
+			results.emplace(key, std::move(result));
+		}
+	}
+};
+
+inline ConstCache& constCache() {
+	return ConstCache::global();
+}
+
+// Runs constexpr and consteval functions over the AST at compile time, so their calls can be emitted as constants
+// Values are held in 64 bits, sign extended from the width of their type, and are computed the same way the
+// generated code would compute them. Anything that depends on the running program, like a pointer or a call to
+// print, and anything the generated code leaves undefined, like signed overflow, throws instead
+class ConstEvaluator {
+	struct Frame {
+		Function* fn;
+		const std::vector<int64_t>* args;
+
+		// Variables by declaration, which are never declared twice in one frame since there are no loops
+		std::vector<std::pair<VariableDeclaration*, int64_t>> variables;
+
+		// Given back when the call returns
+		size_t bytes;
+	};
+
+	// Charged for each call on top of its arguments and variables
+	constexpr static size_t FRAME_BYTES = 64;
+
+	ConstCache& cache = constCache();
+
+	std::vector<Frame> frames;
+
+	// Results of the calls nested in the current outermost one, which are only valid under its limits
+	std::unordered_map<ConstCallKey, int64_t, ConstCallKeyHash> memo;
+
+	size_t steps = 0;
+	size_t memory = 0;
+
+	void charge(size_t bytes) {
+		memory += bytes;
+		if (memory > cache.maxMemory) {
+			throw SourceError(DiagId::CONSTANT_LIMIT, std::to_string(cache.maxMemory), "bytes");
+		}
+	}
+
+	static size_t bytesOf(CppType* type) {
+		return std::max(type->size(), 1);
+	}
+
+	[[noreturn]] static void undefined(std::string_view what) {
+		throw SourceError(DiagId::CONSTANT_UNDEFINED, what);
+	}
+
+	int64_t* find(VariableDeclaration* decl) {
+		if (frames.empty()) {
+			return nullptr;
+		}
+
+		for (auto& [var, value] : frames.back().variables) {
+			if (var == decl) {
+				return &value;
+			}
+		}
+
+		return nullptr;
+	}
+
+	// Evaluates a call that isn't cached yet, defined in expression.cpp since it needs the whole Function
+	int64_t run(Function* fn, const std::vector<int64_t>& args);
+
+	void pushFrame(Function* fn, const std::vector<int64_t>& args) {
+		size_t bytes = FRAME_BYTES + args.size() * sizeof(int64_t);
+		charge(bytes);
+		frames.push_back({ fn, &args, {}, bytes });
+	}
+
+	void popFrame() {
+		memory -= frames.back().bytes;
+		frames.pop_back();
+	}
+
+public:
+	// Set by a return in the function being evaluated, until its call finishes
+	bool returning = false;
+	int64_t returnValue = 0;
+
+	// Truncates val to the width of type and extends it back, which is how a register of that type holds it
+	static int64_t normalize(int64_t val, CppType* type) {
+		int width = type->width();
+
+		if (width == 1) {
+			return val & 1;
+		}
+		if (width >= 64) {
+			return val;
+		}
+
+		int shift = 64 - width;
+		return (int64_t)((uint64_t)val << shift) >> shift;
+	}
+
+	// Evaluates exp, counting it against the step limit
+	int64_t value(Expression* exp) {
+		if (++steps > cache.maxSteps) {
+			throw SourceError(DiagId::CONSTANT_LIMIT, std::to_string(cache.maxSteps), "steps");
+		}
+
+		return exp->evaluate(*this);
+	}
+
+	// Evaluates statements until one returns
+	void run(const std::vector<Expression*>& statements) {
+		for (auto& i : statements) {
+			value(i);
+
+			if (returning) {
+				return;
+			}
+		}
+	}
+
+	// By position, since a declaration and the definition it was completed by have their own arguments
+	int64_t argument(FunctionArgument* arg);
+
+	void declare(VariableDeclaration* decl, int64_t val) {
+		if (frames.empty()) {
+			throw SourceError(DiagId::NOT_CONSTANT, decl->name);
+		}
+
+		charge(bytesOf(decl->type));
+		frames.back().bytes += bytesOf(decl->type);
+		frames.back().variables.emplace_back(decl, val);
+	}
+
+	// A variable of the function being evaluated, or else a constexpr one, which has the value it was initialized to
+	int64_t read(VariableDeclaration* decl) {
+		if (int64_t* val = find(decl)) {
+			return *val;
+		}
+
+		if (decl->_constexpr && decl->initializer) {
+			return normalize(value(decl->initializer), decl->type);
+		}
+
+		throw SourceError(DiagId::NOT_CONSTANT, decl->name);
+	}
+
+	void write(VariableDeclaration* decl, int64_t val) {
+		int64_t* var = find(decl);
+		if (!var) {
+			throw SourceError(DiagId::NOT_CONSTANT, decl->name);
+		}
+
+		*var = normalize(val, decl->type);
+	}
+
+	// The result of a call, from the cache if it has been evaluated before
+	// Each call made from a function being emitted gets the whole of the limits, so whether it fails doesn't depend on
+	// what was evaluated before it and its outcome can be shared. A call nested in it only reuses results from the same
+	// evaluation, since under the shared cache it would cost steps or not depending on what other threads had done
+	int64_t call(Function* fn, std::vector<int64_t> args) {
+		ConstCallKey key = { fn, std::move(args) };
+		bool outermost = frames.empty();
+
+		int64_t result;
+		if (outermost) {
+			if (cache.find(key, result)) {
+				return result;
+			}
+
+			steps = 0;
+			memory = 0;
+			memo.clear();
+		}
+		else if (auto found = memo.find(key); found != memo.end()) {
+			return found->second;
+		}
+
+		if (frames.size() == cache.maxDepth) {
+			throw SourceError(DiagId::CONSTANT_LIMIT, std::to_string(cache.maxDepth), "nested calls");
+		}
+
+		try {
+			result = run(fn, key.args);
+		}
+		catch (const SourceError& err) {
+			// A call inside another may have failed only because the outer one used up the limits
+			if (outermost) {
+				cache.insert(key, err);
+			}
+			throw;
+		}
+
+		if (outermost) {
+			cache.insert(key, result);
+		}
+		else {
+			charge(sizeof(ConstCallKey) + key.args.size() * sizeof(int64_t));
+			memo.emplace(std::move(key), result);
+		}
+		return result;
+	}
+
+	// +, -, *, /, %, &, |, ^, << and >> by the instruction they are emitted as
+	static int64_t binary(std::string_view op, CppType* type, int64_t lhs, int64_t rhs) {
+		int width = type->width();
+		int64_t result;
+
+		if (op == "add nsw" || op == "sub nsw" || op == "mul nsw") {
+			bool overflow;
+
+			if (width < 64) {
+				// Both fit in 32 bits, so the exact result fits in 64
+				result = op == "add nsw" ? lhs + rhs : op == "sub nsw" ? lhs - rhs : lhs * rhs;
+				overflow = result != normalize(result, type);
+			}
+			else if (op == "add nsw") {
+				overflow = rhs > 0 ? lhs > INT64_MAX - rhs : lhs < INT64_MIN - rhs;
+				result = (int64_t)((uint64_t)lhs + (uint64_t)rhs);
+			}
+			else if (op == "sub nsw") {
+				overflow = rhs < 0 ? lhs > INT64_MAX + rhs : lhs < INT64_MIN + rhs;
+				result = (int64_t)((uint64_t)lhs - (uint64_t)rhs);
+			}
+			else {
+				result = (int64_t)((uint64_t)lhs * (uint64_t)rhs);
+				overflow = lhs != 0 && ((lhs == -1 && rhs == INT64_MIN) || (rhs == -1 && lhs == INT64_MIN) || result / lhs != rhs);
+			}
+
+			if (overflow) {
+				undefined("signed overflow");
+			}
+			return result;
+		}
+
+		if (op == "sdiv" || op == "srem") {
+			if (rhs == 0) {
+				undefined("division by zero");
+			}
+
+			// The lowest value has no positive counterpart
+			if (rhs == -1 && lhs == normalize((int64_t)((uint64_t)1 << (width - 1)), type)) {
+				undefined("signed overflow");
+			}
+			return op == "sdiv" ? lhs / rhs : lhs % rhs;
+		}
+
+		if (op == "and") {
+			return lhs & rhs;
+		}
+		if (op == "or") {
+			return lhs | rhs;
+		}
+		if (op == "xor") {
+			return lhs ^ rhs;
+		}
+
+		if (op == "shl" || op == "ashr") {
+			if (rhs < 0 || rhs >= width) {
+				undefined("a shift by more than the width");
+			}
+			return op == "shl" ? normalize((int64_t)((uint64_t)lhs << rhs), type) : lhs >> rhs;
+		}
+
+		throw SourceError(DiagId::NOT_CONSTANT, op);
+	}
+
+	// The icmp predicates Compare is emitted with
+	static bool compare(std::string_view op, int64_t lhs, int64_t rhs) {
+		if (op == "slt") {
+			return lhs < rhs;
+		}
+		if (op == "sle") {
+			return lhs <= rhs;
+		}
+		if (op == "sgt") {
+			return lhs > rhs;
+		}
+		if (op == "sge") {
+			return lhs >= rhs;
+		}
+
+		throw SourceError(DiagId::NOT_CONSTANT, op);
+	}
+};
+
+#endif // ifndef COMPILER_CONSTEVAL_H
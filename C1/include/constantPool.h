@@ -0,0 +1,69 @@
+#ifndef COMPILER_CONSTANTPOOL_H
+#define COMPILER_CONSTANTPOOL_H
+
+#include <string>
+#include <string_view>
+#include <deque>
+#include <unordered_map>
+
+#include "outputBuffer.h"
+
+// The string constants of one module, where literals with the same bytes share one global
+// Filled while parsing and only read once functions are emitted, so it needs no lock
+class ConstantPool {
+public:
+	struct StringConstant {
+		std::string name; // @.str.N
+		std::string bytes; // Including the terminating null
+	};
+
+private:
+	// Entries never move, so the maps can refer into them
+	std::deque<StringConstant> strings;
+	std::unordered_map<std::string_view, const StringConstant*> byBytes;
+	std::unordered_map<std::string_view, const StringConstant*> byName;
+
+public:
+	const StringConstant& intern(std::string_view bytes) {
+		auto existing = byBytes.find(bytes);
+		if (existing != byBytes.end()) {
+			return *existing->second;
+		}
+
+		StringConstant& str = strings.emplace_back(StringConstant{ "@.str." + std::to_string(strings.size()), std::string(bytes) });
+		byBytes.emplace(str.bytes, &str);
+		byName.emplace(str.name, &str);
+		return str;
+	}
+
+	const StringConstant* find(std::string_view name) const {
+		auto str = byName.find(name);
+		return str == byName.end() ? nullptr : str->second;
+	}
+
+	const std::deque<StringConstant>& getStrings() const {
+		return strings;
+	}
+
+	// Printable characters are written as they are, everything else as a two digit hex escape
+	static void writeLlvmStr(OutputBuffer& out, std::string_view bytes) {
+		constexpr std::string_view HEX_DIGITS = "0123456789ABCDEF";
+
+		for (unsigned char c : bytes) {
+			if (c >= 0x20 && c < 0x7F && c != '"' && c != '\\') {
+				out << (char)c;
+			}
+			else {
+				out << '\\' << HEX_DIGITS[c >> 4] << HEX_DIGITS[c & 0xF];
+			}
+		}
+	}
+
+	static void write(OutputBuffer& out, const StringConstant& str) {
+		out << str.name << " = private unnamed_addr constant [" << str.bytes.size() << " x i8] c\"";
+		writeLlvmStr(out, str.bytes);
+		out << "\", align 1\n";
+	}
+};
+
+#endif // ifndef COMPILER_CONSTANTPOOL_H
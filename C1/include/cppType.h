@@ -2,18 +2,74 @@
 #define COMPILER_CPPTYPE_H
 
 #include <string>
-#include <regex>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <shared_mutex>
+#include <mutex>
 
 #include "token.h"
+#include "util.h"
+#include "error.h"
+#include "primitiveType.h"
+#include "llvmType.h"
+
+struct CppType;
+
+// Members and memory layout of a class under the active data model, computed once when its definition is complete
+struct ClassLayout {
+	struct Field {
+		std::string_view name;
+		CppType* type;
+		int index; // Position in the LLVM struct type
+		int offset; // Bytes from the start of the object
+	};
+
+	std::string name;
+	LlvmTypeIdentifiedStruct* llvmType;
+	std::vector<Field> fields;
+
+	// Declared with export in a module interface unit
+	bool exported = false;
+
+	// Set for instances of class templates, for mangling
+	std::string_view templateName;
+	std::vector<CppType*> templateArgs;
+
+	bool complete = false;
+	int size = 0; // Bytes, including tail padding
+	int align = 1;
+
+	const Field* findField(std::string_view fieldName) const {
+		for (auto& i : fields) {
+			if (i.name == fieldName) {
+				return &i;
+			}
+		}
+
+		return nullptr;
+	}
+};
 
+// A canonical type. Every distinct type exists once in the TypeContext and never changes, so types compare by pointer
 struct CppType {
 	// Applies to class, union, enum, typedef, and type alias
 	std::string _coreName; // Underlying type like int or a class
 
+	// Layout of the underlying builtin type, if it is one
+	const PrimitiveTypeInfo* _primitive = nullptr;
+
+	// Layout of the underlying class, if it is one
+	ClassLayout* _layout = nullptr;
+
 	// Derived information
 	int _width;
+	int _align; // Bytes
 	std::string _name;
-	std::string _llvmName;
+	LlvmType* _llvmType = nullptr;
 
 	bool _isSigned = false;
 	bool _isInteger = true;
@@ -27,110 +83,6 @@ struct CppType {
 
 	CppType() {}
 
-	CppType(std::string_view str_) {
-		_coreName = std::string(str_);
-
-		const std::regex nameRegex("[_a-zA-Z][_a-zA-Z0-9]*");
-		std::smatch nameMatch;
-
-		if (std::regex_search(_coreName, nameMatch, nameRegex)) {
-			// The first sub_match is the whole string; the next
-			// sub_match is the first parenthesized expression.
-			if (nameMatch.size() == 1)
-			{
-				_coreName = nameMatch[0].str();
-			}
-		}
-
-		_pointerLayers = (int)std::count(str_.begin(), str_.end(), '*');
-		_pointerLayerIsConst.resize(_pointerLayers, false);
-
-		make();
-	}
-
-	void make() {
-		makeName();
-		makeLlvmName();
-	}
-
-	void makeLlvmName() {
-		if (_coreName == "void") {
-			_llvmName = "void";
-			_width = 0;
-			_isInteger = false;
-
-			if (_pointerLayers) {
-				_llvmName = "i8";
-			}
-		}
-		else if (_coreName == "bool") {
-			_llvmName = buildStr("i", currentDataModel->charWidth);
-			_width = currentDataModel->charWidth;
-			_isInteger = true;
-		}
-		else if (_coreName == "char") {
-			_llvmName = buildStr("i", currentDataModel->charWidth);
-			_width = currentDataModel->charWidth;
-			_isInteger = true;
-		}
-		else if (_coreName == "int") {
-			_llvmName = buildStr("i", currentDataModel->intWidth);
-			_width = currentDataModel->intWidth;
-			_isInteger = true;
-		}
-		else if (_coreName == "long") {
-			_llvmName = buildStr("i", currentDataModel->longWidth);
-			_width = currentDataModel->longWidth;
-			_isInteger = true;
-		}
-		else if (_coreName == "long long") {
-			_llvmName = buildStr("i", currentDataModel->longLongWidth);
-			_width = currentDataModel->longLongWidth;
-			_isInteger = true;
-		}
-		else if (_coreName == "float") {
-			_llvmName = "f32";
-			_width = 32;
-			_isInteger = false;
-		}
-		else if (_coreName == "double") {
-			_llvmName = "f64";
-			_width = 64;
-			_isInteger = false;
-		}
-		else if (_coreName == "long double") {
-			_llvmName = buildStr("i", currentDataModel->longDoubleWidth);
-			_width = currentDataModel->longDoubleWidth;
-			_isInteger = false;
-		}
-		else if (_coreName == "_condition") {
-			_llvmName = "i1";
-			_width = 0;
-			_isInteger = true;
-		}
-		else if (_coreName == "nullptr_t") {
-			_llvmName = "i8*";
-			_width = currentDataModel->pointerWidth;
-			_isInteger = true;
-		}
-		else {
-			throw NULL;
-		}
-
-		if (_pointerLayers) {
-			_width = currentDataModel->pointerWidth;
-			_isInteger = false;
-		}
-
-		for (int i = 0; i < _pointerLayers; i++) {
-			_llvmName += "*";
-		}
-
-		if (_isReference) {
-			_llvmName += "*";
-		}
-	}
-
 	void makeName() {
 		_name = "";
 
@@ -156,7 +108,11 @@ struct CppType {
 	}
 
 	std::string_view getLlvmName() {
-		return _llvmName;
+		return _llvmType->name();
+	}
+
+	LlvmType* llvmType() {
+		return _llvmType;
 	}
 
 	std::string_view getName() {
@@ -167,6 +123,15 @@ struct CppType {
 		return _width;
 	}
 
+	int align() {
+		return _align;
+	}
+
+	// Bytes an object takes, the width rounded up to the alignment like LLVM's alloc size, so a long double takes 16
+	int size() {
+		return ((_width + 7) / 8 + _align - 1) / _align * _align;
+	}
+
 	bool isSigned() {
 		return _isSigned;
 	}
@@ -175,18 +140,418 @@ struct CppType {
 		return _isInteger;
 	}
 
+	// True for a class object itself, not a pointer or reference to one
+	bool isClass() {
+		return _layout && !_pointerLayers && !_isReference;
+	}
+
+	ClassLayout* layout() {
+		return _layout;
+	}
+
 	bool operator==(const CppType& rhs) const noexcept {
-		return this->_name == rhs._name;
+		return this == &rhs;
 	}
 	bool operator!=(const CppType& rhs) const noexcept {
 		return !(*this == rhs);
 	}
 };
 
-inline CppType* strToType(std::string_view str) {
-	auto type = new CppType(str);
+// Everything that makes two types different
+struct CppTypeKey {
+	std::string_view coreName;
+
+	bool isConst = false;
+	bool isVolatile = false;
+
+	int pointerLayers = 0;
+	uint64_t pointerLayerConstMask = 0; // Bit i is set if pointer layer i is const
+
+	bool isReference = false;
+
+	bool operator==(const CppTypeKey& rhs) const noexcept = default;
+
+	struct Hash {
+		std::size_t operator()(const CppTypeKey& key) const noexcept {
+			std::size_t hash = std::hash<std::string_view>{}(key.coreName);
+			hash ^= (std::size_t)key.pointerLayers * 0x9e3779b97f4a7c15ull;
+			hash ^= (std::size_t)key.pointerLayerConstMask << 8;
+			hash ^= (std::size_t)(key.isConst | (key.isVolatile << 1) | (key.isReference << 2)) << 4;
+			return hash;
+		}
+	};
+};
+
+// Owns every type and hands out one canonical CppType per distinct type
+class TypeContext {
+	struct StringHash {
+		using is_transparent = void;
+
+		std::size_t operator()(std::string_view str) const noexcept {
+			return std::hash<std::string_view>{}(str);
+		}
+	};
+
+	// Widths and names of the builtin types under the data model chosen for this compilation
+	const PrimitiveTable* primitives;
+
+	std::deque<CppType> types;
+	std::unordered_set<std::string, StringHash, std::equal_to<>> coreNames; // Storage for the core names keys refer to
+
+	std::unordered_map<CppTypeKey, CppType*, CppTypeKey::Hash> canonical;
+
+	// Every spelling seen so far, so that a spelling is only ever split up once
+	std::unordered_map<std::string, CppType*, StringHash, std::equal_to<>> spellings;
+
+	std::array<CppType*, (size_t)BuiltinType::COUNT> builtins = {};
+
+	// Every class declared so far, in declaration order
+	std::deque<ClassLayout> classes;
+	std::unordered_map<std::string, ClassLayout*, StringHash, std::equal_to<>> classNames;
+
+	CppType* _charPtrType;
+	CppType* _voidPtrType;
+
+	// Functions are emitted on several threads, which may still make new types such as pointers to existing ones
+	// Lookups share the lock and only making a type takes it exclusively
+	std::shared_mutex mutex;
+
+	TypeContext() : primitives(&primitiveTableFor(currentDataModel)) {
+		// Made up front so that looking one up never writes
+		for (int i = 0; i < (int)BuiltinType::COUNT; i++) {
+			CppTypeKey key;
+			key.coreName = BUILTIN_TYPE_STR[i];
+			builtins[i] = get(key);
+		}
+
+		_charPtrType = get("char*");
+		_voidPtrType = get("void*");
+	}
+
+	std::string_view internCoreName(std::string_view name) {
+		auto itr = coreNames.find(name);
+		if (itr == coreNames.end()) {
+			itr = coreNames.emplace(name).first;
+		}
+
+		return *itr;
+	}
+
+public:
+	// Splits a spelling like "const char * const" into the parts that identify it
+	// A template-id like Box<T*> stays whole as the core name
+	static CppTypeKey parseSpelling(std::string_view str) {
+		CppTypeKey key;
+
+		std::string_view core;
+		size_t i = 0;
+
+		while (i < str.size()) {
+			char c = str[i];
+
+			if (c == ' ' || c == '\t') {
+				i++;
+			}
+			else if (c == '*') {
+				key.pointerLayers++;
+				i++;
+			}
+			else if (c == '&') {
+				key.isReference = true;
+				i++;
+			}
+			else {
+				size_t begin = i;
+				int depth = 0;
+				while (i < str.size() && (depth > 0 || !isAnyOf(str[i], { ' ', '\t', '*', '&' }))) {
+					depth += str[i] == '<' ? 1 : str[i] == '>' ? -1 : 0;
+					i++;
+				}
+
+				auto word = str.substr(begin, i - begin);
+
+				if (word == "const" && key.pointerLayers) {
+					key.pointerLayerConstMask |= uint64_t(1) << (key.pointerLayers - 1);
+				}
+				else if (word == "const") {
+					key.isConst = true;
+				}
+				else if (word == "volatile") {
+					key.isVolatile = true;
+				}
+				else if (core.empty()) {
+					core = word;
+				}
+				else {
+					// Multi-word names like long long
+					core = std::string_view(core.data(), word.data() + word.size() - core.data());
+				}
+			}
+		}
+
+		key.coreName = core;
+		return key;
+	}
+
+private:
+
+	// The LLVM type a builtin type is represented by
+	static LlvmType* llvmTypeOf(const PrimitiveTypeInfo& info) {
+		switch (info.type) {
+		case BuiltinType::VOID: return llvmTypes().voidType();
+		case BuiltinType::FLOAT: return llvmTypes().floatType(LlvmTypeFloat::FLOAT);
+		case BuiltinType::DOUBLE: return llvmTypes().floatType(LlvmTypeFloat::DOUBLE);
+		case BuiltinType::LONG_DOUBLE: return llvmTypes().floatType(LlvmTypeFloat::X86_FP80);
+		case BuiltinType::NULLPTR_T: return llvmTypes().pointerTo(llvmTypes().intType(8));
+		default: return llvmTypes().intType(info.width);
+		}
+	}
+
+	// Fills in everything about a class type that follows from its layout
+	void deriveClass(CppType& type, ClassLayout* layout) {
+		// Pointers to a class can be made while its members are still being parsed, but objects can't
+		if (!layout->complete && !type._pointerLayers && !type._isReference) {
+			throw SourceError(DiagId::INCOMPLETE_TYPE, type._coreName);
+		}
 
-	return type;
+		type._layout = layout;
+		type._width = layout->size * 8;
+		type._align = layout->align;
+		type._isSigned = false;
+		type._isInteger = false;
+		type._llvmType = layout->llvmType;
+	}
+
+	// Fills in everything about a type that follows from its key
+	void derive(CppType& type) {
+		auto builtin = findBuiltinType(type._coreName);
+
+		if (builtin) {
+			const PrimitiveTypeInfo& info = (*primitives)[*builtin];
+
+			type._primitive = &info;
+			type._width = info.width;
+			type._align = info.align;
+			type._isSigned = info.isSigned;
+			type._isInteger = info.isInteger;
+			type._llvmType = llvmTypeOf(info);
+		}
+		else {
+			auto itr = classNames.find(type._coreName);
+			if (itr == classNames.end()) {
+				throw SourceError(DiagId::UNKNOWN_TYPE_NAME, type._coreName);
+			}
+
+			deriveClass(type, itr->second);
+		}
+
+		if (type._pointerLayers) {
+			if (builtin == BuiltinType::VOID) {
+				// void* is spelled i8*
+				type._llvmType = llvmTypes().intType(8);
+			}
+
+			type._width = primitives->pointerWidth;
+			type._align = primitives->pointerAlign;
+			type._isSigned = false;
+			type._isInteger = false;
+		}
+
+		for (int i = 0; i < type._pointerLayers; i++) {
+			type._llvmType = llvmTypes().pointerTo(type._llvmType);
+		}
+
+		if (type._isReference) {
+			type._llvmType = llvmTypes().pointerTo(type._llvmType);
+		}
+
+		type.makeName();
+	}
+
+	// Finds or makes the canonical type for a key, with the lock held exclusively
+	CppType* make(const CppTypeKey& key) {
+		auto itr = canonical.find(key);
+		if (itr != canonical.end()) {
+			return itr->second;
+		}
+
+		CppType made;
+		made._coreName = std::string(key.coreName);
+		made._isConst = key.isConst;
+		made._isVolatile = key.isVolatile;
+		made._pointerLayers = key.pointerLayers;
+		made._isReference = key.isReference;
+
+		for (int i = 0; i < key.pointerLayers; i++) {
+			made._pointerLayerIsConst.push_back(key.pointerLayerConstMask & (uint64_t(1) << i));
+		}
+
+		derive(made); // Throws for unknown core names before anything is recorded
+
+		CppType* type = &types.emplace_back(std::move(made));
+
+		CppTypeKey stored = key;
+		stored.coreName = internCoreName(key.coreName);
+		canonical.emplace(stored, type);
+
+		return type;
+	}
+
+public:
+	static TypeContext& global() {
+		static TypeContext context;
+		return context;
+	}
+
+	CppType* get(const CppTypeKey& key) {
+		{
+			std::shared_lock lock(mutex);
+
+			auto itr = canonical.find(key);
+			if (itr != canonical.end()) {
+				return itr->second;
+			}
+		}
+
+		std::unique_lock lock(mutex);
+		return make(key);
+	}
+
+	CppType* get(std::string_view spelling) {
+		{
+			std::shared_lock lock(mutex);
+
+			auto itr = spellings.find(spelling);
+			if (itr != spellings.end()) {
+				return itr->second;
+			}
+		}
+
+		std::unique_lock lock(mutex);
+
+		auto itr = spellings.find(spelling);
+		if (itr != spellings.end()) {
+			return itr->second;
+		}
+
+		CppType* type = make(parseSpelling(spelling));
+		spellings.emplace(std::string(spelling), type);
+		return type;
+	}
+
+	CppTypeKey keyOf(CppType* type) {
+		CppTypeKey key;
+		key.coreName = type->_coreName;
+		key.isConst = type->_isConst;
+		key.isVolatile = type->_isVolatile;
+		key.pointerLayers = type->_pointerLayers;
+		key.isReference = type->_isReference;
+
+		for (int i = 0; i < type->_pointerLayers; i++) {
+			if (type->_pointerLayerIsConst[i]) {
+				key.pointerLayerConstMask |= uint64_t(1) << i;
+			}
+		}
+
+		return key;
+	}
+
+	// Returns type with delta pointer layers added, or removed if negative
+	CppType* adjustPointerLayers(CppType* type, int delta) {
+		CppTypeKey key = keyOf(type);
+		key.pointerLayers += delta;
+		key.pointerLayerConstMask &= (uint64_t(1) << key.pointerLayers) - 1;
+		return get(key);
+	}
+
+	// Returns the type a pointer type points to
+	CppType* pointee(CppType* type) {
+		return adjustPointerLayers(type, -1);
+	}
+
+	// Returns the underlying type of a pointer with every pointer layer removed
+	CppType* stripPointers(CppType* type) {
+		return adjustPointerLayers(type, -type->_pointerLayers);
+	}
+
+	// Looks up a builtin type by index, without going through its spelling
+	CppType* builtin(BuiltinType type) {
+		return builtins[(int)type];
+	}
+
+	const PrimitiveTable& primitiveTable() {
+		return *primitives;
+	}
+
+	// Makes a class name usable as a type, so that members can point to the class before it is complete
+	// Classes are only declared while parsing, which is never concurrent with emission
+	ClassLayout* declareClass(std::string_view name) {
+		auto itr = classNames.find(name);
+		if (itr != classNames.end()) {
+			return itr->second;
+		}
+
+		ClassLayout* layout = &classes.emplace_back();
+		layout->name = name;
+		layout->llvmType = llvmTypes().identifiedStruct(layout->name);
+		classNames.emplace(layout->name, layout);
+		return layout;
+	}
+
+	// Places each member at the next offset that satisfies its alignment and returns the finished class type
+	CppType* completeClass(ClassLayout* layout, const std::vector<std::pair<std::string_view, CppType*>>& members) {
+		if (layout->complete) {
+			throw SourceError(DiagId::REDEFINITION, layout->name);
+		}
+
+		int offset = 0;
+		int align = 1;
+
+		for (auto& [name, type] : members) {
+			if (layout->findField(name)) {
+				throw SourceError(DiagId::DUPLICATE_MEMBER, name, layout->name);
+			}
+
+			offset = (offset + type->align() - 1) / type->align() * type->align();
+			layout->fields.push_back({ name, type, (int)layout->fields.size(), offset });
+
+			offset += type->size();
+			align = std::max(align, type->align());
+		}
+
+		std::vector<LlvmType*> memberTypes;
+		for (auto& field : layout->fields) {
+			memberTypes.push_back(field.type->llvmType());
+		}
+		llvmTypes().setBody(layout->llvmType, memberTypes);
+
+		layout->size = (offset + align - 1) / align * align;
+		layout->align = align;
+		layout->complete = true;
+
+		CppTypeKey key;
+		key.coreName = layout->name;
+		return get(key);
+	}
+
+	const std::deque<ClassLayout>& getClasses() {
+		return classes;
+	}
+
+	CppType* voidType() { return builtin(BuiltinType::VOID); }
+	CppType* boolType() { return builtin(BuiltinType::BOOL); }
+	CppType* intType() { return builtin(BuiltinType::INT); }
+	CppType* conditionType() { return builtin(BuiltinType::CONDITION); }
+	CppType* charPtrType() { return _charPtrType; }
+	CppType* voidPtrType() { return _voidPtrType; }
+};
+
+inline TypeContext& types() {
+	return TypeContext::global();
+}
+
+inline CppType* strToType(std::string_view str) {
+	return types().get(str);
 }
 
 #endif // ifndef COMPILER_CPPTYPE_H
\ No newline at end of file
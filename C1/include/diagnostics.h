@@ -0,0 +1,345 @@
+#ifndef COMPILER_DIAGNOSTICS_H
+#define COMPILER_DIAGNOSTICS_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <initializer_list>
+#include <iostream>
+#include <cstdint>
+#include <algorithm>
+#include <iterator>
+
+#include "source.h"
+
+enum class DiagId {
+	// Notes are only shown to explain a failed compile
+	UNDECLARED_NAME,
+
+	COMPILE_FAILED,
+	UNKNOWN_TOKEN,
+	EXPECTED_TOKEN,
+	MISSING_SEMICOLON,
+	INVALID_TYPE,
+	EMPTY_LOOKUP,
+	UNEXPECTED_CHARACTER,
+	END_OF_FILE_IN_BLOCK,
+	EXPECTED_OPERAND,
+	UNRESOLVED_NAME,
+	ASSERTION_FAILED,
+
+	NO_RESULT_TYPE,
+	NO_VALUE,
+	ASSIGN_TO_RVALUE,
+	ADDRESS_OF_RVALUE,
+
+	UNKNOWN_TYPE_NAME,
+	INCOMPLETE_TYPE,
+	REDEFINITION,
+	DUPLICATE_MEMBER,
+	NOT_A_CLASS,
+	NOT_A_CLASS_POINTER,
+	NO_SUCH_MEMBER,
+
+	TOO_MANY_TEMPLATE_ARGUMENTS,
+	CONFLICTING_DEDUCTION,
+	CANT_DEDUCE,
+	CLASS_TEMPLATE_CALLED,
+	INSTANTIATION_FAILED,
+	WRONG_TEMPLATE_ARGUMENT_COUNT,
+
+	NO_MATCHING_OVERLOAD,
+	AMBIGUOUS_CALL,
+
+	MODULE_NOT_FOUND,
+	INVALID_MODULE,
+	MODULE_DATA_MODEL_MISMATCH,
+	MODULE_WRITE_FAILED,
+
+	UNKNOWN_OPTION_VALUE,
+	OUTPUT_WRITE_FAILED,
+	BITCODE_UNSUPPORTED,
+	TOOL_START_FAILED,
+	TOOL_FAILED,
+	ASM_UNSUPPORTED,
+	JIT_UNSUPPORTED,
+	JIT_UNRESOLVED,
+	VM_UNSUPPORTED,
+	VM_TRAP,
+
+	NOT_CONSTANT,
+	CONSTANT_UNDEFINED,
+	CONSTANT_LIMIT,
+
+	COUNT
+};
+
+enum class Severity {
+	NOTE,
+	ERROR
+};
+
+struct DiagInfo {
+	DiagId id;
+	Severity severity;
+	std::string_view format; // {0}, {1}, ... are replaced by the arguments
+};
+
+constexpr DiagInfo DIAG_INFO[] = {
+	{ DiagId::UNDECLARED_NAME, Severity::NOTE, "no declaration of {0} is visible here" },
+
+	{ DiagId::COMPILE_FAILED, Severity::ERROR, "compile failed" },
+	{ DiagId::UNKNOWN_TOKEN, Severity::ERROR, "unknown token {0}" },
+	{ DiagId::EXPECTED_TOKEN, Severity::ERROR, "expected {0} but found {1}" },
+	{ DiagId::MISSING_SEMICOLON, Severity::ERROR, "missing semicolon" },
+	{ DiagId::INVALID_TYPE, Severity::ERROR, "invalid type {0}" },
+	{ DiagId::EMPTY_LOOKUP, Severity::ERROR, "looked up an empty name" },
+	{ DiagId::UNEXPECTED_CHARACTER, Severity::ERROR, "unexpected token beginning" },
+	{ DiagId::END_OF_FILE_IN_BLOCK, Severity::ERROR, "reached end of file inside a block" },
+	{ DiagId::EXPECTED_OPERAND, Severity::ERROR, "expected an operand for {0}" },
+	{ DiagId::UNRESOLVED_NAME, Severity::ERROR, "use of undeclared name {0}" },
+	{ DiagId::ASSERTION_FAILED, Severity::ERROR, "failed assertion in {0} on line {1}" },
+
+	{ DiagId::NO_RESULT_TYPE, Severity::ERROR, "tried to use expression that doesn't yield a type" },
+	{ DiagId::NO_VALUE, Severity::ERROR, "tried to use expression that doesn't yield a value as a value" },
+	{ DiagId::ASSIGN_TO_RVALUE, Severity::ERROR, "tried to assign to a non-lvalue" },
+	{ DiagId::ADDRESS_OF_RVALUE, Severity::ERROR, "tried to take the address of a non-lvalue" },
+
+	{ DiagId::UNKNOWN_TYPE_NAME, Severity::ERROR, "unknown type name {0}" },
+	{ DiagId::INCOMPLETE_TYPE, Severity::ERROR, "incomplete type {0} used by value" },
+	{ DiagId::REDEFINITION, Severity::ERROR, "redefinition of {0}" },
+	{ DiagId::DUPLICATE_MEMBER, Severity::ERROR, "duplicate member {0} in {1}" },
+	{ DiagId::NOT_A_CLASS, Severity::ERROR, "member access on {0}, which isn't a class" },
+	{ DiagId::NOT_A_CLASS_POINTER, Severity::ERROR, "member access through {0}, which isn't a class pointer" },
+	{ DiagId::NO_SUCH_MEMBER, Severity::ERROR, "{0} has no member named {1}" },
+
+	{ DiagId::TOO_MANY_TEMPLATE_ARGUMENTS, Severity::ERROR, "too many template arguments for {0}" },
+	{ DiagId::CONFLICTING_DEDUCTION, Severity::ERROR, "conflicting deductions for template parameter {0}" },
+	{ DiagId::CANT_DEDUCE, Severity::ERROR, "couldn't deduce every template argument of {0}" },
+	{ DiagId::CLASS_TEMPLATE_CALLED, Severity::ERROR, "class template {0} can't be used as a function" },
+	{ DiagId::INSTANTIATION_FAILED, Severity::ERROR, "failed to instantiate {0}<{1}>" },
+	{ DiagId::WRONG_TEMPLATE_ARGUMENT_COUNT, Severity::ERROR, "wrong number of template arguments for {0}" },
+
+	{ DiagId::NO_MATCHING_OVERLOAD, Severity::ERROR, "no overload of {0} takes these arguments" },
+	{ DiagId::AMBIGUOUS_CALL, Severity::ERROR, "call to {0} is ambiguous" },
+
+	{ DiagId::MODULE_NOT_FOUND, Severity::ERROR, "no interface found for module {0}" },
+	{ DiagId::INVALID_MODULE, Severity::ERROR, "{0} isn't a valid module interface" },
+	{ DiagId::MODULE_DATA_MODEL_MISMATCH, Severity::ERROR, "module interface {0} was built for a different data model" },
+	{ DiagId::MODULE_WRITE_FAILED, Severity::ERROR, "couldn't write module interface {0}" },
+
+	{ DiagId::UNKNOWN_OPTION_VALUE, Severity::ERROR, "unknown {0} {1}" },
+	{ DiagId::OUTPUT_WRITE_FAILED, Severity::ERROR, "couldn't write output file {0}" },
+	{ DiagId::BITCODE_UNSUPPORTED, Severity::ERROR, "can't write {0} as bitcode" },
+	{ DiagId::TOOL_START_FAILED, Severity::ERROR, "couldn't run {0}" },
+	{ DiagId::TOOL_FAILED, Severity::ERROR, "{0} failed with exit code {1}" },
+	{ DiagId::ASM_UNSUPPORTED, Severity::ERROR, "can't write {0} as x86-64 assembly" },
+	{ DiagId::JIT_UNSUPPORTED, Severity::ERROR, "can't run {0} in memory" },
+	{ DiagId::JIT_UNRESOLVED, Severity::ERROR, "couldn't find {0} to run the program" },
+	{ DiagId::VM_UNSUPPORTED, Severity::ERROR, "can't interpret {0}" },
+	{ DiagId::VM_TRAP, Severity::ERROR, "{0} while interpreting the program" },
+
+	{ DiagId::NOT_CONSTANT, Severity::ERROR, "{0} can't be evaluated at compile time" },
+	{ DiagId::CONSTANT_UNDEFINED, Severity::ERROR, "{0} in a constant expression" },
+	{ DiagId::CONSTANT_LIMIT, Severity::ERROR, "constant expression took more than {0} {1}" },
+};
+
+static_assert(std::size(DIAG_INFO) == (size_t)DiagId::COUNT);
+
+constexpr bool diagInfoInOrder() {
+	for (int i = 0; i < (int)DiagId::COUNT; i++) {
+		if ((int)DIAG_INFO[i].id != i) {
+			return false;
+		}
+	}
+	return true;
+}
+static_assert(diagInfoInOrder());
+
+// Substitutes the arguments into a diagnostic's message
+inline std::string formatDiagnostic(DiagId id, const std::string_view* args, size_t argCount) {
+	std::string_view format = DIAG_INFO[(int)id].format;
+	std::string out;
+
+	for (size_t i = 0; i < format.size(); i++) {
+		if (format[i] == '{' && i + 2 < format.size() && format[i + 2] == '}') {
+			size_t arg = format[i + 1] - '0';
+			if (arg < argCount) {
+				out += args[arg];
+			}
+			i += 2;
+		}
+		else {
+			out += format[i];
+		}
+	}
+
+	return out;
+}
+
+// Collects diagnostics as compact records and only turns them into text when they are reported
+// Records made during a speculative parse are rolled back with it, except that the ones from the
+// speculation that got furthest are kept aside to explain the compile if it fails as a whole
+class Diagnostics {
+public:
+	struct Diagnostic {
+		DiagId id;
+		uint32_t offset; // Bytes into the source, NO_OFFSET if it isn't known
+		uint32_t argBegin;
+		uint32_t argCount;
+	};
+
+	constexpr static uint32_t NO_OFFSET = UINT32_MAX;
+
+	struct Mark {
+		size_t records;
+		size_t args;
+		size_t ownedArgs;
+	};
+
+private:
+	std::string_view sourceName;
+	std::string_view source;
+
+	std::vector<Diagnostic> records;
+
+	// Arguments refer to the source or to names that live for the whole compile, except for the copies kept here
+	std::vector<std::string_view> args;
+	std::deque<std::string> ownedArgs;
+
+	std::vector<Diagnostic> furthestFailure;
+	std::vector<std::string_view> furthestArgs;
+	std::deque<std::string> furthestOwnedArgs;
+	uint32_t furthestOffset = 0;
+
+	uint32_t offsetOf(const char* where) const {
+		if (!where || where < source.data() || where > source.data() + source.size()) {
+			return NO_OFFSET;
+		}
+		return (uint32_t)(where - source.data());
+	}
+
+	void print(std::ostream& out, const Diagnostic& diag, const std::vector<std::string_view>& argStore) {
+		if (diag.offset != NO_OFFSET) {
+			SourcePos pos{ sourceName, source, source.data() + diag.offset, source.data() + diag.offset };
+			SourceOffset location = pos.resolve().begin;
+			out << sourceName << ':' << location.line << ':' << location.col << ": ";
+		}
+
+		out << (DIAG_INFO[(int)diag.id].severity == Severity::ERROR ? "error: " : "note: ")
+			<< formatDiagnostic(diag.id, argStore.data() + diag.argBegin, diag.argCount) << '\n';
+	}
+
+public:
+	static Diagnostics& global() {
+		static Diagnostics diagnostics;
+		return diagnostics;
+	}
+
+	void setSource(std::string_view name, std::string_view code) {
+		sourceName = name;
+		source = code;
+	}
+
+	void report(DiagId id, const char* where, std::initializer_list<std::string_view> diagArgs = {}) {
+		records.push_back({ id, offsetOf(where), (uint32_t)args.size(), (uint32_t)diagArgs.size() });
+		args.insert(args.end(), diagArgs.begin(), diagArgs.end());
+	}
+
+	// Records an argument that doesn't outlive the call, like one held by an exception
+	void report(DiagId id, const char* where, const std::string* diagArgs, size_t argCount) {
+		records.push_back({ id, offsetOf(where), (uint32_t)args.size(), (uint32_t)argCount });
+
+		for (size_t i = 0; i < argCount; i++) {
+			args.push_back(ownedArgs.emplace_back(diagArgs[i]));
+		}
+	}
+
+	// Whether a report of id at where is still standing, rather than rolled back
+	bool contains(DiagId id, const char* where) const {
+		uint32_t offset = offsetOf(where);
+		return std::any_of(records.begin(), records.end(), [&](const Diagnostic& i) { return i.id == id && i.offset == offset; });
+	}
+
+	Mark mark() const {
+		return { records.size(), args.size(), ownedArgs.size() };
+	}
+
+	// Forgets everything reported since the mark was taken
+	void rollback(Mark mark) {
+		if (records.size() == mark.records) {
+			return;
+		}
+
+		uint32_t reached = 0;
+		for (size_t i = mark.records; i < records.size(); i++) {
+			if (records[i].offset != NO_OFFSET) {
+				reached = std::max(reached, records[i].offset);
+			}
+		}
+
+		if (reached >= furthestOffset) {
+			furthestOffset = reached;
+			furthestFailure.assign(records.begin() + mark.records, records.end());
+			furthestArgs.assign(args.begin() + mark.args, args.end());
+
+			for (auto& i : furthestFailure) {
+				i.argBegin -= (uint32_t)mark.args;
+			}
+
+			// The copies made since the mark go with it, so the furthest failure keeps its own
+			furthestOwnedArgs.clear();
+			for (auto& arg : furthestArgs) {
+				bool owned = std::any_of(ownedArgs.begin() + mark.ownedArgs, ownedArgs.end(), [&](const std::string& i) {
+					return i.data() == arg.data();
+				});
+
+				if (owned) {
+					arg = furthestOwnedArgs.emplace_back(arg);
+				}
+			}
+		}
+
+		records.resize(mark.records);
+		args.resize(mark.args);
+		ownedArgs.resize(mark.ownedArgs);
+	}
+
+	bool hasErrors() const {
+		for (auto& i : records) {
+			if (DIAG_INFO[(int)i.id].severity == Severity::ERROR) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Writes out the errors that stuck, and when the compile failed, what went wrong in the furthest attempt to parse
+	void flush(std::ostream& out, bool failed) {
+		if (failed) {
+			for (auto& i : furthestFailure) {
+				print(out, i, furthestArgs);
+			}
+		}
+
+		for (auto& i : records) {
+			// An error reported again after its speculation was rolled back is already written out above
+			bool written = failed && std::any_of(furthestFailure.begin(), furthestFailure.end(), [&](const Diagnostic& j) {
+				return j.id == i.id && j.offset == i.offset;
+			});
+
+			if (DIAG_INFO[(int)i.id].severity == Severity::ERROR && !written) {
+				print(out, i, args);
+			}
+		}
+
+		out.flush();
+	}
+};
+
+inline Diagnostics& diagnostics() {
+	return Diagnostics::global();
+}
+
+#endif // ifndef COMPILER_DIAGNOSTICS_H
@@ -2,32 +2,72 @@
 #define COMPILER_ERROR_H
 
 #include <string>
-#include <stdexcept>
+#include <string_view>
+#include <array>
+#include <exception>
 
 #include "source.h"
+#include "diagnostics.h"
 
-class SourceError : public std::runtime_error
+// Carries a diagnostic id and its arguments, and only builds the message if something asks for it
+// Speculative parsing throws and discards these constantly, so constructing one must stay cheap
+class SourceError : public std::exception
 {
-    std::string message;
+    constexpr static size_t MAX_ARGS = 3;
+
+    DiagId id;
+    std::array<std::string, MAX_ARGS> args;
+    size_t argCount = 0;
+
+    const char* where = nullptr;
+
+    mutable std::string message;
 
 public:
-    const std::string& createMessage(std::string message_, SourcePos position_) {
-        message = message_;
-        message.append("  ");
-        message.append(std::string(position_));
-        return message;
+    template <typename... ArgsT>
+    SourceError(DiagId id_, const ArgsT&... args_) : id(id_), args{ std::string(std::string_view(args_))... }, argCount(sizeof...(ArgsT)) {
+        static_assert(sizeof...(ArgsT) <= MAX_ARGS);
     }
 
-    SourceError(std::string message_) :
-        runtime_error(message_) {}
+    SourceError(DiagId id_, SourcePos position_) : id(id_), where(position_.begin) {}
+
+    const char* what() const noexcept override {
+        if (message.empty()) {
+            std::array<std::string_view, MAX_ARGS> views;
+            for (size_t i = 0; i < argCount; i++) {
+                views[i] = args[i];
+            }
+            message = formatDiagnostic(id, views.data(), argCount);
+        }
 
-    SourceError(std::string message_, SourcePos position_) : 
-        //runtime_error(createMessage(message_, position_)) {}
-        runtime_error(message_) {}
+        return message.c_str();
+    }
+
+    // Places an error that was thrown without a position
+    SourceError& at(const char* where_) {
+        if (!where) {
+            where = where_;
+        }
+        return *this;
+    }
+
+    const char* position() const {
+        return where;
+    }
+
+    // Adds this error to the diagnostics, to be rolled back with the speculation it happened in
+    void report() const {
+        diagnostics().report(id, where, args.data(), argCount);
+    }
+
+    // Whether a report of this error is still standing
+    bool isReported() const {
+        return diagnostics().contains(id, where);
+    }
 };
 
 #define eassert_STR_HELPER(x) #x
 #define eassert_STR(x) eassert_STR_HELPER(x)
-#define eassert(cond) if (!(cond)) { throw SourceError("Failed assertion in " __FILE__ " on line " eassert_STR(__LINE__)); }
+#define eassert(cond) if (!(cond)) { throw SourceError(DiagId::ASSERTION_FAILED, __FILE__, eassert_STR(__LINE__)); }
 
-#endif // ifndef COMPILER_ERROR_H
\ No newline at end of file
+#endif // ifndef COMPILER_ERROR_H
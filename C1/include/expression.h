@@ -6,17 +6,24 @@
 #include <optional>
 
 #include "forward.h"
+#include "arena.h"
 #include "cppType.h"
 #include "token.h"
 #include "type.h"
 #include "util.h"
+#include "constantPool.h"
+#include "constEval.h"
 
 
 struct Conversion : public Expression {
 
 };
 
-struct EmptyExpression : public Expression {};
+struct EmptyExpression : public Expression {
+	int64_t evaluate(ConstEvaluator& eval) override {
+		return 0;
+	}
+};
 
 struct Return : public Expression {
 	Expression* ret = nullptr;
@@ -24,28 +31,25 @@ struct Return : public Expression {
 	void emitDependency(FuncEmitter& out) override {
 		if (ret) {
 			ret->emitDependency(out);
-		}
-
-		out.nextReg(); // Return consumes a register
-
-		if (ret) {
-			out.indent() << "ret " << ret->getResultType()->getLlvmName() << " " << ret->getOperand() << "\n";
+			out.ret({ ret->getResultType()->llvmType(), ret->getOperand() });
 		}
 		else {
-			out.indent() << "ret void\n";
+			out.ret();
 		}
 	}
+
+	int64_t evaluate(ConstEvaluator& eval) override {
+		eval.returnValue = ret ? eval.value(ret) : 0;
+		eval.returning = true;
+		return 0;
+	}
 };
 
 struct ArithmeticConversion : public Expression {
 	int inRegister = 0;
 	int outRegister = 0;
 
-	void emitDependency(FuncEmitter& out) override {
-		out.indent() << "%4 = fptosi float %3 to i32";
-	}
-
-	std::string getOperand() override { throw NULL; };
+	Operand getOperand() override { throw nullptr; };
 
 	//CppType* getResultType() override { return "i" + std::to_string(currentDataModel->intWidth); }
 };
@@ -59,24 +63,26 @@ struct Literal : public Expression {
 struct IntegerLiteral : public Expression {
 	int _val;
 
-	int _valReg;
+	Operand _valReg;
 
 	IntegerLiteral(int val) : _val(val) {
 
 	}
 
 	void emitDependency(FuncEmitter& out) override {
-		_valReg = out.nextReg();
-
-		out.indent() << "%" << _valReg << " = add nsw " << "i32" << " 0, " << _val << "\n";
+		_valReg = out.binary("add nsw", getResultType()->llvmType(), Operand::constant(0), Operand::constant(_val));
 	}
 
-	std::string getOperand() override {
-		return buildStr("%", _valReg);
+	Operand getOperand() override {
+		return _valReg;
 	}
 
 	CppType* getResultType() override {
-		return strToType("int");
+		return types().intType();
+	}
+
+	int64_t evaluate(ConstEvaluator& eval) override {
+		return _val;
 	}
 };
 
@@ -85,137 +91,71 @@ struct BoolLiteral : public Expression {
 
 	BoolLiteral(int val) : _val(val == 0) {}
 
-	std::string getOperand() override {
-		return _val ? "true" : "false";
+	Operand getOperand() override {
+		return Operand::boolean(_val);
 	}
 
 	CppType* getResultType() override {
-		return strToType("bool");
+		return types().boolType();
 	}
-};
-
-struct StringLiteral : public Expression {
-	std::string_view origStr;
-	std::string rawStr;
-	std::string llvmStr;
-
-	std::string name;
-
-	StringLiteral(std::string_view origStr_) : origStr(origStr_) {
-		// Ensures every string literal has a unique name
-		static int index = 0;
-
-		name = "@.str." + std::to_string(index);
-
-		rawStr = parseSourceStr(origStr);
-		llvmStr = makeLlvmStr(rawStr);
-	}
-
-	static std::string parseSourceStr(std::string_view str) {
-		constexpr std::pair<std::string_view, char> SIMPLE_ESCAPE_SEQUENCES[11] = {
-			{ "\\\'", 0x27 },
-			{ "\\\"", 0x22 },
-			{ "\\?", 0x3f },
-			{ "\\\\", 0x5c },
-			{ "\\a", 0x07 },
-			{ "\\b", 0x08 },
-			{ "\\f", 0x0c },
-			{ "\\n", 0x0a },
-			{ "\\r", 0x0d },
-			{ "\\t", 0x09 },
-			{ "\\v", 0x0b },
-		};
-
-		std::string out;
-
-		for (int i = 0; i < str.size(); i++) {
-			int c = str[i];
-
-			auto next = [&]() { return (i < str.size() - 1) ? (int)str[i] : EOF; };
-
-			auto simpleReplacement = std::find_if(std::begin(SIMPLE_ESCAPE_SEQUENCES), std::end(SIMPLE_ESCAPE_SEQUENCES),
-				[&](const std::pair<std::string_view, char> i) {
-					return i.first[1] == next();
-				});
-			if (c == '\\' && simpleReplacement != std::end(SIMPLE_ESCAPE_SEQUENCES)) {
-				out += simpleReplacement->second;
-
-				i++;
-			}
-			else {
-				out += c;
-			}
-		}
-
-		out += '\0';
-		return out;
-	}
-
-	static std::string makeLlvmStr(std::string_view str) {
-		std::string out;
-
-		for (int i = 0; i < str.size(); i++) {
-			int c = str[i];
-
-			out += "\\";
-
-			out += std::to_string(c);
-		}
 
-		out += '\0';
-		return out;
+	int64_t evaluate(ConstEvaluator& eval) override {
+		return _val;
 	}
+};
 
-	void emitFileScope(FuncEmitter& out) override {
-		static int index = 0;
+// Refers to a string constant in the module's ConstantPool
+struct StringLiteral : public Expression {
+	const ConstantPool::StringConstant* _str;
 
-		//todo: custom alignment for start and custom padding for end
-		out.indent() << "@.str." << index << " = private unnamed_addr constant [" << (llvmStr.size() + 1) << " x i8] c\"" <<
-			llvmStr << "\", align 1";
-	}
+	StringLiteral(const ConstantPool::StringConstant* str) : _str(str) {}
 
-	std::string getOperand() override {
-		return buildStr("i8* getelementptr inbounds ([", llvmStr.size(), " x i8], [", llvmStr.size(), " x i8]* ", name, " , i64 0, i64 0)");
+	Operand getOperand() override {
+		return Operand::string(_str->name, _str->bytes.size());
 	}
 
-	CppType* getResultType() override { return strToType("char*"); }
+	CppType* getResultType() override { return types().charPtrType(); }
 };
 
 struct FunctionCall : public Expression {
 	Function* _fn;
 
-	int _retReg = 0;
+	Operand _retReg;
 
 	std::vector<Expression*> arguments;
 
+	// Where the call is spelled, for a consteval call that can't be evaluated
+	const char* _where = nullptr;
+
 	FunctionCall(Function* fn) : _fn(fn) {}
 
 	void emitDependency(FuncEmitter& out) override;
 
-	std::string getOperand() override;
+	Operand getOperand() override;
 
 	CppType* getResultType() override;
+
+	int64_t evaluate(ConstEvaluator& eval) override;
 };
 
 struct StackAlloc : public Expression {
 	Expression* _size = nullptr;
-	int _reg = -1;
+	Operand _reg;
 
 	StackAlloc(Expression* size) : _size(size) {}
 
 	void emitDependency(FuncEmitter& out) override {
 		_size->emitDependency(out);
 
-		_reg = out.nextReg();
-		out.indent() << "%" << _reg << " = alloca i8, " << _size->getResultType()->getLlvmName() << " " << _size->getOperand() << '\n';
+		_reg = out.allocate(types().builtin(BuiltinType::CHAR)->llvmType(), { _size->getResultType()->llvmType(), _size->getOperand() });
 	}
 
-	std::string getOperand() override {
-		return buildStr("%", _reg);
+	Operand getOperand() override {
+		return _reg;
 	}
 
 	CppType* getResultType() override {
-		return strToType("void*");
+		return types().voidPtrType();
 	}
 };
 
@@ -226,13 +166,17 @@ struct FunctionArgumentInitializer : public Expression {
 
 	FunctionArgumentInitializer(FunctionArgument* arg) : _arg(arg) {}
 
-	std::string getOperand() override {
-		return buildStr("%", _arg->name, ".arg");
+	Operand getOperand() override {
+		return Operand::argument(_arg->name);
 	}
 
 	CppType* getResultType() override {
 		return _arg->type;
 	}
+
+	int64_t evaluate(ConstEvaluator& eval) override {
+		return eval.argument(_arg);
+	}
 };
 
 struct VariableDeclExp : public Expression {
@@ -242,28 +186,58 @@ struct VariableDeclExp : public Expression {
 	VariableDeclExp(VariableDeclaration* decl_) : decl(decl_) {}
 
 	void emitDependency(FuncEmitter& out) override {
-		decl->initializer->emitDependency(out);
+		LlvmType* type = decl->type->llvmType();
+		IrOperand addr = { types().adjustPointerLayers(decl->type, 1)->llvmType(), Operand::local(decl->irName()) };
+		auto align = decl->type->align();
 
 		// Allocate a slot for the variable and assign %varname to its address
-		out.indent() << "%" << decl->name << " = alloca " << decl->type->getLlvmName() << "\n";
+		out.allocate(type, addr.value, align);
+
+		// Class objects without an initializer are left uninitialized
+		if (!decl->initializer) {
+			return;
+		}
+
+		Operand value;
+		if (decl->_constantInit) {
+			try {
+				ConstEvaluator eval;
+				value = Operand::constant(ConstEvaluator::normalize(eval.value(decl->initializer), decl->type));
+			}
+			catch (SourceError& err) {
+				throw err.at(decl->name.data());
+			}
+		}
+		else {
+			decl->initializer->emitDependency(out);
+			value = decl->initializer->getOperand();
+		}
 
 		// Put the output from the initializer in it
-		out.indent() << "store " << decl->type->getLlvmName() << " " << decl->initializer->getOperand()
-			<< ", " << decl->type->getLlvmName() << "* %" << decl->name << ", align 4\n";
+		out.store({ type, value }, addr, align);
 
 		// Assign %varname.0 to its current value
-		out.indent() << decl->getValReg() << " = load " << decl->type->getLlvmName() << ", "
-			<< decl->type->getLlvmName() << "* %" << decl->name << ", align 4\n";
+		out.load(type, addr, align, decl->getValReg());
 	}
 
 	// Only usable in if statements
-	std::string getOperand() override {
+	Operand getOperand() override {
 		return decl->getValReg();
 	}
 
 	CppType* getResultType() override {
 		return decl->type;
 	}
+
+	int64_t evaluate(ConstEvaluator& eval) override {
+		if (!decl->initializer || decl->type->_pointerLayers || !decl->type->isInteger()) {
+			throw SourceError(DiagId::NOT_CONSTANT, decl->name);
+		}
+
+		int64_t val = ConstEvaluator::normalize(eval.value(decl->initializer), decl->type);
+		eval.declare(decl, val);
+		return val;
+	}
 };
 
 struct VariableRef : public Expression {
@@ -275,22 +249,37 @@ struct VariableRef : public Expression {
 		return decl->type;
 	}
 
+	IrOperand address() {
+		return { types().adjustPointerLayers(decl->type, 1)->llvmType(), Operand::local(decl->irName()) };
+	}
+
 	void emitDependency(FuncEmitter& out) override {
 		// Assign %varname.<num> to its current value
-		auto reg = decl->getNextValReg();
-
-		out.indent() << decl->getValReg() << " = load " << decl->type->getLlvmName() << ", "
-			<< decl->type->getLlvmName() << "* %" << decl->name << ", align 4\n";
+		out.load(decl->type->llvmType(), address(), decl->type->align(), decl->getNextValReg());
 	}
 
-	std::string getOperand() override {
+	Operand getOperand() override {
 		return decl->getValReg();
 	}
 
-	void assign(FuncEmitter& out, std::string newValue) {
+	void assign(FuncEmitter& out, const Operand& newValue) override {
 		// Put the output in it
-		out.indent() << "store " << decl->type->getLlvmName() << " " << newValue
-			<< ", " << decl->type->getLlvmName() << "* %" << decl->name << ", align 4\n";
+		out.store({ decl->type->llvmType(), newValue }, address(), decl->type->align());
+	}
+
+	// %varname always holds the variable's address
+	void emitAddress(FuncEmitter& out) override {}
+
+	Operand getAddress() override {
+		return Operand::local(decl->irName());
+	}
+
+	int64_t evaluate(ConstEvaluator& eval) override {
+		return eval.read(decl);
+	}
+
+	void evaluateAssign(ConstEvaluator& eval, int64_t newValue) override {
+		eval.write(decl, newValue);
 	}
 };
 
@@ -298,87 +287,99 @@ struct Cast : public Expression {
 	Expression* _in;
 	CppType* _outType;
 
-	std::string _outReg;
+	Operand _outReg;
 
 	Cast(Expression* in, CppType* outType) : _in(in), _outType(outType) {}
 
 	void emitDependency(FuncEmitter& out) override {
 		_in->emitDependency(out);
 
+		CppType* inType = _in->getResultType();
+		IrOperand in = { inType->llvmType(), _in->getOperand() };
 
-		if (_in->getResultType()->_pointerLayers && _outType->_pointerLayers) {
+		if (inType->_pointerLayers && _outType->_pointerLayers) {
 			// Pointer-to-pointer cast
-			_outReg = buildStr("%", out.nextReg());
-
-			out.indent() << _outReg << " = bitcast " << _in->getResultType()->getLlvmName() << " " <<
-				_in->getOperand() << " to " << _outType->getLlvmName() << '\n';
+			_outReg = out.cast("bitcast", in, _outType->llvmType());
 		}
-		else if (!_in->getResultType()->_pointerLayers && _outType->_pointerLayers) {
+		else if (!inType->_pointerLayers && _outType->_pointerLayers) {
 			// Number-to-pointer cast
-			_outReg = buildStr("%", out.nextReg());
-
-			out.indent() << _outReg << " = inttoptr " << _in->getResultType()->getLlvmName() << " " <<
-				_in->getOperand() << " to " << _outType->getLlvmName() << '\n';
+			_outReg = out.cast("inttoptr", in, _outType->llvmType());
 		}
-		else if (_in->getResultType()->width() < _outType->width() && _in->getResultType()->isInteger() && _outType->isInteger()) {
+		else if (inType->width() < _outType->width() && inType->isInteger() && _outType->isInteger()) {
 			// Widening
-			int valReg = out.nextReg();
-			_outReg = buildStr("%", valReg);
+			std::string_view opcode;
 
-			out.indent() << _outReg << " = ";
-
-			if (!_in->getResultType()->isSigned() && !_outType->isSigned()) {
+			if (!inType->isSigned() && !_outType->isSigned()) {
 				// Extend without sign
-				out << "zext ";
+				opcode = "zext";
 			}
-			else if (!_in->getResultType()->isSigned() && _outType->isSigned()) {
+			else if (!inType->isSigned() && _outType->isSigned()) {
 				// Extend and add sign
-				out << "zext ";
+				opcode = "zext";
 			}
-			else if (_in->getResultType()->isSigned() && _outType->isSigned()) {
+			else if (inType->isSigned() && _outType->isSigned()) {
 				// Extend and keep sign
-				out << "sext ";
+				opcode = "sext";
 			}
 			else {
-				throw NULL;
+				throw nullptr;
 			}
 
-			out.indent() << _in->getResultType()->getLlvmName() << " " << _in->getOperand()
-				<< " to " << _outType->getLlvmName() << "\n";
+			_outReg = out.cast(opcode, in, _outType->llvmType());
 		}
-		else if (_in->getResultType()->width() == _outType->width()) {
-			_outReg = _in->getOperand();
-			return;
+		else if (inType->width() == _outType->width()) {
+			_outReg = in.value;
 		}
 		else {
 			// Truncate
-			int valReg = out.nextReg();
-			_outReg = buildStr("%", valReg);
-
-			out.indent() << _outReg << " = trunc " << _in->getResultType()->getLlvmName() <<
-				" " << _in->getOperand() << " to " << _outType->getLlvmName() << '\n';
+			_outReg = out.cast("trunc", in, _outType->llvmType());
 		}
 	}
 
 
-	std::string getOperand() override {
+	Operand getOperand() override {
 		return _outReg;
 	}
 
 	CppType* getResultType() override {
 		return _outType;
 	}
+
+	int64_t evaluate(ConstEvaluator& eval) override {
+		CppType* inType = _in->getResultType();
+		int64_t in = eval.value(_in);
+
+		if (inType->_pointerLayers || _outType->_pointerLayers) {
+			throw SourceError(DiagId::NOT_CONSTANT, "a pointer");
+		}
+		if (!inType->isInteger() || !_outType->isInteger()) {
+			throw SourceError(DiagId::NOT_CONSTANT, "this conversion");
+		}
+
+		if (inType->width() < _outType->width() && inType->isInteger() && _outType->isInteger()) {
+			if (inType->isSigned() && !_outType->isSigned()) {
+				throw SourceError(DiagId::NOT_CONSTANT, "this conversion");
+			}
+
+			// zext, unless both are signed
+			if (!inType->isSigned() && inType->width() < 64) {
+				in &= (int64_t)((1ull << inType->width()) - 1);
+			}
+		}
+
+		return ConstEvaluator::normalize(in, _outType);
+	}
 };
 
 struct BinaryOperator : public Expression {
 	Expression* _lhs;
 	Expression* _rhs;
-	int _valReg;
-	std::string op;
+	Operand _valReg;
+	std::string_view op;
 
 	BinaryOperator(Expression* lhs, Expression* rhs) : _lhs(lhs) {
-		if (*lhs->getResultType() != *rhs->getResultType()) {
-			_rhs = new Cast(rhs, lhs->getResultType());
+		if (lhs->getResultType() != rhs->getResultType()) {
+			_rhs = makeNode<Cast>(rhs, lhs->getResultType());
 		}
 		else {
 			_rhs = rhs;
@@ -389,18 +390,22 @@ struct BinaryOperator : public Expression {
 		_lhs->emitDependency(out);
 		_rhs->emitDependency(out);
 
-		_valReg = out.nextReg();
-		out.indent() << "%" << _valReg << " = " << op << " " << _lhs->getResultType()->getLlvmName() << " "
-			<< _lhs->getOperand() << ", " << _rhs->getOperand() << "\n";
+		_valReg = out.binary(op, _lhs->getResultType()->llvmType(), _lhs->getOperand(), _rhs->getOperand());
 	}
 
-	std::string getOperand() override {
-		return buildStr("%", _valReg);
+	Operand getOperand() override {
+		return _valReg;
 	}
 
 	CppType* getResultType() override {
 		return _lhs->getResultType();
 	}
+
+	int64_t evaluate(ConstEvaluator& eval) override {
+		int64_t lhs = eval.value(_lhs);
+		int64_t rhs = eval.value(_rhs);
+		return ConstEvaluator::binary(op, _lhs->getResultType(), lhs, rhs);
+	}
 };
 
 struct Addition : public BinaryOperator {
@@ -413,26 +418,22 @@ struct PointerAddition : public Expression {
 	Expression* _lhs;
 	Expression* _rhs;
 	CppType* _outType;
-	int _valReg;
+	Operand _valReg;
 
 	PointerAddition(Expression* lhs, Expression* rhs) : _lhs(lhs), _rhs(rhs) {
-		_outType = new CppType(*lhs->getResultType());
-		_outType->_pointerLayers -= 1;
-		_outType->make();
+		_outType = types().pointee(lhs->getResultType());
 	}
 
 	void emitDependency(FuncEmitter& out) override {
 		_lhs->emitDependency(out);
 		_rhs->emitDependency(out);
 
-		_valReg = out.nextReg();
-		out.indent() << "%" << _valReg << " = getelementptr inbounds " << _outType->getLlvmName() << ", " <<
-			_lhs->getResultType()->getLlvmName() << " " << _lhs->getOperand() << ", " <<
-			_rhs->getResultType()->getLlvmName() << " " << _rhs->getOperand() << "\n";
+		_valReg = out.gep(_outType->llvmType(), { _lhs->getResultType()->llvmType(), _lhs->getOperand() },
+			{ { _rhs->getResultType()->llvmType(), _rhs->getOperand() } });
 	}
 
-	std::string getOperand() override {
-		return buildStr("%", _valReg);
+	Operand getOperand() override {
+		return _valReg;
 	}
 
 	CppType* getResultType() override {
@@ -499,8 +500,8 @@ struct Assignment : public Expression {
 	Expression* _rhs;
 
 	Assignment(Expression* lhs, Expression* rhs) : _lhs(lhs), _rhs(rhs) {
-		if (*lhs->getResultType() != *rhs->getResultType()) {
-			_rhs = new Cast(rhs, lhs->getResultType());
+		if (lhs->getResultType() != rhs->getResultType()) {
+			_rhs = makeNode<Cast>(rhs, lhs->getResultType());
 		}
 		else {
 			_rhs = rhs;
@@ -514,13 +515,20 @@ struct Assignment : public Expression {
 		_lhs->assign(out, _rhs->getOperand());
 	}
 
-	std::string getOperand() override {
+	Operand getOperand() override {
 		return _lhs->getOperand();
 	}
 
 	CppType* getResultType() override {
 		return _lhs->getResultType();
 	}
+
+	// Like getOperand, the value is the one the left side was read as before it was assigned
+	int64_t evaluate(ConstEvaluator& eval) override {
+		int64_t old = eval.value(_lhs);
+		_lhs->evaluateAssign(eval, eval.value(_rhs));
+		return old;
+	}
 };
 
 struct UnaryAdd : public Expression {
@@ -532,7 +540,7 @@ struct UnaryAdd : public Expression {
 		// Identity operation
 	}
 
-	std::string getOperand() override {
+	Operand getOperand() override {
 		return _operand->getOperand();
 	}
 
@@ -540,89 +548,180 @@ struct UnaryAdd : public Expression {
 		// should strip lvalue I think
 		return _operand->getResultType();
 	}
+
+	int64_t evaluate(ConstEvaluator& eval) override {
+		return eval.value(_operand);
+	}
 };
 
 struct UnarySub : public Expression {
 	Expression* _operand;
-	int _valReg;
+	Operand _valReg;
 
 	UnarySub(Expression* operand) : _operand(operand) {}
 
 	void emitDependency(FuncEmitter& out) override {
 		_operand->emitDependency(out);
 
-		_valReg = out.nextReg();
-		out.indent() << "%" << _valReg << " = sub nsw " << _operand->getResultType()->getLlvmName() << " 0, " << _operand->getOperand() << "\n";
+		_valReg = out.binary("sub nsw", _operand->getResultType()->llvmType(), Operand::constant(0), _operand->getOperand());
 	}
 
-	std::string getOperand() override {
-		return buildStr("%", _valReg);
+	Operand getOperand() override {
+		return _valReg;
 	}
 
 	CppType* getResultType() override {
 		return _operand->getResultType();
 	}
+
+	int64_t evaluate(ConstEvaluator& eval) override {
+		return ConstEvaluator::binary("sub nsw", _operand->getResultType(), 0, eval.value(_operand));
+	}
 };
 
 struct BitwiseNot : public Expression {
 	Expression* _operand;
-	int _valReg;
+	Operand _valReg;
 
 	BitwiseNot(Expression* operand) : _operand(operand) {}
 
 	void emitDependency(FuncEmitter& out) override {
 		_operand->emitDependency(out);
 
-		_valReg = out.nextReg();
-		out.indent() << "%" << _valReg << " = xor " << _operand->getResultType()->getLlvmName() << _operand->getOperand() << ", -1\n";
+		_valReg = out.binary("xor", _operand->getResultType()->llvmType(), _operand->getOperand(), Operand::constant(-1));
 	}
 
-	std::string getOperand() override {
-		return buildStr("%", _valReg);
+	Operand getOperand() override {
+		return _valReg;
 	}
 
 	CppType* getResultType() override {
 		return _operand->getResultType();
 	}
+
+	int64_t evaluate(ConstEvaluator& eval) override {
+		return ~eval.value(_operand);
+	}
 };
 
 struct Dereference : public Expression {
 	Expression* _addr;
 	CppType* _outType;
-	int _valReg = -1;
+	Operand _valReg;
 
 	Dereference(Expression* addr_) : _addr(addr_) {
-		_outType = new CppType(*addr_->getResultType());
-		_outType->_pointerLayers = 0;
-		_outType->make();
+		_outType = types().pointee(addr_->getResultType());
 	}
 
 	void emitDependency(FuncEmitter& out) override {
 		_addr->emitDependency(out);
 
-		_valReg = out.nextReg();
-
-		out.indent() << "%" << _valReg << " = load " << _outType->getLlvmName() << ", " << _addr->getResultType()->getLlvmName() << " " << _addr->getOperand() << '\n';
+		_valReg = out.load(_outType->llvmType(), { _addr->getResultType()->llvmType(), _addr->getOperand() }, _outType->align());
 	}
 
-	std::string getOperand() override {
-		return buildStr("%", _valReg);
+	Operand getOperand() override {
+		return _valReg;
 	}
 
 	CppType* getResultType() override {
 		return _outType;
 	}
 
-	void assign(FuncEmitter& out, std::string newValue) {
-		out.indent() << "store " << _outType->getLlvmName() << " " << newValue
-			<< ", " << _addr->getResultType()->getLlvmName() << " " << _addr->getOperand() << "\n";
+	void assign(FuncEmitter& out, const Operand& newValue) override {
+		out.store({ _outType->llvmType(), newValue }, { _addr->getResultType()->llvmType(), _addr->getOperand() }, _outType->align());
+	}
+
+	void emitAddress(FuncEmitter& out) override {
+		_addr->emitDependency(out);
+	}
+
+	Operand getAddress() override {
+		return _addr->getOperand();
+	}
+};
+
+struct AddressOf : public Expression {
+	Expression* _object;
+
+	AddressOf(Expression* object) : _object(object) {}
+
+	void emitDependency(FuncEmitter& out) override {
+		_object->emitAddress(out);
+	}
+
+	Operand getOperand() override {
+		return _object->getAddress();
+	}
+
+	CppType* getResultType() override {
+		return types().adjustPointerLayers(_object->getResultType(), 1);
+	}
+};
+
+// Reads or writes one member of a class object, reached either through the object itself or through a pointer to it
+struct MemberAccess : public Expression {
+	Expression* _object;
+	bool _throughPointer; // Spelled ->
+	const ClassLayout::Field* _field;
+	CppType* _classType;
+
+	Operand _addrReg;
+	Operand _valReg;
+
+	MemberAccess(Expression* object, bool throughPointer, const ClassLayout::Field* field) :
+		_object(object), _throughPointer(throughPointer), _field(field) {
+		_classType = throughPointer ? types().pointee(object->getResultType()) : object->getResultType();
+	}
+
+	void emitAddress(FuncEmitter& out) override {
+		Operand objectAddr;
+
+		if (_throughPointer) {
+			_object->emitDependency(out);
+			objectAddr = _object->getOperand();
+		}
+		else {
+			_object->emitAddress(out);
+			objectAddr = _object->getAddress();
+		}
+
+		LlvmType* index = llvmTypes().memberIndexType();
+
+		_addrReg = out.gep(_classType->llvmType(), { types().adjustPointerLayers(_classType, 1)->llvmType(), objectAddr },
+			{ { index, Operand::constant(0) }, { index, Operand::constant(_field->index) } });
+	}
+
+	Operand getAddress() override {
+		return _addrReg;
+	}
+
+	IrOperand fieldAddress() {
+		return { types().adjustPointerLayers(_field->type, 1)->llvmType(), _addrReg };
+	}
+
+	void emitDependency(FuncEmitter& out) override {
+		emitAddress(out);
+
+		_valReg = out.load(_field->type->llvmType(), fieldAddress(), _field->type->align());
+	}
+
+	Operand getOperand() override {
+		return _valReg;
+	}
+
+	CppType* getResultType() override {
+		return _field->type;
+	}
+
+	void assign(FuncEmitter& out, const Operand& newValue) override {
+		out.store({ _field->type->llvmType(), newValue }, fieldAddress(), _field->type->align());
 	}
 };
 
 struct LogicEqual : public Expression {
 	Expression* _lhs;
 	Expression* _rhs;
-	int _valReg = -1;
+	Operand _valReg;
 
 	LogicEqual(Expression* lhs, Expression* rhs) : _lhs(lhs), _rhs(rhs) {}
 
@@ -630,27 +729,28 @@ struct LogicEqual : public Expression {
 		_lhs->emitDependency(out);
 		_rhs->emitDependency(out);
 
-		int iValReg = out.nextReg();
-		_valReg = out.nextReg();
-		out.indent() << "%" << iValReg << " = icmp eq " << _lhs->getResultType()->getLlvmName() << " "
-			<< _lhs->getOperand() << ", " << _rhs->getOperand() << "\n";
-
-		out.indent() << "\t%" << _valReg << " = zext i1 %" << iValReg << " to i" << strToType("bool")->width() << '\n';
+		Operand iValReg = out.icmp("eq", _lhs->getResultType()->llvmType(), _lhs->getOperand(), _rhs->getOperand());
+		_valReg = out.cast("zext", { types().conditionType()->llvmType(), iValReg }, types().boolType()->llvmType());
 	}
 
-	std::string getOperand() override {
-		return buildStr("%", _valReg);
+	Operand getOperand() override {
+		return _valReg;
 	}
 
 	CppType* getResultType() override {
-		return strToType("bool");
+		return types().boolType();
+	}
+
+	int64_t evaluate(ConstEvaluator& eval) override {
+		int64_t lhs = eval.value(_lhs);
+		return lhs == eval.value(_rhs);
 	}
 };
 
 struct LogicNotEqual : public Expression {
 	Expression* _lhs;
 	Expression* _rhs;
-	int _valReg, _wideValReg;
+	Operand _valReg, _wideValReg;
 
 	LogicNotEqual(Expression* lhs, Expression* rhs) : _lhs(lhs), _rhs(rhs) {}
 
@@ -658,27 +758,28 @@ struct LogicNotEqual : public Expression {
 		_lhs->emitDependency(out);
 		_rhs->emitDependency(out);
 
-		_valReg = out.nextReg();
-		out.indent() << "%" << _valReg << " = icmp ne " << _lhs->getResultType()->getLlvmName() << " "
-			<< _lhs->getOperand() << ", " << _rhs->getOperand() << "\n";
-
-		_wideValReg = out.nextReg();
-		out.indent() << "\t%" << _valReg << " = zext i1 %" << _wideValReg << " to i" << strToType("bool")->width() << '\n';
+		_valReg = out.icmp("ne", _lhs->getResultType()->llvmType(), _lhs->getOperand(), _rhs->getOperand());
+		_wideValReg = out.cast("zext", { types().conditionType()->llvmType(), _valReg }, types().boolType()->llvmType());
 	}
 
-	std::string getOperand() override {
-		return buildStr("%", _wideValReg);
+	Operand getOperand() override {
+		return _wideValReg;
 	}
 
 	CppType* getResultType() override {
-		return strToType("bool");
+		return types().boolType();
+	}
+
+	int64_t evaluate(ConstEvaluator& eval) override {
+		int64_t lhs = eval.value(_lhs);
+		return lhs != eval.value(_rhs);
 	}
 };
 
 struct Compare : public Expression {
 	Expression* _lhs;
 	Expression* _rhs;
-	int _valReg, _wideValReg;
+	Operand _valReg, _wideValReg;
 	std::string_view _op;
 
 	Compare(Expression* lhs, Expression* rhs, std::string_view op) : _lhs(lhs), _rhs(rhs), _op(op) {}
@@ -687,53 +788,62 @@ struct Compare : public Expression {
 		_lhs->emitDependency(out);
 		_rhs->emitDependency(out);
 
-		_valReg = out.nextReg();
-		out.indent() << "%" << _valReg << " = icmp " << _op << " " << _lhs->getResultType()->getLlvmName() << " "
-			<< _lhs->getOperand() << ", " << _rhs->getOperand() << "\n";
-
-		_wideValReg = out.nextReg();
-		out.indent() << "\t%" << _wideValReg << " = zext i1 %" << _valReg << " to i" << strToType("bool")->width() << '\n';
+		_valReg = out.icmp(_op, _lhs->getResultType()->llvmType(), _lhs->getOperand(), _rhs->getOperand());
+		_wideValReg = out.cast("zext", { types().conditionType()->llvmType(), _valReg }, types().boolType()->llvmType());
 	}
 
-	std::string getOperand() override {
-		return buildStr("%", _wideValReg);
+	Operand getOperand() override {
+		return _wideValReg;
 	}
 
 	CppType* getResultType() override {
-		return strToType("bool");
+		return types().boolType();
+	}
+
+	int64_t evaluate(ConstEvaluator& eval) override {
+		if (_lhs->getResultType()->_pointerLayers) {
+			throw SourceError(DiagId::NOT_CONSTANT, "a pointer");
+		}
+
+		int64_t lhs = eval.value(_lhs);
+		return ConstEvaluator::compare(_op, lhs, eval.value(_rhs));
 	}
 };
 
 inline Expression* makeBinaryExp(std::string_view type, Expression* lhs, Expression* rhs) {
+	if (!lhs || !rhs) {
+		throw SourceError(DiagId::EXPECTED_OPERAND, type).at(type.data());
+	}
+
 	if (lhs->getResultType()->_pointerLayers || rhs->getResultType()->_pointerLayers) {
-		if (type == "+") { return new PointerAddition(lhs, rhs); }
+		if (type == "+") { return makeNode<PointerAddition>(lhs, rhs); }
 	}
 	else {
-		if (type == "+") { return new Addition(lhs, rhs); }
-		else if (type == "-") { return new Subtraction(lhs, rhs); }
-		else if (type == "*") { return new Multiplication(lhs, rhs); }
-		else if (type == "/") { return new Division(lhs, rhs); }
-		else if (type == "%") { return new Remainder(lhs, rhs); }
+		if (type == "+") { return makeNode<Addition>(lhs, rhs); }
+		else if (type == "-") { return makeNode<Subtraction>(lhs, rhs); }
+		else if (type == "*") { return makeNode<Multiplication>(lhs, rhs); }
+		else if (type == "/") { return makeNode<Division>(lhs, rhs); }
+		else if (type == "%") { return makeNode<Remainder>(lhs, rhs); }
 
-		else if (type == "<<") { return new BitShiftLeft(lhs, rhs); }
-		else if (type == ">>") { return new BitShiftRight(lhs, rhs); }
+		else if (type == "<<") { return makeNode<BitShiftLeft>(lhs, rhs); }
+		else if (type == ">>") { return makeNode<BitShiftRight>(lhs, rhs); }
 
-		else if (type == "==") { return new LogicEqual(lhs, rhs); }
-		else if (type == "!=") { return new LogicNotEqual(lhs, rhs); }
+		else if (type == "==") { return makeNode<LogicEqual>(lhs, rhs); }
+		else if (type == "!=") { return makeNode<LogicNotEqual>(lhs, rhs); }
 
-		else if (type == "&") { return new BitAnd(lhs, rhs); }
-		else if (type == "^") { return new BitXor(lhs, rhs); }
-		else if (type == "|") { return new BitOr(lhs, rhs); }
+		else if (type == "&") { return makeNode<BitAnd>(lhs, rhs); }
+		else if (type == "^") { return makeNode<BitXor>(lhs, rhs); }
+		else if (type == "|") { return makeNode<BitOr>(lhs, rhs); }
 	}
 
 	// Applies to both
-	if (type == "=") { return new Assignment(lhs, rhs); }
-	else if (type == "<") { return new Compare(lhs, rhs, "slt"); }
-	else if (type == "<=") { return new Compare(lhs, rhs, "sle"); }
-	else if (type == ">") { return new Compare(lhs, rhs, "sgt"); }
-	else if (type == ">=") { return new Compare(lhs, rhs, "sge"); }
+	if (type == "=") { return makeNode<Assignment>(lhs, rhs); }
+	else if (type == "<") { return makeNode<Compare>(lhs, rhs, "slt"); }
+	else if (type == "<=") { return makeNode<Compare>(lhs, rhs, "sle"); }
+	else if (type == ">") { return makeNode<Compare>(lhs, rhs, "sgt"); }
+	else if (type == ">=") { return makeNode<Compare>(lhs, rhs, "sge"); }
 	else {
-		throw NULL;
+		throw nullptr;
 	}
 
 	// SHORT CIRCUIT
@@ -14,9 +14,13 @@ struct ChildScope : public Expression {
 	void emitDependency(FuncEmitter& out) override {
 		for (auto& i : scope->getExpressions()) {
 			i->emitDependency(out);
-			out << "\n";
 		}
 	}
+
+	int64_t evaluate(ConstEvaluator& eval) override {
+		eval.run(scope->getExpressions());
+		return 0;
+	}
 };
 
 struct IfStatement : public Expression {
@@ -25,63 +29,65 @@ struct IfStatement : public Expression {
 	Scope trueBody;
 	Scope falseBody;
 
-	std::string branchPrefix;
-	std::string trueBranch;
-	std::string falseBranch;
-	std::string endOfIfBranch;
+	Operand trueBranch;
+	Operand falseBranch;
+	Operand endOfIfBranch;
 
 	bool hasTrueBranch = false;
 	bool hasFalseBranch = false;
 
 	IfStatement(Expression* condition_, Scope* parent_) :
 		trueBody("true", Scope::Type::FUNCTION, parent_), falseBody("false", Scope::Type::FUNCTION, parent_) {
-		condition = new Cast(condition_, strToType("_condition"));
+		condition = makeNode<Cast>(condition_, types().conditionType());
 	}
 
 	void emitDependency(FuncEmitter& out) override {
-		branchPrefix = out.nextBranchName();
+		int branch = out.nextBranch();
 
-		endOfIfBranch = branchPrefix + ".end";
-		trueBranch = branchPrefix + ".true";
-		falseBranch = branchPrefix + ".false";
+		endOfIfBranch = Operand::label(branch, "end");
+		trueBranch = Operand::label(branch, "true");
+		falseBranch = Operand::label(branch, "false");
 
 
 		// Evaluate condition
 		condition->emitDependency(out);
-		std::string conditionRegister = condition->getOperand();
 
-		out.indent() << "br i1 " << conditionRegister << ", label %" << (hasTrueBranch ? trueBranch : endOfIfBranch) 
-			<< ", label %" << (hasFalseBranch ? falseBranch : endOfIfBranch) << '\n';
+		out.condBr(condition->getOperand(), hasTrueBranch ? trueBranch : endOfIfBranch,
+			hasFalseBranch ? falseBranch : endOfIfBranch);
 
 		if (hasTrueBranch) {
-			// Branch label
-			out.indent() << trueBranch << ":\n";
-
-			auto indenter = out.addIndent();
+			out.label(trueBranch);
 
 			for (auto& i : trueBody.getExpressions()) {
 				i->emitDependency(out);
-				out << "\n";
 			}
 
-			out.indent() << "br label %" << endOfIfBranch << '\n';
+			out.br(endOfIfBranch);
 		}
 
 		if (hasFalseBranch) {
-			// Branch label
-			out.indent() << falseBranch << ":\n";
-
-			auto indenter = out.addIndent();
+			out.label(falseBranch);
 
 			for (auto& i : falseBody.getExpressions()) {
 				i->emitDependency(out);
-				out << "\n";
 			}
 
-			out.indent() << "br label %" << endOfIfBranch << '\n';
+			out.br(endOfIfBranch);
 		}
 
-		out.indent() << endOfIfBranch << ":\n";
+		out.label(endOfIfBranch);
+	}
+
+	int64_t evaluate(ConstEvaluator& eval) override {
+		if (eval.value(condition)) {
+			if (hasTrueBranch) {
+				eval.run(trueBody.getExpressions());
+			}
+		}
+		else if (hasFalseBranch) {
+			eval.run(falseBody.getExpressions());
+		}
+		return 0;
 	}
 };
 
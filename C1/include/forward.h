@@ -6,68 +6,198 @@
 #include <iostream>
 #include <vector>
 #include <memory>
+#include <cstdint>
 
-struct FuncEmitter {
-	struct Deindenter {
-		void operator()(FuncEmitter* out) {
-			out->removeIndent();
-		}
-	};
+#include "error.h"
+#include "outputBuffer.h"
+#include "ir.h"
+#include "x86.h"
 
+// Lowers a function into an IrFunction, which is printed into codeOut once it is complete
+// Each method adds one instruction to the block being built and returns the value it makes
+struct FuncEmitter {
 	int regCnt = 0;
-	int labelCnt = 1;
 	int branchNum = 0;
 
-	int indentLevel = 1;
+	// Run the IR passes before printing
+	bool optimize = false;
+
+	// What finish() leaves: IR or x86-64 assembly in codeOut, x86-64 instructions in machine to be encoded,
+	// or nothing besides function, for the interpreter
+	enum class Output {
+		IR,
+		X86_ASM,
+		X86,
+		NONE
+	};
+	Output output = Output::IR;
+
+	X86Function machine;
+
+	IrFunction function;
 
-	std::stringstream codeOut;
+	OutputBuffer codeOut;
 
-	std::unique_ptr<FuncEmitter, Deindenter> addIndent() {
-		indentLevel++;
-		return std::unique_ptr<FuncEmitter, Deindenter>(this, Deindenter());
+	int nextReg() {
+		return regCnt++;
+	}
+
+	// Number for the labels of the next branch
+	int nextBranch() {
+		return branchNum++;
 	}
-	void removeIndent() {
-		indentLevel = indentLevel > 0 ? indentLevel - 1 : 0;
+
+	// Starts the block an Operand::label branches to
+	void label(const Operand& op) {
+		function.blocks.push_back({ op, {} });
+	}
+
+	// Whether the block being built has ended, so that nothing added after it could run
+	bool terminated() {
+		return !function.blocks.empty() && function.blocks.back().terminated();
 	}
 
-	FuncEmitter& indent() {
-		for (int i = 0; i < indentLevel; i++) {
-			codeOut << '\t';
+	// Adds an instruction with no operands yet, in a new unnamed block if the last one has ended
+	IrInstruction& add(IrInstruction::Op op, std::string_view opcode, Operand result, LlvmType* type, int align = 0) {
+		if (function.blocks.empty() || function.blocks.back().terminated()) {
+			function.blocks.push_back({});
 		}
 
-		return *this;
+		return function.blocks.back().instructions.emplace_back(
+			IrInstruction{ op, opcode, result, type, align, (uint32_t)function.operands.size(), 0 });
 	}
 
-	template <typename T>
-	FuncEmitter& operator<<(T elm) {
-		codeOut << elm;
-		return *this;
+	// Gives the last instruction added another operand
+	void operand(const IrOperand& op) {
+		function.operands.push_back(op);
+		function.blocks.back().instructions.back().operandCount++;
 	}
 
-	int nextReg() {
-		return regCnt++;
+	Operand allocate(LlvmType* type, Operand result, int align) {
+		add(IrInstruction::Op::ALLOCA, {}, result, type, align);
+		return result;
+	}
+
+	// Allocates count objects of type
+	Operand allocate(LlvmType* type, const IrOperand& count) {
+		Operand result = Operand::reg(nextReg());
+		add(IrInstruction::Op::ALLOCA, {}, result, type);
+		operand(count);
+		return result;
+	}
+
+	Operand load(LlvmType* type, const IrOperand& addr, int align, Operand result) {
+		add(IrInstruction::Op::LOAD, {}, result, type, align);
+		operand(addr);
+		return result;
+	}
+
+	Operand load(LlvmType* type, const IrOperand& addr, int align) {
+		return load(type, addr, align, Operand::reg(nextReg()));
 	}
 
-	std::vector<std::string> outputNames;
+	void store(const IrOperand& val, const IrOperand& addr, int align) {
+		add(IrInstruction::Op::STORE, {}, {}, nullptr, align);
+		operand(val);
+		operand(addr);
+	}
 
-	void setNextOutputName(std::string name) {
-		outputNames.push_back(name);
+	Operand binary(std::string_view opcode, LlvmType* type, const Operand& lhs, const Operand& rhs) {
+		Operand result = Operand::reg(nextReg());
+		add(IrInstruction::Op::BINARY, opcode, result, type);
+		operand({ type, lhs });
+		operand({ type, rhs });
+		return result;
 	}
 
-	std::string getNextOutputName() {
-		std::string ret = outputNames.back();
-		outputNames.pop_back();
-		return ret;
+	Operand icmp(std::string_view predicate, LlvmType* type, const Operand& lhs, const Operand& rhs) {
+		Operand result = Operand::reg(nextReg());
+		add(IrInstruction::Op::ICMP, predicate, result, type);
+		operand({ type, lhs });
+		operand({ type, rhs });
+		return result;
 	}
 
-	std::string nextBranchName() {
-		return buildStr("b.", branchNum++);
+	Operand cast(std::string_view opcode, const IrOperand& val, LlvmType* to) {
+		Operand result = Operand::reg(nextReg());
+		add(IrInstruction::Op::CAST, opcode, result, to);
+		operand(val);
+		return result;
+	}
+
+	Operand gep(LlvmType* type, const IrOperand& base, std::initializer_list<IrOperand> indices) {
+		Operand result = Operand::reg(nextReg());
+		add(IrInstruction::Op::GEP, {}, result, type);
+		operand(base);
+		for (auto& i : indices) {
+			operand(i);
+		}
+		return result;
+	}
+
+	// Returns NONE for a function that returns void, whose call makes no value
+	Operand call(LlvmType* returns, std::string_view callee, const std::vector<IrOperand>& args) {
+		Operand result = returns->kind == LlvmType::Kind::VOID ? Operand() : Operand::reg(nextReg());
+		add(IrInstruction::Op::CALL, callee, result, returns);
+		for (auto& i : args) {
+			operand(i);
+		}
+		return result;
+	}
+
+	void br(const Operand& target) {
+		add(IrInstruction::Op::BR, {}, {}, nullptr);
+		operand({ nullptr, target });
+	}
+
+	void condBr(const Operand& condition, const Operand& ifTrue, const Operand& ifFalse) {
+		add(IrInstruction::Op::COND_BR, {}, {}, nullptr);
+		operand({ nullptr, condition });
+		operand({ nullptr, ifTrue });
+		operand({ nullptr, ifFalse });
+	}
+
+	void ret(const IrOperand& val) {
+		add(IrInstruction::Op::RET, {}, {}, nullptr);
+		operand(val);
+	}
+
+	void ret() {
+		add(IrInstruction::Op::RET, {}, {}, nullptr);
+	}
+
+	// Runs the passes over the finished function and writes it out
+	void finish() {
+		function.registerCount = regCnt;
+
+		if (optimize) {
+			removeDeadInstructions(function);
+		}
+
+		if (output == Output::NONE) {
+			return;
+		}
+
+		// Assemblers need nothing declared
+		if (output != Output::IR) {
+			if (function.defined) {
+				machine = X86Writer(function).write();
+
+				if (output == Output::X86_ASM) {
+					X86Printer(codeOut, machine).print();
+				}
+			}
+			return;
+		}
+
+		IrPrinter(codeOut, function).print();
 	}
 };
 
 struct Function;
 struct Expression;
 struct CppType;
+class ConstEvaluator;
 
 struct FunctionArgument {
 	std::string_view name;
@@ -83,6 +213,9 @@ struct FunctionPrototype {
 };
 
 struct Expression {
+	// Nodes are deleted through Expression* by the arena that owns them
+	virtual ~Expression() = default;
+
 	// Do any work required to get this expression ready, such as allocating static memory
 	virtual void emitFileScope(FuncEmitter& out) {}
 
@@ -90,21 +223,38 @@ struct Expression {
 	virtual void emitDependency(FuncEmitter& out) {}
 
 	virtual CppType* getResultType() {
-		std::cout << "Tried to use expression that doesn't yield a type!\n";
-		throw NULL;
+		throw SourceError(DiagId::NO_RESULT_TYPE);
 	}
 
-	// Get the register this expression's value is in
-	virtual std::string getOperand() {
-		std::cout << "Tried to use expression that doesn't yield a value as a value!\n";
-		throw NULL;
+	// Get the register or constant this expression's value is in
+	virtual Operand getOperand() {
+		throw SourceError(DiagId::NO_VALUE);
 	}
 
 	// Treating the expression as an lvalue, replace its current value
 	// getOperand must now refer to the updated value taken from newValue
-	virtual void assign(FuncEmitter& out, std::string newValue) {
-		std::cout << "Tried to assign to a non-lvalue!\n";
-		throw NULL;
+	virtual void assign(FuncEmitter& out, const Operand& newValue) {
+		throw SourceError(DiagId::ASSIGN_TO_RVALUE);
+	}
+
+	// Treating the expression as an lvalue, do the work needed to find its address without reading it
+	virtual void emitAddress(FuncEmitter& out) {
+		throw SourceError(DiagId::ADDRESS_OF_RVALUE);
+	}
+
+	// Get the register holding this lvalue's address, valid after emitAddress
+	virtual Operand getAddress() {
+		throw SourceError(DiagId::ADDRESS_OF_RVALUE);
+	}
+
+	// Work out the value at compile time, for a constexpr or consteval call, leaving the node as it was
+	virtual int64_t evaluate(ConstEvaluator& eval) {
+		throw SourceError(DiagId::NOT_CONSTANT, "this expression");
+	}
+
+	// Treating the expression as an lvalue, replace its value in the function being evaluated
+	virtual void evaluateAssign(ConstEvaluator& eval, int64_t newValue) {
+		throw SourceError(DiagId::NOT_CONSTANT, "this assignment");
 	}
 };
 
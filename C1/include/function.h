@@ -2,8 +2,14 @@
 #define COMPILER_FUNCTION_H
 
 #include "expression.h"
+#include "arena.h"
+#include "HashMap.h"
+#include "symbolTable.h"
+
+#include <unordered_map>
 
 struct Function;
+struct OverloadSet;
 
 class Scope {
 public:
@@ -13,7 +19,8 @@ public:
 		LOCAL,
 		CLASS,
 		STATEMENT,
-		FUNCTION
+		FUNCTION,
+		TEMPLATE // Binds template parameter names to the arguments of one instantiation
 	};
 
 private:
@@ -26,17 +33,42 @@ private:
 	std::vector<Function*> functions;
 	std::vector<CppType*> types;
 
-	std::vector<Declaration> names;
+	// Declarations by name. The first declaration of a name is the one found.
+	HashMap<Declaration> names;
+
+	// Functions declared here, one set per name
+	std::vector<std::unique_ptr<OverloadSet>> overloadSets;
 
 	std::vector<Expression*> expressions;
 
+	// Names visible in the enclosing function body, shared by all of its blocks
+	SymbolTable* symbols = nullptr;
+
 public:
 	Scope() = delete;
 	Scope(std::string_view name_, Type type_) : name(name_), type(type_) {}
-	Scope(std::string_view name_, Type type_, Scope* parent_) : name(name_), type(type_), parent(parent_) {}
+	Scope(std::string_view name_, Type type_, Scope* parent_) : name(name_), type(type_), parent(parent_) {
+		if (parent && parent->symbols && type == Type::FUNCTION) {
+			symbols = parent->symbols;
+		}
+	}
+
+	// Makes this scope the body of a function, whose blocks bind names in table
+	void attachSymbols(SymbolTable* table) {
+		symbols = table;
+		symbols->outer = parent;
+	}
+
+	// Opens a frame for the names declared in this scope, which are unbound again when the frame leaves scope
+	SymbolTable::Frame enter() {
+		return symbols ? symbols->push() : SymbolTable::Frame(nullptr);
+	}
 
 	inline void addFunction(Function* fn);
 
+	// Forgets everything declared in this scope, for when its nodes are about to be freed
+	inline void clear();
+
 	void addExpression(Expression* exp) {
 		expressions.push_back(exp);
 	}
@@ -47,11 +79,35 @@ public:
 
 	void addType(CppType* type) {
 		types.emplace_back(type);
-		names.push_back(Declaration{ type->getName(), type });
+		addDeclaration(Declaration{ type->getName(), type });
 	}
 
+	// Throws if a variable is declared twice in this scope, otherwise the first declaration of a name is the one found
 	void addDeclaration(Declaration decl) {
-		names.push_back(decl);
+		VariableDeclaration** var = std::get_if<VariableDeclaration*>(&decl.data);
+
+		if (!names.insert(decl.name, decl)) {
+			if (var) {
+				throw SourceError(DiagId::REDEFINITION, decl.name);
+			}
+			return;
+		}
+
+		if (symbols) {
+			if (var) {
+				(*var)->_irName = symbols->localName(decl.name);
+			}
+			symbols->bind(decl);
+		}
+	}
+
+	// Adds a function that must be emitted but is not found by name, like a template instantiation
+	void addInstantiation(Function* fn) {
+		functions.emplace_back(fn);
+	}
+
+	Type getType() {
+		return type;
 	}
 
 	bool isGlobal() {
@@ -66,6 +122,10 @@ public:
 		return type == Type::CLASS;
 	}
 
+	bool isTemplate() {
+		return type == Type::TEMPLATE;
+	}
+
 	std::vector<Function*>& getFunctions() {
 		return functions;
 	}
@@ -87,7 +147,7 @@ public:
 		Scope* itr = this;
 		while (itr->type != Type::GLOBAL) {
 			if (!itr->parent) {
-				throw NULL;
+				throw nullptr;
 			}
 
 			itr = itr->parent;
@@ -98,6 +158,7 @@ public:
 
 	// Searches for a declaration starting from this scope and progressing upwards 
 	inline Declaration* unqualifiedLookup(std::string_view name);
+	inline Declaration* unqualifiedLookup(std::string_view name, std::size_t hash);
 
 	inline Declaration* lookup(std::string_view name);
 };
@@ -106,122 +167,300 @@ struct Function {
 	FunctionPrototype decl;
 
 	bool defined = false;
+
+	// Bindings of the body's blocks while it is being parsed
+	SymbolTable symbols;
+
 	Scope body;
 
+	// Owns the nodes parsed into the body
+	NodeArena nodes;
+
 	bool _export = false;
 
-	Function(Scope* parent) : body("", Scope::Type::FUNCTION, parent) {}
-	Function(Scope* parent, FunctionPrototype decl_) : body(decl_.name, Scope::Type::FUNCTION, parent), decl(decl_) {}
+	// Keeps its plain name instead of being mangled, like main and the C library builtins
+	bool _externC = false;
+
+	// Declared with export in a module interface unit
+	bool _moduleExport = false;
+
+	// Calls with constant arguments are evaluated at compile time, and for consteval must be
+	bool _constexpr = false;
+	bool _consteval = false;
+
+	// Set for instances of function templates, for mangling
+	std::string_view templateName;
+	std::vector<CppType*> templateArgs;
+	Template* _template = nullptr;
 
-	std::string mangleName() {
-		auto name = (std::string)decl.name;
+	// Symbol name, computed on first use
+	std::string _mangledName;
 
-		Scope* scope = body.getParent();
-		while (!scope->isGlobal()) {
-			name = std::string(scope->getName()) + "::" + name;
+	// The definition that completes this declaration, once it has been parsed
+	Function* _definition = nullptr;
 
-			scope = scope->getParent();
+	Function(Scope* parent) : body("", Scope::Type::FUNCTION, parent) {
+		body.attachSymbols(&symbols);
+	}
+	Function(Scope* parent, FunctionPrototype decl_) : decl(decl_), body(decl_.name, Scope::Type::FUNCTION, parent) {
+		body.attachSymbols(&symbols);
+	}
+
+	inline const std::string& mangleName();
+
+	// Fills in the name, return type and arguments, which are named in a definition and left unnamed in a declaration
+	void lowerPrototype(FuncEmitter& out, bool definition) {
+		IrFunction& ir = out.function;
+		ir.name = mangleName();
+		ir.returns = (decl.returnType ? decl.returnType : types().voidType())->llvmType();
+		ir.defined = definition;
+
+		for (auto& i : decl.arguments) {
+			ir.arguments.push_back({ i->type->llvmType(), definition ? Operand::argument(i->name) : Operand::reg(out.nextReg()) });
 		}
+	}
 
-		return name;
+	// Declares the function even if it is defined, for a module that calls it from another
+	void emitDeclaration(FuncEmitter& out) {
+		lowerPrototype(out, false);
+		out.finish();
 	}
 
 	void emitFileScope(FuncEmitter& out) {
 		if (mangleName() == "print") { return; }
 
-		if (defined) {
-			out << "define dso_local " << decl.returnType->getLlvmName() << " @" << mangleName() << " (";
+		// Every call was evaluated, so there is nothing to call
+		if (_consteval) { return; }
 
-			for (int i = 0; i < decl.arguments.size(); i++) {
-				FunctionArgument& arg = *(decl.arguments[i]);
+		// LLVM doesn't allow declaring a function that is also defined
+		if (!defined && _definition) { return; }
 
-				out << arg.type->getLlvmName() << " %" << arg.name << ".arg";
-				if (i != decl.arguments.size() - 1) {
-					out << ", ";
-				}
-			}
+		lowerPrototype(out, defined);
+
+		if (defined) {
+			IrFunction& ir = out.function;
 
-			out << ") #0 ";
-			
 			if (_export) {
 				if (targetPlatform == Platform::WINDOWS) {
-					out << "dllexport ";
+					ir.visibility = "dllexport ";
 				}
 				else if (targetPlatform == Platform::LINUX) {
-					out << "default ";
+					ir.visibility = "default ";
 				}
 			}
 
-			// Completing the function prototype fills %0 with a label indicating the start of the function
-			out.regCnt++;
-			
-			//"() #4 {\n";
-
-			out << "{\n";
-
 			for (auto& i : body.getExpressions()) {
 				i->emitDependency(out);
-				out << "\n";
 			}
 
-			if (decl.returnType->getName() == "void" && typeid(body.getExpressions().back()) != typeid(Return)) {
-				// No return is required at the end if the return type is void
-				Return ret;
-				ret.emitDependency(out);
-			}
-			else if (decl.name == "main" && typeid(body.getExpressions().back()) != typeid(Return)) {
-				// The end of main implicitly returns 0
-				Return ret;
-				ret.ret = new IntegerLiteral(0);
-				ret.emitDependency(out);
+			if (!out.terminated()) {
+				if (decl.returnType == types().voidType()) {
+					// No return is required at the end if the return type is void
+					out.ret();
+				}
+				else if (decl.name == "main") {
+					// The end of main implicitly returns 0
+					IntegerLiteral zero(0);
+					Return ret;
+					ret.ret = &zero;
+					ret.emitDependency(out);
+				}
 			}
+		}
+
+		out.finish();
+	}
+
+	std::string_view getName() {
+		return decl.name;
+	}
+
+	// The body of a constexpr function is kept after it has been emitted, for the calls that are evaluated
+	bool keepsBody() {
+		return _constexpr || _consteval;
+	}
+
+	// Frees the body once it has been emitted, leaving only the prototype for callers
+	void releaseBody() {
+		body.clear();
+		nodes.release();
+	}
+};
+
 
-			out << "}\n";
+// Every function declared with one name in one scope
+// Exact matches are found by their parameter types, everything else among the candidates with the same arity
+struct OverloadSet {
+	using Signature = std::vector<CppType*>;
+
+	struct SignatureHash {
+		std::size_t operator()(const Signature& signature) const noexcept {
+			std::size_t hash = signature.size();
+			for (auto& i : signature) {
+				hash = hash * 31 + std::hash<CppType*>{}(i);
+			}
+			return hash;
 		}
-		else {
-			out << "declare dso_local " << (decl.returnType ? decl.returnType->getLlvmName() : "void") << " @" << mangleName() << " (";
+	};
 
-			for (int i = 0; i < decl.arguments.size(); i++) {
-				FunctionArgument& arg = *(decl.arguments[i]);
+	std::string_view name;
 
-				out << arg.type->getLlvmName() << " %" << out.nextReg();
-				if (i != decl.arguments.size() - 1) {
-					out << ", ";
-				}
+	std::vector<std::vector<Function*>> byArity;
+	std::unordered_map<Signature, Function*, SignatureHash> bySignature;
+
+	OverloadSet(std::string_view name_) : name(name_) {}
+
+	static Signature signatureOf(Function* fn) {
+		Signature signature;
+		for (auto& i : fn->decl.arguments) {
+			signature.push_back(i->type);
+		}
+		return signature;
+	}
+
+	void add(Function* fn) {
+		Signature signature = signatureOf(fn);
+		Function*& existing = bySignature[signature];
+
+		if (existing) {
+			// A definition takes the place of an earlier declaration
+			if (fn->defined && !existing->defined) {
+				auto& candidates = byArity[signature.size()];
+				*std::find(candidates.begin(), candidates.end(), existing) = fn;
+				existing->_definition = fn;
+				existing = fn;
 			}
+			return;
+		}
+
+		existing = fn;
 
-			out << ") #0\n";
+		if (byArity.size() <= signature.size()) {
+			byArity.resize(signature.size() + 1);
 		}
+		byArity[signature.size()].push_back(fn);
 	}
 
-	std::string_view getName() {
-		return decl.name;
+	// Whether a call's argument can be converted to a parameter's type
+	static bool convertible(CppType* from, CppType* to) {
+		if (from == to) {
+			return true;
+		}
+		if (from->isClass() || to->isClass()) {
+			return false;
+		}
+		if (from->_pointerLayers || to->_pointerLayers) {
+			// Any pointer converts to void*, and casts between pointers are allowed for now
+			return from->_pointerLayers && to->_pointerLayers;
+		}
+		return from->isInteger() && to->isInteger();
 	}
-};
 
+	Function* resolve(const Signature& argTypes) {
+		size_t arity = argTypes.size();
+
+		if (arity >= byArity.size() || byArity[arity].empty()) {
+			throw SourceError(DiagId::NO_MATCHING_OVERLOAD, name);
+		}
+
+		auto exact = bySignature.find(argTypes);
+		if (exact != bySignature.end()) {
+			return exact->second;
+		}
+
+		auto& candidates = byArity[arity];
+
+		// Even a lone candidate has to take the arguments, so f(&p) can't pass a pointer as an int
+		// Prefer the viable candidate with the most arguments that don't need converting
+		Function* best = nullptr;
+		int bestExact = -1;
+		bool ambiguous = false;
+
+		for (auto& fn : candidates) {
+			int exactCount = 0;
+			bool viable = true;
+
+			for (size_t i = 0; i < arity && viable; i++) {
+				CppType* param = fn->decl.arguments[i]->type;
+				exactCount += (argTypes[i] == param);
+				viable = convertible(argTypes[i], param);
+			}
+
+			if (!viable) {
+				continue;
+			}
+
+			if (exactCount > bestExact) {
+				best = fn;
+				bestExact = exactCount;
+				ambiguous = false;
+			}
+			else if (exactCount == bestExact) {
+				ambiguous = true;
+			}
+		}
+
+		if (!best) {
+			throw SourceError(DiagId::NO_MATCHING_OVERLOAD, name);
+		}
+		if (ambiguous) {
+			throw SourceError(DiagId::AMBIGUOUS_CALL, name);
+		}
+
+		return best;
+	}
+};
 
 void Scope::addFunction(Function* fn) {
 	functions.emplace_back(fn);
 
-	Declaration decl;
-	decl.name = fn->decl.name;
-	decl.data = fn;
-	names.push_back(decl);
+	Declaration* existing = names.get(fn->decl.name);
+	OverloadSet** set = existing ? std::get_if<OverloadSet*>(&existing->data) : nullptr;
+
+	if (set) {
+		(*set)->add(fn);
+	}
+	else {
+		OverloadSet* made = overloadSets.emplace_back(std::make_unique<OverloadSet>(fn->decl.name)).get();
+		made->add(fn);
+		addDeclaration(Declaration{ fn->decl.name, made });
+	}
+}
+
+void Scope::clear() {
+	children.clear();
+	types.clear();
+	names.clear();
+	overloadSets.clear();
+	expressions.clear();
 }
 
 // Searches for a declaration starting from this scope and progressing upwards 
 Declaration* Scope::unqualifiedLookup(std::string_view name) {
-	for (auto& i : names) {
-		if (i.name == name) {
-			return &i;
+	return unqualifiedLookup(name, HashMap<Declaration>::hashOf(name));
+}
+
+// The name is hashed once for the whole walk up the scope chain
+Declaration* Scope::unqualifiedLookup(std::string_view name, std::size_t hash) {
+	// Inside a function body, the symbol table already holds the innermost binding from every enclosing block
+	if (symbols) {
+		if (Declaration* decl = symbols->find(name, hash)) {
+			return decl;
 		}
+
+		return symbols->outer->unqualifiedLookup(name, hash);
+	}
+
+	if (Declaration* decl = names.get(name, hash)) {
+		return decl;
 	}
 
 	if (parent) {
-		return parent->unqualifiedLookup(name);
+		return parent->unqualifiedLookup(name, hash);
 	}
 	else {
-		std::cout << "Failed to lookup name " << name << '\n';
+		// Speculative parsing misses all the time, so this is only a note that is rolled back with the speculation
+		diagnostics().report(DiagId::UNDECLARED_NAME, name.data(), { name });
 	}
 
 	return nullptr;
@@ -229,8 +468,8 @@ Declaration* Scope::unqualifiedLookup(std::string_view name) {
 
 Declaration* Scope::lookup(std::string_view name) {
 	if (name == "") {
-		std::cout << "Looking up empty string!\n";
-		throw NULL;
+		diagnostics().report(DiagId::EMPTY_LOOKUP, name.data());
+		throw nullptr;
 	}
 
 	if (name.substr(0, 2) == "::") {
@@ -240,4 +479,14 @@ Declaration* Scope::lookup(std::string_view name) {
 	return unqualifiedLookup(name);
 }
 
-#endif // ifndef COMPILER_FUNCTION_H
\ No newline at end of file
+#include "mangle.h"
+
+const std::string& Function::mangleName() {
+	if (_mangledName.empty()) {
+		_mangledName = (_externC || decl.name == "main") ? std::string(decl.name) : Mangler::function(this);
+	}
+
+	return _mangledName;
+}
+
+#endif // ifndef COMPILER_FUNCTION_H
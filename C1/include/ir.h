@@ -0,0 +1,507 @@
+#ifndef COMPILER_IR_H
+#define COMPILER_IR_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+
+#include "outputBuffer.h"
+#include "llvmType.h"
+
+// A value as an instruction refers to it, which is only turned into text as the instruction is written
+// Nothing is allocated to make or copy one
+struct Operand {
+	enum class Kind : uint8_t {
+		NONE,
+		REGISTER, // %N, renumbered in order when the function is printed
+		LOCAL, // %name, the address of a variable, or %name.N, its value after its Nth load
+		ARGUMENT, // %name.arg
+		CONSTANT,
+		BOOL,
+		STRING, // Pointer to the first character of the string constant @name, of value bytes
+		LABEL // %b.N.name
+	};
+
+	Kind kind = Kind::NONE;
+	int64_t value = -1;
+	std::string_view name;
+
+	static Operand reg(int num) {
+		return { Kind::REGISTER, num, {} };
+	}
+
+	static Operand local(std::string_view name, int load = -1) {
+		return { Kind::LOCAL, load, name };
+	}
+
+	static Operand argument(std::string_view name) {
+		return { Kind::ARGUMENT, -1, name };
+	}
+
+	static Operand constant(int64_t val) {
+		return { Kind::CONSTANT, val, {} };
+	}
+
+	static Operand boolean(bool val) {
+		return { Kind::BOOL, val, {} };
+	}
+
+	static Operand string(std::string_view global, size_t size) {
+		return { Kind::STRING, (int64_t)size, global };
+	}
+
+	static Operand label(int branch, std::string_view name) {
+		return { Kind::LABEL, branch, name };
+	}
+
+	bool operator==(const Operand&) const = default;
+
+	// Labels are written without their % where they are defined
+	void writeTo(OutputBuffer& out, bool sigil = true) const {
+		switch (kind) {
+		case Kind::NONE:
+			break;
+		case Kind::REGISTER:
+			out << '%' << value;
+			break;
+		case Kind::LOCAL:
+			out << '%' << name;
+			if (value >= 0) {
+				out << '.' << value;
+			}
+			break;
+		case Kind::ARGUMENT:
+			out << '%' << name << ".arg";
+			break;
+		case Kind::CONSTANT:
+			out << value;
+			break;
+		case Kind::BOOL:
+			out << (value ? "true" : "false");
+			break;
+		case Kind::STRING:
+			out << "getelementptr inbounds ([" << value << " x i8], [" << value << " x i8]* " << name << " , i64 0, i64 0)";
+			break;
+		case Kind::LABEL:
+			if (sigil) {
+				out << '%';
+			}
+			out << "b." << value << '.' << name;
+			break;
+		}
+	}
+};
+
+struct OperandHash {
+	std::size_t operator()(const Operand& op) const noexcept {
+		return std::hash<std::string_view>{}(op.name) ^ (std::hash<int64_t>{}(op.value) * 31 + (std::size_t)op.kind);
+	}
+};
+
+// A value an instruction reads, with the type it is read as
+struct IrOperand {
+	LlvmType* type;
+	Operand value;
+};
+
+struct IrInstruction {
+	enum class Op : uint8_t {
+		ALLOCA, // result = alloca type [, operand 0 elements], align
+		LOAD, // result = load type, operand 0 address, align
+		STORE, // store operand 0 value, operand 1 address, align
+		BINARY, // result = opcode type operand 0, operand 1
+		ICMP, // result = icmp opcode type operand 0, operand 1
+		CAST, // result = opcode operand 0 to type
+		GEP, // result = getelementptr inbounds type, operand 0 base, indices...
+		CALL, // [result =] call type @opcode(arguments...)
+		BR, // br label operand 0
+		COND_BR, // br i1 operand 0, label operand 1, label operand 2
+		RET // ret void or ret operand 0
+	};
+
+	Op op;
+	std::string_view opcode; // The operation, cast, comparison or callee, depending on op
+	Operand result; // NONE if the instruction doesn't make a value
+	LlvmType* type = nullptr;
+	int align = 0; // 0 to leave it out
+
+	// Operands are kept together in the function, from firstOperand on
+	uint32_t firstOperand = 0;
+	uint32_t operandCount = 0;
+
+	bool isTerminator() const {
+		return op == Op::BR || op == Op::COND_BR || op == Op::RET;
+	}
+
+	// Whether the instruction does anything besides make its result
+	bool hasSideEffects() const {
+		return op == Op::STORE || op == Op::CALL || isTerminator();
+	}
+};
+
+struct IrBlock {
+	Operand label; // NONE for a block numbered like a register, which starts the function or follows a terminator
+
+	std::vector<IrInstruction> instructions;
+
+	bool terminated() const {
+		return !instructions.empty() && instructions.back().isTerminator();
+	}
+};
+
+// Where an instruction is in its function
+struct IrRef {
+	uint32_t block;
+	uint32_t instruction;
+};
+
+// A function as a list of basic blocks, which passes can rewrite before it is printed
+struct IrFunction {
+	std::string_view name;
+	LlvmType* returns = nullptr;
+
+	// Named Operand::argument in definitions, numbered registers in declarations
+	std::vector<IrOperand> arguments;
+
+	bool defined = false;
+	std::string_view visibility; // Written between the attributes and the body, like "dllexport "
+
+	std::vector<IrBlock> blocks;
+	std::vector<IrOperand> operands;
+
+	// The register after the last one the function uses
+	int registerCount = 0;
+
+	IrOperand* operandsOf(IrInstruction& inst) {
+		return operands.data() + inst.firstOperand;
+	}
+
+	const IrOperand* operandsOf(const IrInstruction& inst) const {
+		return operands.data() + inst.firstOperand;
+	}
+
+	IrInstruction& at(IrRef ref) {
+		return blocks[ref.block].instructions[ref.instruction];
+	}
+
+	// Every function called, each once, in the order of their first call
+	std::vector<std::string_view> callees() const {
+		std::vector<std::string_view> out;
+
+		for (auto& block : blocks) {
+			for (auto& i : block.instructions) {
+				if (i.op == IrInstruction::Op::CALL && std::find(out.begin(), out.end(), i.opcode) == out.end()) {
+					out.push_back(i.opcode);
+				}
+			}
+		}
+
+		return out;
+	}
+
+	// Every string constant read, each once, in the order of their first use
+	std::vector<std::string_view> strings() const {
+		std::vector<std::string_view> out;
+
+		for (auto& block : blocks) {
+			for (auto& i : block.instructions) {
+				for (uint32_t j = 0; j < i.operandCount; j++) {
+					const Operand& op = operands[i.firstOperand + j].value;
+					if (op.kind == Operand::Kind::STRING && std::find(out.begin(), out.end(), op.name) == out.end()) {
+						out.push_back(op.name);
+					}
+				}
+			}
+		}
+
+		return out;
+	}
+
+	size_t instructionCount() const {
+		size_t count = 0;
+		for (auto& i : blocks) {
+			count += i.instructions.size();
+		}
+		return count;
+	}
+
+	// The instruction that makes a value, and every instruction that reads it
+	struct Value {
+		IrRef def;
+		std::vector<IrRef> uses;
+	};
+
+	// Def-use chains for every value an instruction makes
+	std::unordered_map<Operand, Value, OperandHash> computeUses() const {
+		std::unordered_map<Operand, Value, OperandHash> values;
+
+		for (uint32_t b = 0; b < blocks.size(); b++) {
+			for (uint32_t i = 0; i < blocks[b].instructions.size(); i++) {
+				const IrInstruction& inst = blocks[b].instructions[i];
+				if (inst.result.kind != Operand::Kind::NONE) {
+					values[inst.result].def = { b, i };
+				}
+			}
+		}
+
+		for (uint32_t b = 0; b < blocks.size(); b++) {
+			for (uint32_t i = 0; i < blocks[b].instructions.size(); i++) {
+				const IrInstruction& inst = blocks[b].instructions[i];
+				const IrOperand* ops = operandsOf(inst);
+
+				for (uint32_t j = 0; j < inst.operandCount; j++) {
+					auto value = values.find(ops[j].value);
+					if (value != values.end()) {
+						value->second.uses.push_back({ b, i });
+					}
+				}
+			}
+		}
+
+		return values;
+	}
+};
+
+// Removes instructions that only make a value nobody reads, including those only read by other removed instructions
+// Returns how many were removed
+inline size_t removeDeadInstructions(IrFunction& fn) {
+	auto values = fn.computeUses();
+
+	std::unordered_map<Operand, size_t, OperandHash> useCounts;
+	std::vector<IrRef> worklist;
+
+	for (auto& [op, value] : values) {
+		useCounts[op] = value.uses.size();
+
+		if (value.uses.empty() && !fn.at(value.def).hasSideEffects()) {
+			worklist.push_back(value.def);
+		}
+	}
+
+	std::vector<std::vector<bool>> dead(fn.blocks.size());
+	for (size_t i = 0; i < fn.blocks.size(); i++) {
+		dead[i].resize(fn.blocks[i].instructions.size());
+	}
+
+	size_t removed = 0;
+
+	while (!worklist.empty()) {
+		IrRef ref = worklist.back();
+		worklist.pop_back();
+
+		if (dead[ref.block][ref.instruction]) {
+			continue;
+		}
+		dead[ref.block][ref.instruction] = true;
+		removed++;
+
+		IrInstruction& inst = fn.at(ref);
+		IrOperand* ops = fn.operandsOf(inst);
+
+		// Whatever made this instruction's operands may now be dead too
+		for (uint32_t i = 0; i < inst.operandCount; i++) {
+			auto value = values.find(ops[i].value);
+			if (value == values.end()) {
+				continue;
+			}
+
+			if (--useCounts[ops[i].value] == 0 && !fn.at(value->second.def).hasSideEffects()) {
+				worklist.push_back(value->second.def);
+			}
+		}
+	}
+
+	for (size_t b = 0; b < fn.blocks.size(); b++) {
+		auto& instructions = fn.blocks[b].instructions;
+
+		size_t kept = 0;
+		for (size_t i = 0; i < instructions.size(); i++) {
+			if (!dead[b][i]) {
+				instructions[kept++] = instructions[i];
+			}
+		}
+		instructions.resize(kept);
+	}
+
+	return removed;
+}
+
+// Writes a function as textual IR, numbering its unnamed values and blocks in the order LLVM expects
+class IrPrinter {
+	OutputBuffer& out;
+	const IrFunction& fn;
+
+	// What each register is printed as
+	std::vector<int> numbers;
+	int next = 0;
+
+	void number(const Operand& op) {
+		if (op.kind == Operand::Kind::REGISTER) {
+			numbers[op.value] = next++;
+		}
+	}
+
+	void value(const Operand& op) {
+		if (op.kind == Operand::Kind::REGISTER) {
+			out << '%' << numbers[op.value];
+		}
+		else {
+			op.writeTo(out);
+		}
+	}
+
+	void typed(const IrOperand& op) {
+		out << op.type->name() << ' ';
+		value(op.value);
+	}
+
+	void instruction(const IrInstruction& inst) {
+		using Op = IrInstruction::Op;
+
+		const IrOperand* ops = fn.operandsOf(inst);
+
+		out << '\t';
+		if (inst.result.kind != Operand::Kind::NONE) {
+			value(inst.result);
+			out << " = ";
+		}
+
+		switch (inst.op) {
+		case Op::ALLOCA:
+			out << "alloca " << inst.type->name();
+			if (inst.operandCount) {
+				out << ", ";
+				typed(ops[0]);
+			}
+			break;
+		case Op::LOAD:
+			out << "load " << inst.type->name() << ", ";
+			typed(ops[0]);
+			break;
+		case Op::STORE:
+			out << "store ";
+			typed(ops[0]);
+			out << ", ";
+			typed(ops[1]);
+			break;
+		case Op::BINARY:
+		case Op::ICMP:
+			out << (inst.op == Op::ICMP ? "icmp " : "") << inst.opcode << ' ' << inst.type->name() << ' ';
+			value(ops[0].value);
+			out << ", ";
+			value(ops[1].value);
+			break;
+		case Op::CAST:
+			out << inst.opcode << ' ';
+			typed(ops[0]);
+			out << " to " << inst.type->name();
+			break;
+		case Op::GEP:
+			out << "getelementptr inbounds " << inst.type->name();
+			for (uint32_t i = 0; i < inst.operandCount; i++) {
+				out << ", ";
+				typed(ops[i]);
+			}
+			break;
+		case Op::CALL:
+			out << "call " << inst.type->name() << " @" << inst.opcode << '(';
+			for (uint32_t i = 0; i < inst.operandCount; i++) {
+				if (i) {
+					out << ", ";
+				}
+				typed(ops[i]);
+			}
+			out << ')';
+			break;
+		case Op::BR:
+			out << "br label ";
+			value(ops[0].value);
+			break;
+		case Op::COND_BR:
+			out << "br i1 ";
+			value(ops[0].value);
+			out << ", label ";
+			value(ops[1].value);
+			out << ", label ";
+			value(ops[2].value);
+			break;
+		case Op::RET:
+			out << "ret ";
+			if (inst.operandCount) {
+				typed(ops[0]);
+			}
+			else {
+				out << "void";
+			}
+			break;
+		}
+
+		if (inst.align) {
+			out << ", align " << inst.align;
+		}
+
+		out << '\n';
+	}
+
+	void arguments() {
+		out << " (";
+		for (size_t i = 0; i < fn.arguments.size(); i++) {
+			if (i) {
+				out << ", ";
+			}
+			typed(fn.arguments[i]);
+		}
+		out << ") #0";
+	}
+
+public:
+	IrPrinter(OutputBuffer& out_, const IrFunction& fn_) : out(out_), fn(fn_), numbers(fn_.registerCount, -1) {}
+
+	void print() {
+		// Unnamed arguments come first, then each unnamed block followed by the values made in it
+		for (auto& i : fn.arguments) {
+			number(i.value);
+		}
+
+		if (!fn.defined) {
+			out << "declare dso_local " << fn.returns->name() << " @" << fn.name;
+			arguments();
+			out << '\n';
+			return;
+		}
+
+		for (auto& block : fn.blocks) {
+			if (block.label.kind == Operand::Kind::NONE) {
+				next++;
+			}
+			for (auto& i : block.instructions) {
+				number(i.result);
+			}
+		}
+
+		out << "define dso_local " << fn.returns->name() << " @" << fn.name;
+		arguments();
+		out << ' ' << fn.visibility << "{\n";
+
+		for (auto& block : fn.blocks) {
+			// Nothing branches to an unnamed block, so it goes without a label
+			if (block.label.kind != Operand::Kind::NONE) {
+				out << '\t';
+				block.label.writeTo(out, false);
+				out << ":\n";
+			}
+
+			for (auto& i : block.instructions) {
+				instruction(i);
+			}
+		}
+
+		out << "}\n";
+	}
+};
+
+#endif // ifndef COMPILER_IR_H
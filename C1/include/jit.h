@@ -0,0 +1,174 @@
+#ifndef COMPILER_JIT_H
+#define COMPILER_JIT_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <dlfcn.h>
+#endif
+
+#include "type.h"
+#include "function.h"
+#include "constantPool.h"
+#include "x86.h"
+#include "x86Encoder.h"
+
+// Runs the program straight from memory, with no files, assembler or linker
+// main and everything it calls are encoded into one executable mapping, and functions the program only declares,
+// like puts and malloc, are called in the compiler's own libc through dlsym
+class Jit {
+	std::vector<uint8_t> code;
+	std::vector<X86Relocation> relocations;
+
+	// Where each function, stub and string starts in code
+	std::unordered_map<std::string_view, size_t> symbols;
+
+	// print as the IR preamble has it, which LLVM would give printf an i32 whatever the data model
+	static void print32(int32_t val) {
+		printf("%d\n", val);
+	}
+
+	static void print64(int64_t val) {
+		printf("%d\n", (int32_t)val);
+	}
+
+	// A host function is too far away for a call's 32 bit displacement, so calls go through a jmp *0(%rip) and its address
+	void addStub(std::string_view name, const void* address) {
+		symbols[name] = code.size();
+
+		for (uint8_t i : { 0xFF, 0x25, 0x00, 0x00, 0x00, 0x00 }) {
+			code.push_back(i);
+		}
+
+		uint64_t bits = (uint64_t)(uintptr_t)address;
+		for (int i = 0; i < 8; i++) {
+			code.push_back((uint8_t)(bits >> (i * 8)));
+		}
+	}
+
+	// Finds whatever a relocation refers to that wasn't compiled, and places a stub or the string's bytes for it
+	void resolve(std::string_view symbol) {
+		if (symbols.contains(symbol)) {
+			return;
+		}
+
+		if (auto str = constants ? constants->find(symbol) : nullptr) {
+			symbols[symbol] = code.size();
+			code.insert(code.end(), str->bytes.begin(), str->bytes.end());
+			return;
+		}
+
+		if (symbol == "print") {
+			addStub(symbol, types().intType()->width() == 64 ? (const void*)&print64 : (const void*)&print32);
+			return;
+		}
+
+#ifndef _WIN32
+		void* address = dlsym(RTLD_DEFAULT, std::string(symbol).c_str());
+		if (address) {
+			addStub(symbol, address);
+			return;
+		}
+#endif
+
+		throw SourceError(DiagId::JIT_UNRESOLVED, symbol);
+	}
+
+public:
+	// String constants the functions refer to
+	ConstantPool* constants = nullptr;
+
+	// Run the IR passes on each function before it is encoded
+	bool optimize = false;
+
+	// Returns what main returns
+	int run(Scope* global) {
+#ifdef _WIN32
+		throw SourceError(DiagId::JIT_UNSUPPORTED, "code for Windows");
+#else
+		if (targetPlatform != Platform::LINUX || types().primitiveTable().pointerWidth != 64) {
+			throw SourceError(DiagId::JIT_UNSUPPORTED, "code for another data model or platform");
+		}
+
+		std::unordered_map<std::string_view, Function*> functions;
+		for (auto& i : global->getFunctions()) {
+			auto& fn = functions[i->mangleName()];
+			if (!fn || i->defined) {
+				fn = i;
+			}
+		}
+
+		X86Encoder encoder(code, relocations);
+
+		// Only what main can reach is compiled
+		std::vector<std::string_view> pending = { "main" };
+		while (!pending.empty()) {
+			std::string_view name = pending.back();
+			pending.pop_back();
+
+			auto fn = functions.find(name);
+			if (symbols.contains(name) || fn == functions.end() || !fn->second->defined) {
+				continue;
+			}
+
+			FuncEmitter emitter;
+			emitter.optimize = optimize;
+			emitter.output = FuncEmitter::Output::X86;
+			fn->second->emitFileScope(emitter);
+
+			// print is the preamble's, not the program's
+			if (emitter.machine.code.empty()) {
+				continue;
+			}
+
+			symbols[name] = encoder.encode(emitter.machine);
+
+			for (auto& i : emitter.machine.callees()) {
+				pending.push_back(i);
+			}
+		}
+
+		if (!symbols.contains("main")) {
+			throw SourceError(DiagId::JIT_UNRESOLVED, "main");
+		}
+
+		for (auto& i : relocations) {
+			resolve(i.symbol);
+		}
+
+		for (auto& i : relocations) {
+			encoder.imm32At(i.offset, (int64_t)symbols[i.symbol] - (int64_t)(i.offset + 4));
+		}
+
+		// Written, then made executable, so it is never writable and executable at once
+		void* memory = mmap(nullptr, code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (memory == MAP_FAILED) {
+			throw SourceError(DiagId::JIT_UNSUPPORTED, "code without executable memory");
+		}
+
+		std::memcpy(memory, code.data(), code.size());
+		if (mprotect(memory, code.size(), PROT_READ | PROT_EXEC)) {
+			munmap(memory, code.size());
+			throw SourceError(DiagId::JIT_UNSUPPORTED, "code without executable memory");
+		}
+
+		using Main = int64_t (*)();
+		int64_t ret = reinterpret_cast<Main>(static_cast<uint8_t*>(memory) + symbols["main"])();
+
+		fflush(stdout);
+		munmap(memory, code.size());
+
+		// Only the bits of the int main returns are set
+		return types().intType()->width() == 64 ? (int)ret : (int32_t)ret;
+#endif
+	}
+};
+
+#endif // ifndef COMPILER_JIT_H
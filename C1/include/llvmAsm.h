@@ -7,9 +7,29 @@
 #include <algorithm>
 #include <numeric>
 #include <sstream>
+#include <unordered_set>
+#include <thread>
+#include <atomic>
+#include <exception>
 
 #include "type.h"
 #include "function.h"
+#include "outputSink.h"
+#include "bitcode.h"
+#include "process.h"
+
+// What the generator writes, textual IR or the bitcode assembled from it
+// ASM skips LLVM and is written by X86AsmGenerator instead
+enum class EmitKind {
+	LL,
+	BC,
+	ASM
+};
+constexpr std::string_view EMIT_KINDS_STR[] = {
+	"ll",
+	"bc",
+	"asm"
+};
 
 
 struct LlvmValue {
@@ -33,54 +53,426 @@ struct LlvmStackEntry {
 
 class LlvmAsmGenerator {
 public:
-	std::stringstream llvmAsm;
+	OutputBuffer llvmAsm;
 	std::string_view origFile;
 
+	// Where each finished part of the module goes
+	OutputSink sink;
+	std::string outName;
+
+	// Classes whose types have already been written
+	std::unordered_set<const ClassLayout*> emittedClasses;
+
+	// Functions streamed while only declared, which are written at the end unless a definition turns up
+	std::vector<Function*> pendingDeclarations;
+
+	// Threads that emit functions at once, 1 to emit them one after another
+	unsigned jobs = 1;
+
+	EmitKind emit = EmitKind::LL;
+
+	// Run the IR passes on each function before it is written
+	bool optimize = false;
+
+	// String constants the functions refer to
+	ConstantPool* constants = nullptr;
+
+	// If set, the module is written into this process's stdin instead of a file
+	ChildProcess* pipeTo = nullptr;
+
+	// Modules the functions are divided between, so that they can be compiled in parallel and linked
+	unsigned split = 1;
+
 	LlvmAsmGenerator(std::string_view origFile_) : origFile(origFile_) {}
 
 	void generate(std::string_view outFileName, Scope* global) {
+		if (split > 1) {
+			generateSplit(outFileName, global);
+			return;
+		}
+
+		openOutput(outFileName);
+
+		genPreamble();
+		genClassTypes();
+		flushStream();
+
+		emitFunctions(global->getFunctions(), [&](size_t, FuncEmitter& emitter) {
+			sink.write(std::move(emitter.codeOut));
+		});
+
+		genConstants();
+		genPostamble();
+		if (outFileName == "") {
+			llvmAsm << '\n';
+		}
+
+		closeOutput();
+	}
+
+	void openOutput(std::string_view outFileName) {
+		outName = outFileName;
+
+		// Bitcode can only be written once the whole module is known, so the text is kept until then
+		if (emit == EmitKind::BC) {
+			sink.openMemory();
+			return;
+		}
+
+		openSink();
+	}
+
+	void openSink() {
+		if (pipeTo) {
+			sink.attach(pipeTo->inputFd());
+		}
+		else if (!sink.open(outName)) {
+			throw SourceError(DiagId::OUTPUT_WRITE_FAILED, outName);
+		}
+	}
+
+	void closeOutput() {
+		flushStream();
+
+		if (emit == EmitKind::BC) {
+			std::string text = sink.release().str();
+			OutputBuffer bitcode = assembleBitcode(text);
+
+			openSink();
+			sink.write(std::move(bitcode));
+		}
+
+		sink.close();
+
+		if (sink.hasFailed()) {
+			throw SourceError(DiagId::OUTPUT_WRITE_FAILED, outName);
+		}
+	}
+
+	void emitFunction(Function* fn) {
+		FuncEmitter emitter;
+		emitter.optimize = optimize;
+		fn->emitFileScope(emitter);
+		llvmAsm.splice(std::move(emitter.codeOut));
+	}
+
+	// Emits each function on a pool of threads, and hands each emitter to onEmitted in source order
+	// so the output is the same as emitting them one by one
+	template <typename FuncT>
+	void emitFunctions(const std::vector<Function*>& functions, FuncT&& onEmitted) {
+		unsigned threadCount = std::min<size_t>(jobs, functions.size());
+
+		if (threadCount <= 1) {
+			for (size_t i = 0; i < functions.size(); i++) {
+				FuncEmitter emitter;
+				emitter.optimize = optimize;
+				functions[i]->emitFileScope(emitter);
+				onEmitted(i, emitter);
+			}
+			return;
+		}
+
+		// Names are cached on first use, so they are all made here rather than by whichever thread calls first
+		for (auto& i : functions) {
+			i->mangleName();
+		}
+
+		// Longest first, so that a long function started last doesn't leave the other threads idle
+		std::vector<size_t> order(functions.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+			return functions[a]->nodes.nodes.size() > functions[b]->nodes.nodes.size();
+		});
+
+		std::vector<FuncEmitter> emitters(functions.size());
+		std::vector<std::exception_ptr> errors(functions.size());
+		std::vector<std::atomic<bool>> done(functions.size());
+		std::atomic<size_t> next = 0;
+
+		auto work = [&]() {
+			for (size_t i = next++; i < order.size(); i = next++) {
+				size_t index = order[i];
+
+				try {
+					emitters[index].optimize = optimize;
+					functions[index]->emitFileScope(emitters[index]);
+				}
+				catch (...) {
+					errors[index] = std::current_exception();
+				}
+
+				done[index].store(true, std::memory_order_release);
+				done[index].notify_one();
+			}
+		};
+
+		std::vector<std::thread> threads;
+		for (unsigned i = 0; i < threadCount; i++) {
+			threads.emplace_back(work);
+		}
+
+		// Write each function out as soon as it and everything before it is done, while the rest are still being emitted
+		std::exception_ptr error;
+
+		for (size_t i = 0; i < functions.size(); i++) {
+			done[i].wait(false, std::memory_order_acquire);
+
+			// Report the error that serial emission would have run into first, and stop taking new work
+			if (errors[i]) {
+				error = errors[i];
+				next.store(order.size());
+				break;
+			}
+
+			onEmitted(i, emitters[i]);
+			emitters[i] = FuncEmitter();
+		}
+
+		for (auto& i : threads) {
+			i.join();
+		}
+
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+
+	// out.ll's Nth module is out.N.ll
+	static std::string splitName(std::string_view name, unsigned index) {
+		if (name.empty()) {
+			return {};
+		}
+
+		size_t dot = name.rfind('.');
+		size_t slash = name.find_last_of("/\\");
+		if (dot == std::string_view::npos || (slash != std::string_view::npos && dot < slash)) {
+			dot = name.size();
+		}
+
+		return buildStr(name.substr(0, dot), ".", index, name.substr(dot));
+	}
+
+	// Divides the functions between split modules with about as many instructions each
+	// Every module has the preamble and the class types, and declares whatever it calls that another module defines
+	void generateSplit(std::string_view outFileName, Scope* global) {
+		const std::vector<Function*>& functions = global->getFunctions();
+
+		struct Part {
+			OutputBuffer text;
+			std::vector<std::string_view> callees;
+			std::vector<std::string_view> strings;
+			size_t instructions = 0;
+		};
+		std::vector<Part> parts(functions.size());
+
+		emitFunctions(functions, [&](size_t i, FuncEmitter& emitter) {
+			parts[i] = { std::move(emitter.codeOut), emitter.function.callees(), emitter.function.strings(), emitter.function.instructionCount() };
+		});
+
+		std::unordered_map<std::string_view, Function*> byName;
+		std::vector<size_t> order;
+
+		for (size_t i = 0; i < functions.size(); i++) {
+			byName.try_emplace(functions[i]->mangleName(), functions[i]);
+
+			if (functions[i]->defined) {
+				order.push_back(i);
+			}
+		}
+
+		// Largest first, each onto the module with the fewest instructions so far
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+			return parts[a].instructions > parts[b].instructions;
+		});
+
+		std::vector<std::vector<size_t>> modules(split);
+		std::vector<size_t> sizes(split);
+
+		for (auto& i : order) {
+			size_t smallest = std::min_element(sizes.begin(), sizes.end()) - sizes.begin();
+			modules[smallest].push_back(i);
+			sizes[smallest] += parts[i].instructions;
+		}
+
+		for (unsigned m = 0; m < split; m++) {
+			std::vector<size_t>& module = modules[m];
+			std::sort(module.begin(), module.end());
+
+			openOutput(splitName(outFileName, m));
+
+			emittedClasses.clear();
+			genPreamble();
+			genClassTypes();
+
+			std::unordered_set<std::string_view> declared = { "print" }; // Defined by the preamble
+			for (auto& i : module) {
+				declared.insert(functions[i]->mangleName());
+			}
+
+			for (auto& i : module) {
+				llvmAsm.splice(std::move(parts[i].text));
+			}
+
+			for (auto& i : module) {
+				for (auto& callee : parts[i].callees) {
+					auto fn = byName.find(callee);
+					if (fn != byName.end() && declared.insert(callee).second) {
+						FuncEmitter emitter;
+						fn->second->emitDeclaration(emitter);
+						llvmAsm.splice(std::move(emitter.codeOut));
+					}
+				}
+			}
+
+			// Only the strings this module's functions use
+			std::unordered_set<std::string_view> written;
+			for (auto& i : module) {
+				for (auto& name : parts[i].strings) {
+					if (written.insert(name).second) {
+						ConstantPool::write(llvmAsm, *constants->find(name));
+					}
+				}
+			}
+
+			genPostamble();
+			if (outFileName == "") {
+				llvmAsm << '\n';
+			}
+
+			closeOutput();
+		}
+	}
+
+	// Streaming keeps only the function currently being written in memory
+	// Everything declared before parsing starts, like the builtins, is emitted up front
+	void beginStream(std::string_view outFileName, Scope* global) {
+		openOutput(outFileName);
+
 		genPreamble();
 
 		for (auto& i : global->getFunctions()) {
-			FuncEmitter emitter;
-			i->emitFileScope(emitter);
-			llvmAsm << emitter.codeOut.str();
+			emitFunction(i);
 		}
 
-		genPostamble();
+		flushStream();
+	}
 
-		if (outFileName == "") {
-			std::cout << llvmAsm.str() << '\n';
+	void streamFunction(Function* fn) {
+		if (!fn->defined) {
+			pendingDeclarations.push_back(fn);
+			return;
 		}
-		else {
-			writeToFile(std::string(outFileName));
+
+		// A struct type must be defined before a getelementptr on it is read
+		genClassTypes();
+		emitFunction(fn);
+		flushStream();
+	}
+
+	void endStream() {
+		genClassTypes();
+
+		for (auto& i : pendingDeclarations) {
+			emitFunction(i);
 		}
+
+		genConstants();
+		genPostamble();
+		closeOutput();
+	}
+
+	// Hands what has been generated so far to the sink
+	void flushStream() {
+		sink.write(std::move(llvmAsm));
 	}
 
-	void writeToFile(std::string name) {
-		std::ofstream file(name);
-		file << llvmAsm.str();
+	struct Target {
+		std::string_view triple;
+		std::string_view dataLayout;
+	};
+
+	// x86 target for the platform, 32 bit pointers on Linux being the x32 ABI on x86-64
+	static Target targetFor(Platform platform, int pointerWidth) {
+		if (platform == Platform::WINDOWS) {
+			if (pointerWidth == 32) {
+				return { "i686-pc-windows-msvc", "e-m:x-p:32:32-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:32-n8:16:32-a:0:32-S32" };
+			}
+			return { "x86_64-pc-windows-msvc", "e-m:w-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128" };
+		}
+
+		if (pointerWidth == 32) {
+			return { "x86_64-pc-linux-gnux32", "e-m:e-p:32:32-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128" };
+		}
+		return { "x86_64-pc-linux-gnu", "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128" };
 	}
 
 	void genPreamble() {
+		Target target = targetFor(targetPlatform, types().primitiveTable().pointerWidth);
+
+		// print takes an int, which printf is given as an i32 whatever the data model
+		CppType* intType = types().intType();
+		std::string_view intName = intType->getLlvmName();
+		int intAlign = intType->align();
+
+		std::string_view widen = intType->width() < 32 ? "sext" : "trunc";
+		bool converted = intType->width() != 32;
+
 		appendAll(llvmAsm, "; ModuleID = \"", origFile, "\"\n",
 			"source_filename = \"", origFile, "\"\n",
-			"target datalayout = \"e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128\"\n",
-			"target triple = \"x86_64-pc-linux-gnu\"\n",
+			"target datalayout = \"", target.dataLayout, "\"\n",
+			"target triple = \"", target.triple, "\"\n",
 			"\n",
 			"@print_int_fstring = private unnamed_addr constant [4 x i8] c\"%d\\0A\\00\", align 1\n",
 			"\n",
 			"; Function Attrs: noinline nounwind optnone uwtable\n"
-			"define dso_local void @print(i32 %0) #0 {\n",
-			"\t%2 = alloca i32, align 4\n",
-			"\tstore i32 %0, i32* %2, align 4\n",
-			"\t%3 = load i32, i32* %2, align 4\n",
-			"\t%4 = call i32(i8*, ...) @printf(i8 * getelementptr inbounds([4 x i8], [4 x i8]* @print_int_fstring, i64 0, i64 0), i32 %3)\n",
+			"define linkonce_odr dso_local void @print(", intName, " %0) #0 {\n",
+			"\t%2 = alloca ", intName, ", align ", intAlign, "\n",
+			"\tstore ", intName, " %0, ", intName, "* %2, align ", intAlign, "\n",
+			"\t%3 = load ", intName, ", ", intName, "* %2, align ", intAlign, "\n"
+		);
+
+		if (converted) {
+			appendAll(llvmAsm, "\t%4 = ", widen, " ", intName, " %3 to i32\n");
+		}
+
+		appendAll(llvmAsm,
+			"\t%", converted ? 5 : 4, " = call i32(i8*, ...) @printf(i8 * getelementptr inbounds([4 x i8], [4 x i8]* @print_int_fstring, i64 0, i64 0), i32 %", converted ? 4 : 3, ")\n",
 			"\tret void\n",
 			"}\n\n"
 		);
 	}
 
+	// %struct.Name = type { ... } for every class completed since the last call
+	void genClassTypes() {
+		bool any = false;
+
+		for (auto& layout : types().getClasses()) {
+			if (!layout.complete || emittedClasses.contains(&layout)) {
+				continue;
+			}
+
+			emittedClasses.insert(&layout);
+
+			llvmAsm << layout.llvmType->declare() << '\n';
+			any = true;
+		}
+
+		if (any) {
+			llvmAsm << '\n';
+		}
+	}
+
+	// Globals can come after the functions that use them, so the pool is written once every function has been parsed
+	void genConstants() {
+		if (!constants) {
+			return;
+		}
+
+		for (auto& i : constants->getStrings()) {
+			ConstantPool::write(llvmAsm, i);
+		}
+	}
+
 	void genPostamble() {
 		appendAll(llvmAsm, R"B(
 declare i32 @printf(i8*, ...) #1
@@ -1,32 +1,78 @@
 #ifndef COMPILER_LLVMTYPE_H
 #define COMPILER_LLVMTYPE_H
 
-
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <tuple>
+
+#include "util.h"
+
+// Every LLVM type exists once in the LlvmTypeTable, so its textual name is built when it is made and never again
 struct LlvmType {
-	virtual std::string name() = 0;
+	enum class Kind {
+		VOID,
+		FUNCTION,
+		INT,
+		FLOAT,
+		POINTER,
+		VECTOR,
+		LABEL,
+		TOKEN,
+		METADATA,
+		ARRAY,
+		LITERAL_STRUCT,
+		IDENTIFIED_STRUCT,
+		CONSTANT
+	};
+
+	Kind kind;
+	std::string _name;
+
+	// This type with a pointer layer added, made on first use
+	LlvmType* _pointer = nullptr;
+
+	LlvmType(Kind kind_, std::string name_) : kind(kind_), _name(std::move(name_)) {}
+	virtual ~LlvmType() = default;
+
+	const std::string& name() const {
+		return _name;
+	}
 };
 
 struct LlvmTypeVoid : public LlvmType {
+	LlvmTypeVoid() : LlvmType(Kind::VOID, "void") {}
+
 	int size() {
 		return 0;
 	}
-
-	std::string name() {
-		return "void";
-	}
 };
 
 struct LlvmTypeFunction : public LlvmType {
 	LlvmType* returns;
 	std::vector<LlvmType*> args;
+	bool varArg = false; // Takes more arguments after args, like printf
 
-	std::string name() {
+	LlvmTypeFunction(LlvmType* returns_, std::vector<LlvmType*> args_, bool varArg_ = false) :
+		LlvmType(Kind::FUNCTION, makeName(returns_, args_, varArg_)), returns(returns_), args(std::move(args_)), varArg(varArg_) {}
+
+	static std::string makeName(LlvmType* returns, const std::vector<LlvmType*>& args, bool varArg) {
 		std::string out = returns->name();
 		out += " (";
 
 		for (auto& arg : args) {
+			if (&arg != &args.front()) {
+				out += ", ";
+			}
 			out += arg->name();
-			out += ", ";
+		}
+
+		if (varArg) {
+			out += args.empty() ? "..." : ", ...";
 		}
 
 		out += ")";
@@ -38,9 +84,7 @@ struct LlvmTypeFunction : public LlvmType {
 struct LlvmTypeInt : public LlvmType {
 	int width;
 
-	std::string name() {
-		return "i" + std::to_string(width);
-	}
+	LlvmTypeInt(int width_) : LlvmType(Kind::INT, "i" + std::to_string(width_)), width(width_) {}
 };
 
 struct LlvmTypeFloat : public LlvmType {
@@ -51,133 +95,92 @@ struct LlvmTypeFloat : public LlvmType {
 		DOUBLE,
 		FP128,
 		X86_FP80,
-		PPC_FP128
+		PPC_FP128,
+
+		COUNT
 	};
 
 	static constexpr std::string_view FLOAT_TYPES_STR[] = {
 		"half",
 		"bfloat",
+		"float",
 		"double",
 		"fp128",
 		"x86_fp80",
 		"ppc_fp128"
 	};
 
-
 	FLOAT_TYPES type;
 
-	std::string name() {
-		return std::string(FLOAT_TYPES_STR[(int)type]);
-	}
+	LlvmTypeFloat(FLOAT_TYPES type_) : LlvmType(Kind::FLOAT, std::string(FLOAT_TYPES_STR[(int)type_])), type(type_) {}
 };
 
 // LLVM uses opaque pointers as of LLVM 15, but my clang is too old for that
 struct LlvmTypePtr : public LlvmType {
 	LlvmType* destType;
 
-	std::string name() {
-		return destType->name() + "*";
-	}
+	LlvmTypePtr(LlvmType* destType_) : LlvmType(Kind::POINTER, destType_->name() + "*"), destType(destType_) {}
 };
 
 struct LlvmTypeVec : public LlvmType {
 	int size; // Element count
 	LlvmType* dataType;
 
-	std::string name() {
-		std::string out = "<";
-		out += std::to_string(size);
-		out += " x ";
-		out += dataType->name();
-		out += ">";
-		return out;
-	}
+	LlvmTypeVec(int size_, LlvmType* dataType_) :
+		LlvmType(Kind::VECTOR, buildStr("<", size_, " x ", dataType_->name(), ">")), size(size_), dataType(dataType_) {}
 };
 
 struct LlvmTypeLabel : public LlvmType {
-	std::string _name;
-
-	std::string name() {
-		return _name;
-	}
+	LlvmTypeLabel() : LlvmType(Kind::LABEL, "label") {}
 };
 
 struct LlvmTypeToken : public LlvmType {
-	std::string _name;
-
-	std::string name() {
-		return _name;
-	}
+	LlvmTypeToken() : LlvmType(Kind::TOKEN, "token") {}
 };
 
 struct LlvmTypeMetadata : public LlvmType {
-	std::string _name;
-
-	std::string name() {
-		return _name;
-	}
+	LlvmTypeMetadata() : LlvmType(Kind::METADATA, "metadata") {}
 };
 
 struct LlvmTypeArray : public LlvmType {
 	int size; // Element count
 	LlvmType* dataType;
 
-	std::string name() {
-		std::string out = "[";
-		out += std::to_string(size);
-		out += " x ";
-		out += dataType->name();
-		out += "]";
-		return out;
-	}
+	LlvmTypeArray(int size_, LlvmType* dataType_) :
+		LlvmType(Kind::ARRAY, buildStr("[", size_, " x ", dataType_->name(), "]")), size(size_), dataType(dataType_) {}
 };
 
 struct LlvmTypeLiteralStruct : public LlvmType {
 	std::vector<LlvmType*> members;
 	bool packed = false;
 
-	std::string name() {
-		std::string out = "type { ";
+	LlvmTypeLiteralStruct(std::vector<LlvmType*> members_, bool packed_) :
+		LlvmType(Kind::LITERAL_STRUCT, makeName(members_, packed_)), members(std::move(members_)), packed(packed_) {}
+
+	static std::string makeName(const std::vector<LlvmType*>& members, bool packed) {
+		std::string out = packed ? "<{" : "{";
 
 		for (auto& member : members) {
+			out += (&member == &members.front()) ? " " : ", ";
 			out += member->name();
-			out += ", ";
 		}
 
-		out += " }";
+		out += members.empty() ? "" : " ";
+		out += packed ? "}>" : "}";
 		return out;
 	}
-
-	bool equals(LlvmType* rhs) {
-		return false;
-	}
 };
 
+// A named struct, which may refer to itself through pointers and only gets its members once they are known
 struct LlvmTypeIdentifiedStruct : public LlvmType {
 	std::string prettyName;
-	std::string codeName;
-	LlvmTypeLiteralStruct type;
+	LlvmTypeLiteralStruct* type = nullptr; // Body, null while opaque
 
-	void init() {
-		codeName = "%struct.";
-		codeName += prettyName;
-	}
+	LlvmTypeIdentifiedStruct(std::string prettyName_) :
+		LlvmType(Kind::IDENTIFIED_STRUCT, "%" + quoteLlvmName("struct." + prettyName_)), prettyName(std::move(prettyName_)) {}
 
 	std::string declare() {
-		std::string out = codeName;
-		out += " = ";
-		out += type.name();
-		return out;
-	}
-
-	std::string name() {
-		return codeName;
-	}
-};
-
-struct LlvmTypeOpaqueStruct : public LlvmType {
-	std::string name() {
-		return "type opaque";
+		return name() + " = type " + (type ? type->name() : std::string("opaque"));
 	}
 };
 
@@ -186,37 +189,151 @@ struct LlvmTypeOpaqueStruct : public LlvmType {
 struct LlvmTypeConstantBool : public LlvmType {
 	bool val;
 
-	std::string name() {
-		return val ? "true" : "false";
-	}
+	LlvmTypeConstantBool(bool val_) : LlvmType(Kind::CONSTANT, val_ ? "true" : "false"), val(val_) {}
 };
 
 struct LlvmTypeConstantInt : public LlvmType {
-	std::string val;
-
-	std::string name() {
-		return val;
-	}
+	LlvmTypeConstantInt(std::string val) : LlvmType(Kind::CONSTANT, std::move(val)) {}
 };
 
 struct LlvmTypeConstantFloat : public LlvmType {
-	std::string val;
-
-	std::string name() {
-		return val;
-	}
+	LlvmTypeConstantFloat(std::string val) : LlvmType(Kind::CONSTANT, std::move(val)) {}
 };
 
 struct LlvmTypeConstantNullPtr : public LlvmType {
-	std::string name() {
-		return "null";
-	}
+	LlvmTypeConstantNullPtr() : LlvmType(Kind::CONSTANT, "null") {}
 };
 
 struct LlvmTypeConstantToken : public LlvmType {
-	std::string name() {
-		return "none";
+	LlvmTypeConstantToken() : LlvmType(Kind::CONSTANT, "none") {}
+};
+
+
+// Owns every LLVM type and hands out one instance per distinct type
+class LlvmTypeTable {
+	std::vector<std::unique_ptr<LlvmType>> owned;
+
+	LlvmTypeVoid* _void = nullptr;
+	LlvmTypeLabel* _label = nullptr;
+	std::array<LlvmTypeFloat*, LlvmTypeFloat::COUNT> floats = {};
+
+	std::map<int, LlvmTypeInt*> ints;
+	std::map<std::pair<int, LlvmType*>, LlvmTypeArray*> arrays;
+	std::map<std::pair<int, LlvmType*>, LlvmTypeVec*> vectors;
+	std::map<std::tuple<LlvmType*, std::vector<LlvmType*>, bool>, LlvmTypeFunction*> functions;
+	std::map<std::pair<std::vector<LlvmType*>, bool>, LlvmTypeLiteralStruct*> literalStructs;
+	std::unordered_map<std::string, LlvmTypeIdentifiedStruct*> identifiedStructs;
+
+	// Struct member indices are always i32, whatever the data model
+	LlvmTypeInt* _memberIndex = nullptr;
+
+	template <typename T, typename... ArgsT>
+	T* make(ArgsT&&... args) {
+		T* type = new T(std::forward<ArgsT>(args)...);
+		owned.emplace_back(type);
+		return type;
+	}
+
+	// Made up front, so that it can be used while functions are emitted on several threads
+	LlvmTypeTable() {
+		_memberIndex = intType(32);
+	}
+
+public:
+	static LlvmTypeTable& global() {
+		static LlvmTypeTable table;
+		return table;
+	}
+
+	LlvmTypeVoid* voidType() {
+		if (!_void) {
+			_void = make<LlvmTypeVoid>();
+		}
+		return _void;
+	}
+
+	LlvmTypeLabel* labelType() {
+		if (!_label) {
+			_label = make<LlvmTypeLabel>();
+		}
+		return _label;
+	}
+
+	LlvmTypeInt* intType(int width) {
+		auto& slot = ints[width];
+		if (!slot) {
+			slot = make<LlvmTypeInt>(width);
+		}
+		return slot;
+	}
+
+	LlvmTypeInt* memberIndexType() {
+		return _memberIndex;
+	}
+
+	LlvmTypeFloat* floatType(LlvmTypeFloat::FLOAT_TYPES type) {
+		auto& slot = floats[type];
+		if (!slot) {
+			slot = make<LlvmTypeFloat>(type);
+		}
+		return slot;
+	}
+
+	LlvmTypePtr* pointerTo(LlvmType* type) {
+		if (!type->_pointer) {
+			type->_pointer = make<LlvmTypePtr>(type);
+		}
+		return static_cast<LlvmTypePtr*>(type->_pointer);
+	}
+
+	LlvmTypeArray* arrayOf(int size, LlvmType* type) {
+		auto& slot = arrays[{ size, type }];
+		if (!slot) {
+			slot = make<LlvmTypeArray>(size, type);
+		}
+		return slot;
+	}
+
+	LlvmTypeVec* vectorOf(int size, LlvmType* type) {
+		auto& slot = vectors[{ size, type }];
+		if (!slot) {
+			slot = make<LlvmTypeVec>(size, type);
+		}
+		return slot;
+	}
+
+	LlvmTypeFunction* functionType(LlvmType* returns, const std::vector<LlvmType*>& args, bool varArg = false) {
+		auto& slot = functions[{ returns, args, varArg }];
+		if (!slot) {
+			slot = make<LlvmTypeFunction>(returns, args, varArg);
+		}
+		return slot;
+	}
+
+	LlvmTypeLiteralStruct* literalStruct(const std::vector<LlvmType*>& members, bool packed = false) {
+		auto& slot = literalStructs[{ members, packed }];
+		if (!slot) {
+			slot = make<LlvmTypeLiteralStruct>(members, packed);
+		}
+		return slot;
+	}
+
+	// Named structs are looked up by name, their body is filled in separately with setBody
+	LlvmTypeIdentifiedStruct* identifiedStruct(std::string_view name) {
+		auto& slot = identifiedStructs[std::string(name)];
+		if (!slot) {
+			slot = make<LlvmTypeIdentifiedStruct>(std::string(name));
+		}
+		return slot;
+	}
+
+	void setBody(LlvmTypeIdentifiedStruct* type, const std::vector<LlvmType*>& members) {
+		type->type = literalStruct(members);
 	}
 };
 
-#endif // ifndef COMPILER_LLVMTYPE_H
\ No newline at end of file
+inline LlvmTypeTable& llvmTypes() {
+	return LlvmTypeTable::global();
+}
+
+#endif // ifndef COMPILER_LLVMTYPE_H
@@ -0,0 +1,361 @@
+#ifndef COMPILER_MANGLE_H
+#define COMPILER_MANGLE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <cctype>
+
+#include "function.h"
+#include "template.h"
+
+// Builds Itanium C++ ABI symbol names, like _ZN2ns3addEii for ns::add(int, int)
+struct Mangler {
+	std::string out;
+
+	// Everything that may be referred back to with S_, S0_, ... in the order it was first written
+	// Types are keyed by their canonical CppType, scopes by their Scope and template names by their spelling
+	std::vector<const void*> substitutions;
+
+	// Types that depend on a template parameter have no CppType, so they are keyed by an entry here
+	std::deque<std::string> dependentKeys;
+
+	// The function template whose instance is being mangled, if it is one
+	Template* tmpl = nullptr;
+
+	static char builtinCode(BuiltinType type) {
+		switch (type) {
+		case BuiltinType::VOID: return 'v';
+		case BuiltinType::BOOL: return 'b';
+		case BuiltinType::CHAR: return 'c';
+		case BuiltinType::SHORT: return 's';
+		case BuiltinType::INT: return 'i';
+		case BuiltinType::LONG: return 'l';
+		case BuiltinType::LONG_LONG: return 'x';
+		case BuiltinType::FLOAT: return 'f';
+		case BuiltinType::DOUBLE: return 'd';
+		case BuiltinType::LONG_DOUBLE: return 'e';
+		default: return 0;
+		}
+	}
+
+	void sourceName(std::string_view name) {
+		out += std::to_string(name.size());
+		out += name;
+	}
+
+	// Writes a reference to an entity that has already been written, if it has
+	bool substitute(const void* entity) {
+		auto itr = std::find(substitutions.begin(), substitutions.end(), entity);
+		if (itr == substitutions.end()) {
+			return false;
+		}
+
+		size_t index = itr - substitutions.begin();
+		out += 'S';
+
+		if (index > 0) {
+			// Sequence ids are base 36 and start from the second substitution
+			std::string id;
+			for (size_t i = index - 1; ; i /= 36) {
+				id.insert(id.begin(), "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ"[i % 36]);
+				if (i < 36) {
+					break;
+				}
+			}
+			out += id;
+		}
+
+		out += '_';
+		return true;
+	}
+
+	void templateArgs(const std::vector<CppType*>& args) {
+		out += 'I';
+		for (auto& i : args) {
+			type(i);
+		}
+		out += 'E';
+	}
+
+	void type(CppType* t) {
+		TypeContext& context = types();
+
+		if (t->_primitive && !t->_pointerLayers && !t->_isReference && !t->_isConst && !t->_isVolatile) {
+			if (t->_primitive->type == BuiltinType::NULLPTR_T) {
+				out += "Dn";
+			}
+			else {
+				out += builtinCode(t->_primitive->type);
+			}
+			return;
+		}
+
+		if (substitute(t)) {
+			return;
+		}
+
+		CppTypeKey key = context.keyOf(t);
+
+		if (t->_isReference) {
+			out += 'R';
+			key.isReference = false;
+			type(context.get(key));
+		}
+		else if (t->_pointerLayers && (key.pointerLayerConstMask >> (t->_pointerLayers - 1)) & 1) {
+			// A const pointer, as opposed to a pointer to const
+			out += 'K';
+			key.pointerLayerConstMask &= ~(uint64_t(1) << (t->_pointerLayers - 1));
+			type(context.get(key));
+		}
+		else if (t->_pointerLayers) {
+			out += 'P';
+			type(context.pointee(t));
+		}
+		else if (t->_isConst || t->_isVolatile) {
+			out += t->_isVolatile ? "V" : "";
+			out += t->_isConst ? "K" : "";
+			key.isConst = false;
+			key.isVolatile = false;
+			type(context.get(key));
+		}
+		else if (ClassLayout* layout = t->layout()) {
+			if (!layout->templateName.empty()) {
+				if (!substitute(layout->templateName.data())) {
+					sourceName(layout->templateName);
+					substitutions.push_back(layout->templateName.data());
+				}
+				templateArgs(layout->templateArgs);
+			}
+			else {
+				sourceName(layout->name);
+			}
+		}
+
+		substitutions.push_back(t);
+	}
+
+	// The same entry for every spelling of one dependent type
+	const void* dependentKey(const CppTypeKey& key) {
+		std::string id = buildStr(key.coreName, '|', key.pointerLayers, '|', key.pointerLayerConstMask, '|',
+			key.isConst, key.isVolatile, key.isReference);
+
+		auto itr = std::find(dependentKeys.begin(), dependentKeys.end(), id);
+		if (itr != dependentKeys.end()) {
+			return &*itr;
+		}
+		return &dependentKeys.emplace_back(std::move(id));
+	}
+
+	// Index of the template parameter named name, or -1
+	int parameterIndex(std::string_view name) {
+		auto itr = std::find(tmpl->parameters.begin(), tmpl->parameters.end(), name);
+		return itr == tmpl->parameters.end() ? -1 : (int)(itr - tmpl->parameters.begin());
+	}
+
+	// Whether a spelling names one of the template's parameters anywhere, like T in const Box<T*>&
+	bool isDependent(std::string_view spelling) {
+		size_t i = 0;
+		while (i < spelling.size()) {
+			size_t begin = i;
+			while (i < spelling.size() && (std::isalnum((unsigned char)spelling[i]) || spelling[i] == '_')) {
+				i++;
+			}
+
+			if (i > begin && parameterIndex(spelling.substr(begin, i - begin)) >= 0) {
+				return true;
+			}
+			i = std::max(i, begin + 1);
+		}
+
+		return false;
+	}
+
+	// Writes a type as the template spelled it, with T_ for its first parameter, T0_ for the second and so on
+	// The parts that don't depend on a parameter are written as the types they name
+	void dependentType(CppTypeKey key) {
+		if (!isDependent(key.coreName)) {
+			type(types().get(key));
+			return;
+		}
+
+		const void* entity = dependentKey(key);
+		if (substitute(entity)) {
+			return;
+		}
+
+		int param = parameterIndex(key.coreName);
+
+		if (key.isReference) {
+			out += 'R';
+			key.isReference = false;
+			dependentType(key);
+		}
+		else if (key.pointerLayers && (key.pointerLayerConstMask >> (key.pointerLayers - 1)) & 1) {
+			out += 'K';
+			key.pointerLayerConstMask &= ~(uint64_t(1) << (key.pointerLayers - 1));
+			dependentType(key);
+		}
+		else if (key.pointerLayers) {
+			out += 'P';
+			key.pointerLayers--;
+			key.pointerLayerConstMask &= (uint64_t(1) << key.pointerLayers) - 1;
+			dependentType(key);
+		}
+		else if (key.isConst || key.isVolatile) {
+			out += key.isVolatile ? "V" : "";
+			out += key.isConst ? "K" : "";
+			key.isConst = false;
+			key.isVolatile = false;
+			dependentType(key);
+		}
+		else if (param >= 0) {
+			out += param == 0 ? "T_" : buildStr("T", param - 1, "_");
+		}
+		else {
+			// A class template given a parameter, like Box<T>
+			std::string_view core = key.coreName;
+			std::string_view name = core.substr(0, core.find('<'));
+
+			// The class template's own name is what instances of it are substituted by
+			const void* nameEntity = nullptr;
+			if (Declaration* decl = tmpl->scope->lookup(name)) {
+				if (Template** classTmpl = std::get_if<Template*>(&decl->data)) {
+					nameEntity = (*classTmpl)->name.data();
+				}
+			}
+
+			if (!nameEntity || !substitute(nameEntity)) {
+				sourceName(name);
+				if (nameEntity) {
+					substitutions.push_back(nameEntity);
+				}
+			}
+
+			out += 'I';
+			std::string_view args = core.substr(name.size() + 1, core.size() - name.size() - 2);
+			size_t begin = 0;
+			int depth = 0;
+			for (size_t i = 0; i <= args.size(); i++) {
+				if (i == args.size() || (args[i] == ',' && depth == 0)) {
+					std::string_view arg = args.substr(begin, i - begin);
+					arg.remove_prefix(std::min(arg.find_first_not_of(" \t"), arg.size()));
+					arg.remove_suffix(arg.size() - std::min(arg.find_last_not_of(" \t") + 1, arg.size()));
+
+					dependentType(TypeContext::parseSpelling(arg));
+					begin = i + 1;
+				}
+				else {
+					depth += args[i] == '<' ? 1 : args[i] == '>' ? -1 : 0;
+				}
+			}
+			out += 'E';
+		}
+
+		substitutions.push_back(entity);
+	}
+
+	// A parameter or return type of a template instance, by how the template spelled it
+	void templateType(std::string_view spelling, CppType* concrete, bool parameter) {
+		if (!isDependent(spelling)) {
+			type(parameter ? topLevelUnqualified(concrete) : concrete);
+			return;
+		}
+
+		CppTypeKey key = TypeContext::parseSpelling(spelling);
+
+		if (parameter && !key.isReference) {
+			if (key.pointerLayers) {
+				key.pointerLayerConstMask &= ~(uint64_t(1) << (key.pointerLayers - 1));
+			}
+			else {
+				key.isConst = false;
+				key.isVolatile = false;
+			}
+		}
+
+		dependentType(key);
+	}
+
+	// _Z <name> [I <template args> E <return type>] <parameter types>
+	static std::string function(Function* fn) {
+		Mangler m;
+		m.out = "_Z";
+		m.tmpl = fn->_template;
+
+		std::string_view name = fn->templateName.empty() ? fn->decl.name : fn->templateName;
+
+		// Enclosing namespaces and classes, outermost first
+		std::vector<Scope*> prefixes;
+		for (Scope* scope = fn->body.getParent(); scope && !scope->isGlobal(); scope = scope->getParent()) {
+			if (!scope->isTemplate()) {
+				prefixes.insert(prefixes.begin(), scope);
+			}
+		}
+
+		if (!prefixes.empty()) {
+			m.out += 'N';
+			for (auto& i : prefixes) {
+				if (!m.substitute(i)) {
+					m.sourceName(i->getName());
+					m.substitutions.push_back(i);
+				}
+			}
+		}
+
+		m.sourceName(name);
+
+		if (!fn->templateName.empty()) {
+			m.substitutions.push_back(fn->templateName.data());
+			m.templateArgs(fn->templateArgs);
+		}
+
+		if (!prefixes.empty()) {
+			m.out += 'E';
+		}
+
+		// Only template instances encode their return type, and they encode every type as the template spelled it
+		if (m.tmpl) {
+			m.templateType(m.tmpl->returnType, fn->decl.returnType, false);
+		}
+
+		if (fn->decl.arguments.empty()) {
+			m.out += 'v';
+		}
+
+		for (size_t i = 0; i < fn->decl.arguments.size(); i++) {
+			CppType* arg = fn->decl.arguments[i]->type;
+
+			if (m.tmpl && i < m.tmpl->argumentTypes.size()) {
+				m.templateType(m.tmpl->argumentTypes[i], arg, true);
+			}
+			else {
+				m.type(topLevelUnqualified(arg));
+			}
+		}
+
+		return m.out;
+	}
+
+	// const on a parameter itself isn't part of the function's type
+	static CppType* topLevelUnqualified(CppType* t) {
+		CppTypeKey key = types().keyOf(t);
+
+		if (t->_isReference) {
+			return t;
+		}
+		else if (t->_pointerLayers) {
+			key.pointerLayerConstMask &= ~(uint64_t(1) << (t->_pointerLayers - 1));
+		}
+		else {
+			key.isConst = false;
+			key.isVolatile = false;
+		}
+
+		return types().get(key);
+	}
+};
+
+#endif // ifndef COMPILER_MANGLE_H
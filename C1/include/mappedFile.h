@@ -0,0 +1,152 @@
+#ifndef COMPILER_MAPPEDFILE_H
+#define COMPILER_MAPPEDFILE_H
+
+#include <string>
+#include <string_view>
+#include <fstream>
+#include <filesystem>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// A whole file mapped read-only into memory, so that its contents can be used in place without being copied
+// Falls back to reading the file into a buffer where it can't be mapped
+class MappedFile {
+	const char* _data = nullptr;
+	size_t _size = 0;
+
+	bool mapped = false;
+	std::string buffer;
+
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#endif
+
+	bool map(const std::string& path) {
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+			return false;
+		}
+
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!mapping) {
+			return false;
+		}
+
+		void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (!view) {
+			return false;
+		}
+
+		_data = static_cast<const char*>(view);
+		_size = (size_t)size.QuadPart;
+#else
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size == 0) {
+			::close(fd);
+			return false;
+		}
+
+		void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd); // The mapping keeps the file open
+
+		if (view == MAP_FAILED) {
+			return false;
+		}
+
+		_data = static_cast<const char*>(view);
+		_size = (size_t)info.st_size;
+#endif
+
+		mapped = true;
+		return true;
+	}
+
+	void unmap() {
+#ifdef _WIN32
+		if (mapped) {
+			UnmapViewOfFile(_data);
+		}
+		if (mapping) {
+			CloseHandle(mapping);
+			mapping = nullptr;
+		}
+		if (file != INVALID_HANDLE_VALUE) {
+			CloseHandle(file);
+			file = INVALID_HANDLE_VALUE;
+		}
+#else
+		if (mapped) {
+			munmap(const_cast<char*>(_data), _size);
+		}
+#endif
+
+		mapped = false;
+		_data = nullptr;
+		_size = 0;
+	}
+
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	~MappedFile() {
+		unmap();
+	}
+
+	// Returns whether the file could be opened
+	bool open(const std::string& path) {
+		unmap();
+
+		if (map(path)) {
+			return true;
+		}
+
+		unmap();
+
+		std::ifstream in(path, std::ios::binary);
+		if (!in) {
+			return false;
+		}
+
+		std::error_code err;
+		auto size = std::filesystem::file_size(path, err);
+		if (err) {
+			return false;
+		}
+
+		buffer.resize(size);
+		in.read(buffer.data(), buffer.size());
+
+		_data = buffer.data();
+		_size = buffer.size();
+		return true;
+	}
+
+	std::string_view bytes() const {
+		return { _data, _size };
+	}
+};
+
+#endif // ifndef COMPILER_MAPPEDFILE_H
@@ -0,0 +1,501 @@
+#ifndef COMPILER_MODULE_H
+#define COMPILER_MODULE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <span>
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <unordered_map>
+
+#include "function.h"
+#include "mappedFile.h"
+
+// Binary module interface (.c1m), written for an export module unit and mapped in place by each unit that imports it
+// Records are fixed size and refer to each other by index and to names by their place in the string table,
+// so an importer only has to check bounds before using them
+
+constexpr char MODULE_MAGIC[4] = { 'C', '1', 'M', '\x1A' };
+constexpr uint32_t MODULE_VERSION = 1;
+
+struct ModuleStr {
+	uint32_t offset;
+	uint32_t size;
+};
+
+struct ModuleSection {
+	uint32_t offset; // Bytes from the start of the file
+	uint32_t count; // Records, or bytes for the string table
+};
+
+struct ModuleHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t dataModel; // Index into DATA_MODELS, since type widths depend on it
+	uint32_t reserved;
+
+	ModuleStr name;
+
+	ModuleSection strings;
+	ModuleSection types;
+	ModuleSection classes;
+	ModuleSection fields;
+	ModuleSection scopes;
+	ModuleSection functions;
+	ModuleSection params;
+};
+
+// A canonical type, by the same parts as its CppTypeKey
+struct ModuleType {
+	enum Flags : uint32_t {
+		CONST = 1,
+		VOLATILE = 2,
+		REFERENCE = 4
+	};
+
+	ModuleStr coreName;
+	uint64_t pointerLayerConstMask;
+	uint32_t pointerLayers;
+	uint32_t flags;
+};
+
+// Classes come after the classes they contain by value
+struct ModuleClass {
+	ModuleStr name;
+	uint32_t fieldBegin;
+	uint32_t fieldCount;
+	uint32_t complete;
+};
+
+struct ModuleField {
+	ModuleStr name;
+	uint32_t type;
+};
+
+// Scope 0 is the global scope, every other one comes after its parent
+struct ModuleScope {
+	ModuleStr name;
+	uint32_t parent;
+	uint32_t kind; // Scope::Type
+};
+
+struct ModuleFunction {
+	ModuleStr name;
+	ModuleStr symbol; // Already mangled
+	uint32_t scope;
+	uint32_t returnType;
+	uint32_t paramBegin;
+	uint32_t paramCount;
+};
+
+struct ModuleParam {
+	ModuleStr name;
+	uint32_t type;
+};
+
+inline uint32_t dataModelIndex() {
+	return (uint32_t)currentDataModelId();
+}
+
+// Collects what a module interface unit exports and writes it out as a .c1m
+class ModuleWriter {
+	std::string strings;
+	std::unordered_map<std::string_view, ModuleStr> stringRefs;
+
+	std::vector<ModuleType> typeRecords;
+	std::unordered_map<CppType*, uint32_t> typeIndex;
+
+	std::vector<ModuleClass> classRecords;
+	std::unordered_map<const ClassLayout*, uint32_t> classIndex;
+	std::vector<ModuleField> fieldRecords;
+
+	std::vector<ModuleScope> scopeRecords;
+	std::unordered_map<Scope*, uint32_t> scopeIndex;
+
+	std::vector<ModuleFunction> functionRecords;
+	std::vector<ModuleParam> paramRecords;
+
+	ModuleStr str(std::string_view name) {
+		auto itr = stringRefs.find(name);
+		if (itr != stringRefs.end()) {
+			return itr->second;
+		}
+
+		ModuleStr ref{ (uint32_t)strings.size(), (uint32_t)name.size() };
+		strings += name;
+		stringRefs.emplace(name, ref);
+		return ref;
+	}
+
+	uint32_t type(CppType* t) {
+		auto itr = typeIndex.find(t);
+		if (itr != typeIndex.end()) {
+			return itr->second;
+		}
+
+		// Pointers to a class need it declared, so it goes in too
+		if (ClassLayout* layout = t->layout()) {
+			addClass(layout);
+		}
+
+		CppTypeKey key = types().keyOf(t);
+
+		ModuleType record{};
+		record.coreName = str(t->_coreName);
+		record.pointerLayerConstMask = key.pointerLayerConstMask;
+		record.pointerLayers = (uint32_t)key.pointerLayers;
+		record.flags = 0;
+		if (key.isConst) {
+			record.flags |= ModuleType::CONST;
+		}
+		if (key.isVolatile) {
+			record.flags |= ModuleType::VOLATILE;
+		}
+		if (key.isReference) {
+			record.flags |= ModuleType::REFERENCE;
+		}
+
+		uint32_t index = (uint32_t)typeRecords.size();
+		typeRecords.push_back(record);
+		typeIndex.emplace(t, index);
+		return index;
+	}
+
+	void addClass(const ClassLayout* layout) {
+		if (classIndex.contains(layout)) {
+			return;
+		}
+
+		// Claimed before the members are visited, so a class that points to itself isn't added twice
+		classIndex.emplace(layout, UINT32_MAX);
+
+		std::vector<ModuleField> fields;
+		for (auto& field : layout->fields) {
+			fields.push_back({ str(field.name), type(field.type) });
+		}
+
+		ModuleClass record{ str(layout->name), (uint32_t)fieldRecords.size(), (uint32_t)fields.size(), layout->complete };
+		fieldRecords.insert(fieldRecords.end(), fields.begin(), fields.end());
+
+		classIndex[layout] = (uint32_t)classRecords.size();
+		classRecords.push_back(record);
+	}
+
+	uint32_t scope(Scope* s) {
+		// Template scopes only bind parameters, they aren't part of any name
+		while (s->isTemplate()) {
+			s = s->getParent();
+		}
+
+		auto itr = scopeIndex.find(s);
+		if (itr != scopeIndex.end()) {
+			return itr->second;
+		}
+
+		ModuleScope record{ str(s->getName()), 0, (uint32_t)s->getType() };
+		if (!s->isGlobal()) {
+			record.parent = scope(s->getParent());
+		}
+
+		uint32_t index = (uint32_t)scopeRecords.size();
+		scopeRecords.push_back(record);
+		scopeIndex.emplace(s, index);
+		return index;
+	}
+
+	void addFunction(Function* fn) {
+		ModuleFunction record{};
+		record.name = str(fn->decl.name);
+		record.symbol = str(fn->mangleName());
+		record.scope = scope(fn->body.getParent());
+		record.returnType = type(fn->decl.returnType);
+
+		std::vector<ModuleParam> params;
+		for (auto& arg : fn->decl.arguments) {
+			params.push_back({ str(arg->name), type(arg->type) });
+		}
+
+		record.paramBegin = (uint32_t)paramRecords.size();
+		record.paramCount = (uint32_t)params.size();
+		paramRecords.insert(paramRecords.end(), params.begin(), params.end());
+
+		functionRecords.push_back(record);
+	}
+
+	template <typename T>
+	static ModuleSection append(std::string& out, const std::vector<T>& records) {
+		out.resize((out.size() + alignof(uint64_t) - 1) / alignof(uint64_t) * alignof(uint64_t), '\0');
+
+		ModuleSection section{ (uint32_t)out.size(), (uint32_t)records.size() };
+		out.append(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(T));
+		return section;
+	}
+
+public:
+	// Collects every function and class declared with export, and whatever their types refer to
+	void addExports(Scope* global) {
+		scope(global);
+
+		for (auto& fn : global->getFunctions()) {
+			if (fn->_moduleExport) {
+				addFunction(fn);
+			}
+		}
+
+		for (auto& layout : types().getClasses()) {
+			if (layout.exported) {
+				addClass(&layout);
+			}
+		}
+	}
+
+	bool write(const std::string& path, std::string_view moduleName) {
+		ModuleHeader header{};
+		std::memcpy(header.magic, MODULE_MAGIC, sizeof(MODULE_MAGIC));
+		header.version = MODULE_VERSION;
+		header.dataModel = dataModelIndex();
+		header.name = str(moduleName);
+
+		std::string out(sizeof(ModuleHeader), '\0');
+
+		header.types = append(out, typeRecords);
+		header.classes = append(out, classRecords);
+		header.fields = append(out, fieldRecords);
+		header.scopes = append(out, scopeRecords);
+		header.functions = append(out, functionRecords);
+		header.params = append(out, paramRecords);
+
+		header.strings = { (uint32_t)out.size(), (uint32_t)strings.size() };
+		out += strings;
+
+		std::memcpy(out.data(), &header, sizeof(header));
+
+		std::ofstream file(path, std::ios::binary);
+		file.write(out.data(), out.size());
+		return (bool)file;
+	}
+};
+
+// A module interface mapped into memory
+// Declarations made from it refer to its names in place, so it must stay open for the rest of the compile
+class ModuleFile {
+	MappedFile file;
+	std::string path;
+
+	const ModuleHeader* header = nullptr;
+	std::string_view strings;
+
+	std::span<const ModuleType> typeRecords;
+	std::span<const ModuleClass> classRecords;
+	std::span<const ModuleField> fieldRecords;
+	std::span<const ModuleScope> scopeRecords;
+	std::span<const ModuleFunction> functionRecords;
+	std::span<const ModuleParam> paramRecords;
+
+	// Types are only looked up once something uses them
+	std::vector<CppType*> typeCache;
+
+	[[noreturn]] void invalid() {
+		throw SourceError(DiagId::INVALID_MODULE, path);
+	}
+
+	template <typename T>
+	std::span<const T> section(const ModuleSection& sec) {
+		std::string_view bytes = file.bytes();
+
+		if (sec.offset % alignof(T) || sec.offset > bytes.size() || sec.count > (bytes.size() - sec.offset) / sizeof(T)) {
+			invalid();
+		}
+
+		return { reinterpret_cast<const T*>(bytes.data() + sec.offset), sec.count };
+	}
+
+	std::string_view str(ModuleStr ref) {
+		if (ref.offset > strings.size() || ref.size > strings.size() - ref.offset) {
+			invalid();
+		}
+
+		return strings.substr(ref.offset, ref.size);
+	}
+
+	CppType* type(uint32_t index) {
+		if (index >= typeCache.size()) {
+			invalid();
+		}
+
+		CppType*& slot = typeCache[index];
+
+		if (!slot) {
+			const ModuleType& record = typeRecords[index];
+
+			// The const mask has a bit for each pointer layer and no more, and every flag is one this version knows
+			constexpr uint32_t knownFlags = ModuleType::CONST | ModuleType::VOLATILE | ModuleType::REFERENCE;
+			if (record.pointerLayers > 63 || (record.pointerLayerConstMask >> record.pointerLayers) || (record.flags & ~knownFlags)) {
+				invalid();
+			}
+
+			CppTypeKey key;
+			key.coreName = str(record.coreName);
+			key.pointerLayerConstMask = record.pointerLayerConstMask;
+			key.pointerLayers = (int)record.pointerLayers;
+			key.isConst = record.flags & ModuleType::CONST;
+			key.isVolatile = record.flags & ModuleType::VOLATILE;
+			key.isReference = record.flags & ModuleType::REFERENCE;
+
+			slot = types().get(key);
+		}
+
+		return slot;
+	}
+
+	void importClasses() {
+		// Every class is declared before any is laid out, since members may point to classes that come later
+		std::vector<ClassLayout*> layouts;
+		for (auto& record : classRecords) {
+			layouts.push_back(types().declareClass(str(record.name)));
+		}
+
+		for (size_t i = 0; i < classRecords.size(); i++) {
+			const ModuleClass& record = classRecords[i];
+
+			// Another module may have brought in the same class already
+			if (!record.complete || layouts[i]->complete) {
+				continue;
+			}
+
+			if (record.fieldBegin > fieldRecords.size() || record.fieldCount > fieldRecords.size() - record.fieldBegin) {
+				invalid();
+			}
+
+			std::vector<std::pair<std::string_view, CppType*>> members;
+			for (auto& field : fieldRecords.subspan(record.fieldBegin, record.fieldCount)) {
+				members.push_back({ str(field.name), type(field.type) });
+			}
+
+			types().completeClass(layouts[i], members);
+		}
+	}
+
+	std::vector<Scope*> importScopes(Scope* global) {
+		std::vector<Scope*> scopes;
+
+		for (size_t i = 0; i < scopeRecords.size(); i++) {
+			const ModuleScope& record = scopeRecords[i];
+
+			if (i == 0) {
+				scopes.push_back(global);
+				continue;
+			}
+
+			if (record.parent >= i) {
+				invalid();
+			}
+
+			Scope* parent = scopes[record.parent];
+			std::string_view name = str(record.name);
+
+			// Reuse a namespace that is already declared
+			Declaration* existing = parent->lookup(name);
+			Scope** existingScope = existing ? std::get_if<Scope*>(&existing->data) : nullptr;
+
+			if (existingScope && (*existingScope)->getParent() == parent) {
+				scopes.push_back(*existingScope);
+				continue;
+			}
+
+			Scope* made = new Scope(name, record.kind == (uint32_t)Scope::Type::CLASS ? Scope::Type::CLASS : Scope::Type::NAMESPACE, parent);
+			parent->addChildScope(made);
+			parent->addDeclaration(Declaration{ name, made });
+			scopes.push_back(made);
+		}
+
+		return scopes;
+	}
+
+public:
+	// Maps the file and checks its header, throwing if it isn't a module interface this compile can use
+	// Returns false if the file doesn't exist
+	bool open(const std::string& path_) {
+		path = path_;
+
+		if (!file.open(path)) {
+			return false;
+		}
+
+		std::string_view bytes = file.bytes();
+		if (bytes.size() < sizeof(ModuleHeader)) {
+			invalid();
+		}
+
+		header = reinterpret_cast<const ModuleHeader*>(bytes.data());
+
+		if (std::memcmp(header->magic, MODULE_MAGIC, sizeof(MODULE_MAGIC)) || header->version != MODULE_VERSION) {
+			invalid();
+		}
+
+		if (header->dataModel != dataModelIndex()) {
+			throw SourceError(DiagId::MODULE_DATA_MODEL_MISMATCH, path);
+		}
+
+		std::span<const char> stringBytes = section<char>(header->strings);
+		strings = { stringBytes.data(), stringBytes.size() };
+
+		typeRecords = section<ModuleType>(header->types);
+		classRecords = section<ModuleClass>(header->classes);
+		fieldRecords = section<ModuleField>(header->fields);
+		scopeRecords = section<ModuleScope>(header->scopes);
+		functionRecords = section<ModuleFunction>(header->functions);
+		paramRecords = section<ModuleParam>(header->params);
+
+		typeCache.assign(typeRecords.size(), nullptr);
+		return true;
+	}
+
+	std::string_view name() {
+		return str(header->name);
+	}
+
+	// Declares everything the module exports, returning the functions so they can be emitted as declarations
+	std::vector<Function*> importInto(Scope* global) {
+		importClasses();
+		std::vector<Scope*> scopes = importScopes(global);
+
+		std::vector<Function*> imported;
+
+		for (auto& record : functionRecords) {
+			if (record.scope >= scopes.size()) {
+				invalid();
+			}
+
+			Scope* scope = scopes[record.scope];
+
+			if (record.paramBegin > paramRecords.size() || record.paramCount > paramRecords.size() - record.paramBegin) {
+				invalid();
+			}
+
+			Function* fn = new Function(scope);
+			fn->decl.name = str(record.name);
+			fn->decl.returnType = type(record.returnType);
+			fn->_mangledName = str(record.symbol);
+
+			for (auto& param : paramRecords.subspan(record.paramBegin, record.paramCount)) {
+				fn->decl.arguments.push_back(new FunctionArgument{ str(param.name), type(param.type), nullptr });
+			}
+
+			scope->addFunction(fn);
+
+			// Only the global scope's functions are emitted
+			if (scope != global) {
+				global->addInstantiation(fn);
+			}
+
+			imported.push_back(fn);
+		}
+
+		return imported;
+	}
+};
+
+#endif // ifndef COMPILER_MODULE_H
@@ -0,0 +1,193 @@
+#ifndef COMPILER_OUTPUTBUFFER_H
+#define COMPILER_OUTPUTBUFFER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <charconv>
+#include <cstring>
+#include <ostream>
+#include <type_traits>
+#include <algorithm>
+
+// Append-only text made of separately allocated chunks, so growing it never moves what was already written
+// Buffers are joined by handing over their chunks, and written out chunk by chunk, so text is never copied between them
+class OutputBuffer {
+	constexpr static size_t MIN_CHUNK_SIZE = 1024;
+	constexpr static size_t MAX_CHUNK_SIZE = 64 * 1024;
+
+	// Enough for any integer or floating point number to_chars writes
+	constexpr static size_t MAX_NUMBER_SIZE = 32;
+
+	constexpr static std::string_view TABS = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+
+	struct Chunk {
+		std::unique_ptr<char[]> data;
+		size_t used;
+		size_t capacity;
+	};
+
+	std::vector<Chunk> chunks;
+
+	// Free space in the last chunk
+	char* cursor = nullptr;
+	char* end = nullptr;
+
+	// Records how much of the last chunk has been written
+	void settle() {
+		if (!chunks.empty()) {
+			chunks.back().used = cursor - chunks.back().data.get();
+		}
+	}
+
+	// Starts a new chunk with room for at least size bytes, each one twice as big as the last up to MAX_CHUNK_SIZE
+	void grow(size_t size) {
+		settle();
+
+		size_t capacity = chunks.empty() ? MIN_CHUNK_SIZE : std::min(chunks.back().capacity * 2, MAX_CHUNK_SIZE);
+		capacity = std::max(capacity, size);
+
+		Chunk& chunk = chunks.emplace_back(Chunk{ std::make_unique<char[]>(capacity), 0, capacity });
+		cursor = chunk.data.get();
+		end = cursor + capacity;
+	}
+
+	char* reserve(size_t size) {
+		if ((size_t)(end - cursor) < size) {
+			grow(size);
+		}
+		return cursor;
+	}
+
+public:
+	OutputBuffer() = default;
+	OutputBuffer(OutputBuffer&&) = default;
+	OutputBuffer& operator=(OutputBuffer&&) = default;
+
+	void append(std::string_view str) {
+		std::memcpy(reserve(str.size()), str.data(), str.size());
+		cursor += str.size();
+	}
+
+	void append(char c) {
+		*reserve(1) = c;
+		cursor++;
+	}
+
+	template <typename T>
+	void appendNumber(T val) {
+		char* begin = reserve(MAX_NUMBER_SIZE);
+		cursor = std::to_chars(begin, end, val).ptr;
+	}
+
+	// Writes level tabs
+	void indent(int level) {
+		while (level > 0) {
+			size_t count = std::min((size_t)level, TABS.size());
+			append(TABS.substr(0, count));
+			level -= (int)count;
+		}
+	}
+
+	// Moves everything written to other onto the end of this buffer, leaving other empty
+	void splice(OutputBuffer&& other) {
+		if (other.chunks.empty()) {
+			return;
+		}
+
+		settle();
+		other.settle();
+
+		for (auto& i : other.chunks) {
+			chunks.push_back(std::move(i));
+		}
+
+		// Carry on writing into the space left in other's last chunk
+		Chunk& last = chunks.back();
+		cursor = last.data.get() + last.used;
+		end = last.data.get() + last.capacity;
+
+		other.chunks.clear();
+		other.cursor = nullptr;
+		other.end = nullptr;
+	}
+
+	size_t size() {
+		settle();
+
+		size_t total = 0;
+		for (auto& i : chunks) {
+			total += i.used;
+		}
+		return total;
+	}
+
+	template <typename FuncT>
+	void forEachChunk(FuncT&& func) {
+		settle();
+
+		for (auto& i : chunks) {
+			func(std::string_view(i.data.get(), i.used));
+		}
+	}
+
+	void writeTo(std::ostream& out) {
+		settle();
+
+		for (auto& i : chunks) {
+			out.write(i.data.get(), i.used);
+		}
+	}
+
+	std::string str() {
+		settle();
+
+		std::string out;
+		out.reserve(size());
+		for (auto& i : chunks) {
+			out.append(i.data.get(), i.used);
+		}
+		return out;
+	}
+
+	void clear() {
+		chunks.clear();
+		cursor = nullptr;
+		end = nullptr;
+	}
+
+	OutputBuffer& operator<<(std::string_view str) {
+		append(str);
+		return *this;
+	}
+
+	OutputBuffer& operator<<(const std::string& str) {
+		append(std::string_view(str));
+		return *this;
+	}
+
+	OutputBuffer& operator<<(const char* str) {
+		append(std::string_view(str));
+		return *this;
+	}
+
+	OutputBuffer& operator<<(char c) {
+		append(c);
+		return *this;
+	}
+
+	// Like a stream, bools are written as 0 or 1
+	template <typename T> requires (std::is_arithmetic_v<T> && !std::is_same_v<T, char>)
+	OutputBuffer& operator<<(T val) {
+		if constexpr (std::is_same_v<T, bool>) {
+			append(val ? '1' : '0');
+		}
+		else {
+			appendNumber(val);
+		}
+		return *this;
+	}
+};
+
+#endif // ifndef COMPILER_OUTPUTBUFFER_H
@@ -0,0 +1,189 @@
+#ifndef COMPILER_OUTPUTSINK_H
+#define COMPILER_OUTPUTSINK_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdio>
+#include <iostream>
+#include <algorithm>
+#include <climits>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#include "outputBuffer.h"
+
+// Writes finished output straight to a file descriptor
+// Buffers handed to it are collected without copying and written together once there is enough for one large write
+class OutputSink {
+	constexpr static size_t BATCH_SIZE = 256 * 1024;
+
+#ifdef _WIN32
+	constexpr static size_t MAX_IOV = 1;
+#elif defined(IOV_MAX)
+	constexpr static size_t MAX_IOV = IOV_MAX;
+#else
+	constexpr static size_t MAX_IOV = 1024;
+#endif
+
+	int fd = -1;
+	bool ownsFd = false;
+	bool failed = false;
+
+	OutputBuffer pending;
+	size_t pendingSize = 0;
+
+	// Writes every byte of each piece, continuing after partial writes
+	void writePieces(std::vector<std::string_view>& pieces) {
+#ifdef _WIN32
+		for (auto& i : pieces) {
+			while (!i.empty() && !failed) {
+				int written = _write(fd, i.data(), (unsigned)std::min<size_t>(i.size(), INT_MAX));
+				if (written < 0) {
+					failed = true;
+					break;
+				}
+				i.remove_prefix(written);
+			}
+		}
+#else
+		std::vector<iovec> iov;
+		size_t first = 0;
+
+		while (first < pieces.size() && !failed) {
+			iov.clear();
+			for (size_t i = first; i < pieces.size() && iov.size() < MAX_IOV; i++) {
+				iov.push_back({ const_cast<char*>(pieces[i].data()), pieces[i].size() });
+			}
+
+			ssize_t written = ::writev(fd, iov.data(), (int)iov.size());
+			if (written < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				failed = true;
+				break;
+			}
+
+			// Skip past whatever was written, which may end partway through a piece
+			while (first < pieces.size() && (size_t)written >= pieces[first].size()) {
+				written -= pieces[first].size();
+				first++;
+			}
+			if (first < pieces.size()) {
+				pieces[first].remove_prefix(written);
+			}
+		}
+#endif
+	}
+
+public:
+	OutputSink() = default;
+	OutputSink(const OutputSink&) = delete;
+
+	~OutputSink() {
+		close();
+	}
+
+	// An empty name writes to stdout
+	bool open(std::string_view name) {
+		close();
+		failed = false;
+
+		if (name.empty()) {
+			// Anything already printed through the stream has to come first
+			std::cout.flush();
+			fd = 1;
+			ownsFd = false;
+			return true;
+		}
+
+#ifdef _WIN32
+		fd = _open(std::string(name).c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+		fd = ::open(std::string(name).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+		ownsFd = fd >= 0;
+		return fd >= 0;
+	}
+
+	// Writes to a descriptor someone else opened and closes, like a pipe
+	void attach(int fd_) {
+		close();
+		failed = false;
+
+		fd = fd_;
+		ownsFd = false;
+	}
+
+	// Keeps everything written in memory until it is taken back with release
+	void openMemory() {
+		close();
+		failed = false;
+	}
+
+	OutputBuffer release() {
+		OutputBuffer out = std::move(pending);
+		pending.clear();
+		pendingSize = 0;
+		return out;
+	}
+
+	// Takes over buffer's contents, writing once enough has built up
+	void write(OutputBuffer&& buffer) {
+		pendingSize += buffer.size();
+		pending.splice(std::move(buffer));
+
+		if (pendingSize >= BATCH_SIZE) {
+			flush();
+		}
+	}
+
+	void flush() {
+		if (fd < 0 || pendingSize == 0) {
+			return;
+		}
+
+		std::vector<std::string_view> pieces;
+		pending.forEachChunk([&](std::string_view chunk) {
+			if (!chunk.empty()) {
+				pieces.push_back(chunk);
+			}
+		});
+
+		writePieces(pieces);
+
+		pending.clear();
+		pendingSize = 0;
+	}
+
+	void close() {
+		flush();
+
+		if (ownsFd) {
+#ifdef _WIN32
+			_close(fd);
+#else
+			::close(fd);
+#endif
+		}
+
+		fd = -1;
+		ownsFd = false;
+	}
+
+	// Whether any write has failed since the sink was opened
+	bool hasFailed() const {
+		return failed;
+	}
+};
+
+#endif // ifndef COMPILER_OUTPUTSINK_H
@@ -6,7 +6,9 @@
 #include <functional>
 #include <algorithm>
 #include <charconv>
+#include <cctype>
 #include <string>
+#include <optional>
 
 #include "util.h"
 #include "token.h"
@@ -14,6 +16,7 @@
 #include "scanner.h"
 #include "expression.h"
 #include "flowControl.h"
+#include "template.h"
 
 struct Parser {
 	Scanner scanner;
@@ -24,15 +27,43 @@ struct Parser {
 	// If a function sets this flag, it made it too far into parsing before reaching an error, the code is wrong
 	bool forceFail = false;
 
+	// Called with every function as soon as it has been completely parsed
+	std::function<void(Function*)> onFunctionParsed;
+
+	// Called for each import declaration, throws if the module can't be imported
+	std::function<void(std::string_view)> onImport;
+
+	// Name from export module, if this is a module interface unit
+	std::string_view moduleName;
+
+	// Where string literals are kept
+	ConstantPool* constants = nullptr;
+
+	// Set while parsing a declaration that follows export
+	bool exporting = false;
+
+	// The furthest identifier that no expression could be made from, which may only have been tried speculatively
+	std::string_view unresolved;
+
+	// The furthest call that couldn't be resolved, which the speculation around it may have rolled back too
+	std::optional<SourceError> failedCall;
+
 	Parser(std::string_view _code, std::string_view _file) : scanner(_code, _file) {}
 
 	void parse(Scope* scope, bool captureSingleStatement = false) {
 		scopes.push_back(scope);
+		auto frame = scope->enter();
+
+		const char* statementBegin = scanner.peek().first.str.data();
 
 		while (true) {
 			forceFail = false;
 			auto next = scanner.peek().first.str;
 
+			// The statement before this one was committed, so a name in it that never resolved is an error
+			reportUnresolved(statementBegin, next.data());
+			statementBegin = next.data();
+
 			if (next == "" || next == "}") {
 				// End scope
 				break;
@@ -43,7 +74,7 @@ struct Parser {
 			}
 			else if (next == "{") {
 				// Enter a block scope
-				Scope* nextScope = new Scope("child", Scope::Type::FUNCTION, scope);
+				Scope* nextScope = makeNode<Scope>("child", Scope::Type::FUNCTION, scope);
 
 				matchToken("{");
 
@@ -52,9 +83,12 @@ struct Parser {
 				matchToken("}");
 
 				scope->addChildScope(nextScope);
-				scope->addExpression(new ChildScope(nextScope));
+				scope->addExpression(makeNode<ChildScope>(nextScope));
 			}
 
+			else if (parseModuleDeclaration(scope)) { continue; }
+			else if (parseTemplate(scope)) { continue; }
+			else if (parseClass(scope)) { continue; }
 			else if (parseDeclaration(scope)) { continue; }
 			else if (parseFunction(scope)) { continue; }
 			else if (parseReturn(scope)) { continue; }
@@ -63,12 +97,16 @@ struct Parser {
 
 			else {
 				if (forceFail) {
-					std::cout << "Compile failed.\n";
+					reportFailedCall(next.data(), nullptr);
+					diagnostics().report(DiagId::COMPILE_FAILED, next.data());
+					diagnostics().flush(std::cerr, true);
 					std::exit(-1);
 				}
 
-				// Give up and consume this unknown token
-				std::cout << "Unknown token " << next << '\n';
+				// Give up and consume this unknown token, unless a name it couldn't resolve is the likelier reason
+				if (!reportUnresolved(next.data(), nullptr)) {
+					diagnostics().report(DiagId::UNKNOWN_TOKEN, next.data(), { next });
+				}
 				scanToken();
 				break;
 			}
@@ -81,6 +119,43 @@ struct Parser {
 		scopes.pop_back();
 	}
 
+	// Reports the furthest failed call as an error if it is at or after begin and before end, if there is an end
+	// Its report from parseFunctionCall may have been rolled back with a speculation around the call
+	bool reportFailedCall(const char* begin, const char* end) {
+		const char* at = failedCall ? failedCall->position() : nullptr;
+		if (!at || at < begin || (end && at >= end)) {
+			return false;
+		}
+
+		if (!failedCall->isReported()) {
+			failedCall->report();
+		}
+		return true;
+	}
+
+	// Reports the failed call or else the unresolved name as an error if it is at or after begin and before end, if there is an end
+	// The report is outside of any speculation, so unlike the note from the lookup it isn't rolled back
+	bool reportUnresolved(const char* begin, const char* end) {
+		if (reportFailedCall(begin, end)) {
+			return true;
+		}
+
+		const char* at = unresolved.data();
+		if (!at || at < begin || (end && at >= end)) {
+			return false;
+		}
+
+		diagnostics().report(DiagId::UNRESOLVED_NAME, at, { unresolved });
+		unresolved = {};
+		return true;
+	}
+
+	void functionParsed(Function* fn) {
+		if (onFunctionParsed) {
+			onFunctionParsed(fn);
+		}
+	}
+
 	void scanToken() {
 		auto next = scanner.peek();
 		auto tok = next.first;
@@ -106,11 +181,11 @@ struct Parser {
 			return;
 		}
 
-		// Try to see if its an integer
+		// Try to see if its an integer or a string
 		const char* r = str.data();
 		auto val = LiteralParser::parseLiteral(r, str.data() + str.size());
 		if (!std::get_if<LiteralContainerEmpty>(&val)) {
-			currentTok.type = TokenType::INTEGER_LITERAL;
+			currentTok.type = std::get_if<std::string>(&val) ? TokenType::STRING_LITERAL : TokenType::INTEGER_LITERAL;
 			currentTok.value = val;
 			scanner.readCursor = next.second;
 			return;
@@ -136,10 +211,13 @@ struct Parser {
 
 	Expression* parseLeftExpression(Scope* scope) {
 		if (currentTok.type == TokenType::INTEGER_LITERAL) {
-			return new IntegerLiteral((int)*std::get_if<int64_t>(&currentTok.value));
+			return makeNode<IntegerLiteral>((int)*std::get_if<int64_t>(&currentTok.value));
 		}
 		else if (currentTok.type == TokenType::BOOL_LITERAL) {
-			return new IntegerLiteral((int)*std::get_if<int64_t>(&currentTok.value));
+			return makeNode<IntegerLiteral>((int)*std::get_if<int64_t>(&currentTok.value));
+		}
+		else if (currentTok.type == TokenType::STRING_LITERAL) {
+			return makeNode<StringLiteral>(&constants->intern(*std::get_if<std::string>(&currentTok.value)));
 		}
 		else if (Expression* exp = parseCast(scope)) {
 			return exp;
@@ -152,10 +230,10 @@ struct Parser {
 		}
 
 		else if (currentTok.str == "+") {
-			return new UnaryAdd(parseExpression(scope));
+			return makeNode<UnaryAdd>(parseOperand(scope));
 		}
 		else if (currentTok.str == "-") {
-			return new UnarySub(parseExpression(scope));
+			return makeNode<UnarySub>(parseOperand(scope));
 		}
 
 		else if (currentTok.str == "*") {
@@ -163,17 +241,21 @@ struct Parser {
 			if (!exp) {
 				return nullptr;
 			}
-			return new Dereference(exp);
+			return makeNode<Dereference>(exp);
 		}
 		else if (currentTok.str == "&") {
-
+			Expression* exp = parseExpression(scope, OPERATOR_TRAITS[(int)Operator::ADDRESS_OF].precedence);
+			if (!exp) {
+				return nullptr;
+			}
+			return makeNode<AddressOf>(exp);
 		}
 		
 		else if (currentTok.str == "!") {
 
 		}
 		else if (currentTok.str == "~") {
-			return new BitwiseNot(parseExpression(scope));
+			return makeNode<BitwiseNot>(parseOperand(scope));
 		}
 
 		else if (currentTok.str == "++") {
@@ -189,9 +271,26 @@ struct Parser {
 			return exp;
 		}
 
+		if (currentTok.type == TokenType::IDENTIFIER && currentTok.str.data() > unresolved.data() &&
+			!isAnyOf(currentTok.str, std::begin(KEYWORDS_STR), std::end(KEYWORDS_STR))) {
+			unresolved = currentTok.str;
+		}
+
 		return nullptr;
 	}
 
+	// The operand of a prefix operator, which the operator can't be built without
+	Expression* parseOperand(Scope* scope) {
+		std::string_view op = currentTok.str;
+
+		Expression* exp = parseExpression(scope);
+		if (!exp) {
+			throw SourceError(DiagId::EXPECTED_OPERAND, op).at(op.data());
+		}
+
+		return exp;
+	}
+
 	Expression* parseVariableRef(Scope* scope) {
 		try {
 			auto vScan = scanner.startVirtualScan();
@@ -201,7 +300,7 @@ struct Parser {
 			if (!res) { return nullptr; }
 
 			if (VariableDeclaration** var = std::get_if<VariableDeclaration*>(&res->data)) {
-				auto ref = new VariableRef(*var);
+				auto ref = makeNode<VariableRef>(*var);
 
 				vScan.keep();
 				return ref;
@@ -232,17 +331,34 @@ struct Parser {
 				Expression* size = parseExpression(scope);
 				matchToken(")");
 
-				auto call = new StackAlloc(size);
+				auto call = makeNode<StackAlloc>(size);
 
 				vScan.keep();
 				return call;
 			}
 			else if (name == "sizeof") {
 				matchToken("(");
-				Expression* size = parseExpression(scope);
-				matchToken(")");
 
-				Expression* exp = new IntegerLiteral(size->getResultType()->width() / 8);
+				CppType* type = nullptr;
+
+				// sizeof(type), or failing that sizeof(expression)
+				try {
+					auto typeScan = scanner.startVirtualScan();
+					type = resolveType(scope, consumeType());
+					matchToken(")");
+					typeScan.keep();
+				}
+				catch (...) {
+					type = nullptr;
+				}
+
+				if (!type) {
+					Expression* size = parseExpression(scope);
+					matchToken(")");
+					type = size->getResultType();
+				}
+
+				Expression* exp = makeNode<IntegerLiteral>(type->size());
 
 				vScan.keep();
 				return exp;
@@ -252,14 +368,57 @@ struct Parser {
 				return nullptr;
 			}
 
-			if (Function** fn = std::get_if<Function*>(&res->data)) {
-				auto call = new FunctionCall(*fn);
+			if (OverloadSet** set = std::get_if<OverloadSet*>(&res->data)) {
+				std::vector<Expression*> args = consumeCallArguments(scope);
+
+				std::vector<CppType*> argTypes;
+				for (auto& i : args) {
+					argTypes.push_back(i->getResultType());
+				}
+
+				Function* fn = nullptr;
+				try {
+					fn = (*set)->resolve(argTypes);
+				}
+				catch (SourceError& err) {
+					throw err.at(currentTok.str.data());
+				}
 
-				call->arguments = consumeFunctionPassedParameters(*fn);
+				auto call = makeNode<FunctionCall>(fn);
+				call->_where = name.data();
+
+				call->arguments = convertCallArguments(fn, args);
 
 				vScan.keep();
 				return call;
 			}
+			else if (Template** tmpl = std::get_if<Template*>(&res->data)) {
+				std::vector<CppType*> templateArgs = consumeTemplateArguments(scope);
+				std::vector<Expression*> args = consumeCallArguments(scope);
+
+				try {
+					deduceTemplateArguments(*tmpl, templateArgs, args);
+				}
+				catch (SourceError& err) {
+					throw err.at(name.data());
+				}
+
+				Function* instance = instantiate(*tmpl, templateArgs);
+				auto call = makeNode<FunctionCall>(instance);
+				call->_where = name.data();
+
+				call->arguments = convertCallArguments(instance, args);
+
+				vScan.keep();
+				return call;
+			}
+		}
+		catch (const SourceError& err) {
+			err.report();
+
+			if (!failedCall || err.position() > failedCall->position()) {
+				failedCall = err;
+			}
 		}
 		catch (...) {}
 
@@ -274,25 +433,25 @@ struct Parser {
 				// (type)exp
 
 				auto typeStr = consumeType();
-				auto type = strToType(typeStr);
+				auto type = resolveType(scope, typeStr);
 
 				matchToken(")");
 
 				auto exp = parseExpression(scope);
 
 				vScan.keep();
-				return new Cast(exp, type);
+				return makeNode<Cast>(exp, type);
 			}
 			else {
 				// type(exp)
 
 				auto typeStr = currentTok.str;
-				auto type = strToType(typeStr);
+				auto type = resolveType(scope, typeStr);
 
 				auto exp = parseExpression(scope);
 
 				vScan.keep();
-				return new Cast(exp, type);
+				return makeNode<Cast>(exp, type);
 			}
 
 		}
@@ -307,12 +466,15 @@ struct Parser {
 			return nullptr;
 		}
 		else if (next.str == ";") {
-			return new EmptyExpression;
+			return makeNode<EmptyExpression>();
 		}
 
 		scanToken();
 
 		Expression* left = parseLeftExpression(scope);
+		if (left) {
+			left = parseMemberAccess(scope, left);
+		}
 
 		next = scanner.peek().first;
 		if ((next.str == ")" || next.str == ";") && left) {
@@ -356,7 +518,7 @@ struct Parser {
 			left = makeBinaryExp(parent.str, left, right);
 
 			next = scanner.peek().first;
-			if (next.str == ")" || next.str == ";" || next.str == "") {
+			if (next.str == ")" || next.str == ";" || next.str == "" || next.str == ",") {
 				virt.keep();
 				return left;
 			}
@@ -368,7 +530,7 @@ struct Parser {
 			TokenType nodeType = currentTok.type;
 			if (nodeType == TokenType::END_OF_FIELD) {
 				std::cout << "missing semicolon\n";
-				throw NULL;
+				throw nullptr;
 			}
 			else if (currentTok.str == ";" || currentTok.str == ")") {
 				break;
@@ -379,10 +541,38 @@ struct Parser {
 	}
 
 
+	// Applies any number of trailing .member and ->member accesses to object
+	Expression* parseMemberAccess(Scope* scope, Expression* object) {
+		while (true) {
+			auto next = scanner.peek().first.str;
+			if (next != "." && next != "->") {
+				return object;
+			}
+
+			scanner.consume();
+
+			bool throughPointer = (next == "->");
+			CppType* objectType = object->getResultType();
+
+			if (throughPointer ? objectType->_pointerLayers != 1 : !objectType->isClass()) {
+				throw SourceError(throughPointer ? DiagId::NOT_A_CLASS_POINTER : DiagId::NOT_A_CLASS, objectType->getName());
+			}
+
+			auto memberName = consumeName();
+			const ClassLayout::Field* field = objectType->layout()->findField(memberName);
+
+			if (!field) {
+				throw SourceError(DiagId::NO_SUCH_MEMBER, objectType->layout()->name, memberName);
+			}
+
+			object = makeNode<MemberAccess>(object, throughPointer, field);
+		}
+	}
+
 	void matchCurrentToken(std::string_view tok) {
 		if (currentTok.str != tok) {
-			std::cout << "didnt find expected token type\n";
-			throw NULL;
+			diagnostics().report(DiagId::EXPECTED_TOKEN, currentTok.str.data(), { tok, currentTok.str });
+			throw nullptr;
 		}
 	}
 
@@ -409,7 +599,7 @@ struct Parser {
 		while (true) {
 			if (*scanner.readCursor == ' ') {
 				if (name.size() == 0 || name[0] == ' ') {
-					throw NULL;
+					throw nullptr;
 				}
 				return name;
 			}
@@ -419,7 +609,7 @@ struct Parser {
 
 			if (isScopeOp(str)) {
 				if (lastWasScopeOp) {
-					throw NULL;
+					throw nullptr;
 				}
 				name = std::string_view(name.data(), name.size() + str.size());
 				lastWasScopeOp = true;
@@ -427,7 +617,7 @@ struct Parser {
 			}
 			else if (scanner.isValidIdentifier(str)) {
 				if (!lastWasScopeOp && name != "") {
-					throw NULL;
+					throw nullptr;
 				}
 				name = std::string_view(name.data(), name.size() + str.size());
 				lastWasScopeOp = false;
@@ -435,11 +625,11 @@ struct Parser {
 			}
 			else {
 				if (lastWasScopeOp) {
-					throw NULL;
+					throw nullptr;
 				}
 
 				if (name.size() == 0 || name[0] == ' ') {
-					throw NULL;
+					throw nullptr;
 				}
 
 				return name;
@@ -447,23 +637,182 @@ struct Parser {
 		}
 
 		if (name.size() == 0 || name[0] == ' ') {
-			throw NULL;
+			throw nullptr;
 		}
 
 		return name;
 	}
 
 	std::string_view consumeType() {
+		// Leading cv-qualifiers are part of the spelling, like const T
+		scanner.readCursor = scanner.skipws();
+		const char* begin = scanner.readCursor;
+
+		while (true) {
+			auto next = scanner.peek();
+
+			if (next.first.str != "const" && next.first.str != "volatile") {
+				break;
+			}
+
+			scanner.readCursor = next.second;
+		}
+
 		auto name = consumeName();
+		name = std::string_view(begin, name.data() + name.size() - begin);
+
+		// Template arguments are part of the spelling, like Box<char*>
+		if (*scanner.readCursor == '<') {
+			int depth = 0;
+
+			do {
+				char c = *scanner.readCursor;
+
+				if (c == '<') {
+					depth++;
+				}
+				else if (c == '>') {
+					depth--;
+				}
+				else if (isAnyOf(c, { '\0', ';', '{', '}', '(', ')' })) {
+					throw nullptr;
+				}
+
+				scanner.readCursor++;
+			} while (depth > 0);
+
+			name = std::string_view(name.data(), scanner.readCursor - name.data());
+		}
+
+		// A pointer layer may be qualified itself, like char* const*
+		while (true) {
+			if (*scanner.readCursor == '*') {
+				scanner.readCursor++;
+			}
+			else if (auto next = scanner.peek(); name.back() == '*' && (next.first.str == "const" || next.first.str == "volatile")) {
+				scanner.readCursor = next.second;
+			}
+			else {
+				break;
+			}
 
-		while (*scanner.readCursor == '*') {
-			scanner.readCursor++;
 			name = std::string_view(name.data(), scanner.readCursor - name.data());
 		}
 
 		return name;
 	}
 
+	// Maps a type spelling to a type, looking through names declared as types in scope, like template parameters
+	CppType* resolveType(Scope* scope, std::string_view typeStr) {
+		if (typeStr.find('<') != std::string_view::npos) {
+			return resolveTemplateId(scope, typeStr);
+		}
+
+		try {
+			return strToType(typeStr);
+		}
+		catch (...) {}
+
+		CppTypeKey key = TypeContext::parseSpelling(typeStr);
+		if (key.coreName == "" || isAnyOf(key.coreName, std::begin(KEYWORDS_STR), std::end(KEYWORDS_STR))) {
+			throw nullptr;
+		}
+
+		Declaration* decl = scope->lookup(key.coreName);
+		CppType** aliased = decl ? std::get_if<CppType*>(&decl->data) : nullptr;
+		if (!aliased) {
+			throw nullptr;
+		}
+
+		// The spelling's qualifiers wrap the aliased type, so const T with T = char* is char* const
+		CppTypeKey result = types().keyOf(*aliased);
+
+		if (key.isConst && result.pointerLayers) {
+			result.pointerLayerConstMask |= uint64_t(1) << (result.pointerLayers - 1);
+		}
+		else if (key.isConst) {
+			result.isConst = true;
+		}
+
+		result.isVolatile = result.isVolatile || (key.isVolatile && !result.pointerLayers);
+		result.pointerLayerConstMask |= key.pointerLayerConstMask << result.pointerLayers;
+		result.pointerLayers += key.pointerLayers;
+		result.isReference = result.isReference || key.isReference;
+
+		return types().get(result);
+	}
+
+	// Splits a template-id like Box<T, char*> into the spellings of its arguments
+	static std::vector<std::string_view> splitTemplateArguments(std::string_view templateId) {
+		auto trim = [](std::string_view str) {
+			auto begin = str.find_first_not_of(" \t\r\n");
+			auto end = str.find_last_not_of(" \t\r\n");
+			return begin == std::string_view::npos ? std::string_view() : str.substr(begin, end - begin + 1);
+		};
+
+		std::vector<std::string_view> args;
+		auto open = templateId.find('<');
+		auto close = templateId.rfind('>');
+		int depth = 0;
+		size_t argBegin = open + 1;
+
+		for (size_t i = open + 1; i <= close; i++) {
+			if (templateId[i] == '<') {
+				depth++;
+			}
+			else if (templateId[i] == '>' && depth > 0) {
+				depth--;
+			}
+			else if ((templateId[i] == ',' && depth == 0) || i == close) {
+				args.push_back(trim(templateId.substr(argBegin, i - argBegin)));
+				argBegin = i + 1;
+			}
+		}
+
+		return args;
+	}
+
+	// Resolves a spelling like Box<int*>* by instantiating the class template it names
+	CppType* resolveTemplateId(Scope* scope, std::string_view typeStr) {
+		auto open = typeStr.find('<');
+		auto close = typeStr.rfind('>');
+
+		Declaration* decl = scope->lookup(typeStr.substr(0, open));
+		Template** tmpl = decl ? std::get_if<Template*>(&decl->data) : nullptr;
+		if (!tmpl || (*tmpl)->kind != Template::Kind::CLASS) {
+			throw nullptr;
+		}
+
+		std::vector<CppType*> args;
+		for (auto& arg : splitTemplateArguments(typeStr.substr(0, close + 1))) {
+			args.push_back(resolveType(scope, arg));
+		}
+
+		CppTypeKey key;
+		key.coreName = instantiateClass(*tmpl, args);
+		key.pointerLayers = (int)std::count(typeStr.begin() + close, typeStr.end(), '*');
+		return types().get(key);
+	}
+
+	// Consumes tokens up to and including the } that closes an already consumed {
+	void skipBlock() {
+		int depth = 1;
+
+		while (depth > 0) {
+			auto tok = scanner.consume();
+
+			if (tok.str == "") {
+				throw SourceError(DiagId::END_OF_FILE_IN_BLOCK);
+			}
+			else if (tok.str == "{") {
+				depth++;
+			}
+			else if (tok.str == "}") {
+				depth--;
+			}
+		}
+	}
+
 	bool parseStatementExpression(Scope* scope) {
 		try {
 			auto virtualScanner = scanner.startVirtualScan();
@@ -495,7 +844,7 @@ struct Parser {
 
 			matchToken(")");
 
-			IfStatement* statement = new IfStatement(exp, scope);
+			IfStatement* statement = makeNode<IfStatement>(exp, scope);
 
 			parse(&statement->trueBody, true);
 			statement->hasTrueBranch = true;
@@ -523,7 +872,7 @@ struct Parser {
 			std::string_view retToken = consumeName();
 			if (retToken != "return") { return false; }
 
-			Return* retExp = new Return;
+			Return* retExp = makeNode<Return>();
 
 			retExp->ret = parseExpression(scope);
 
@@ -536,40 +885,205 @@ struct Parser {
 		}
 	}
 
-	void parseClassDecl(std::string_view type) {
-		bool defaultPrivateVisibility = (type == "class");
-		
+	// A module name like math or math.vectors, as one view of the source
+	std::string_view consumeModuleName() {
+		auto first = scanner.consume().str;
+		if (first.empty() || !(std::isalpha((unsigned char)first[0]) || first[0] == '_')) {
+			throw nullptr;
+		}
+
+		const char* end = first.data() + first.size();
+
+		while (scanner.peek().first.str == ".") {
+			scanner.consume();
+
+			auto part = scanner.consume().str;
+			if (part.empty()) {
+				throw nullptr;
+			}
+
+			end = part.data() + part.size();
+		}
+
+		return { first.data(), (size_t)(end - first.data()) };
+	}
+
+	// export module name;, module;, import name; and export in front of a declaration, all at file scope
+	bool parseModuleDeclaration(Scope* scope) {
+		if (!scope->isGlobal()) {
+			return false;
+		}
+
+		try {
+			auto virtualScanner = scanner.startVirtualScan();
+
+			bool exported = scanner.peek().first.str == "export";
+			if (exported) {
+				scanner.consume();
+			}
+
+			auto next = scanner.peek().first.str;
+
+			if (next == "module") {
+				scanner.consume();
+
+				// module; only opens the global module fragment
+				if (scanner.peek().first.str != ";") {
+					auto name = consumeModuleName();
+					if (exported) {
+						moduleName = name;
+					}
+				}
+
+				matchToken(";");
+			}
+			else if (next == "import") {
+				scanner.consume();
+				auto name = consumeModuleName();
+				matchToken(";");
+
+				try {
+					onImport(name);
+				}
+				catch (SourceError& err) {
+					err.at(name.data()).report();
+				}
+			}
+			else if (exported) {
+				exporting = true;
+				bool parsed = parseClass(scope) || parseFunction(scope);
+				exporting = false;
+
+				if (!parsed) {
+					return false;
+				}
+			}
+			else {
+				return false;
+			}
+
+			virtualScanner.keep();
+			return true;
+		}
+		catch (const SourceError& err) {
+			err.report();
+		}
+		catch (...) {}
+
+		exporting = false;
+		return false;
+	}
+
+	// struct or class definition at any scope
+	bool parseClass(Scope* scope) {
+		try {
+			auto virtualScanner = scanner.startVirtualScan();
+
+			auto keyword = scanner.consume().str;
+			if (keyword != "struct" && keyword != "class") {
+				return false;
+			}
+
+			auto name = consumeName();
+
+			// Only definitions are parsed here
+			auto next = scanner.peek().first.str;
+			if (next != "{" && next != ":" && next != "final") {
+				return false;
+			}
+
+			forceFail = true;
+			parseClassDecl(scope, keyword, name);
+			forceFail = false;
+
+			virtualScanner.keep();
+			return true;
+		}
+		catch (const SourceError& err) {
+			err.report();
+		}
+		catch (...) {}
+
+		return false;
+	}
+
+	// Parses the rest of a class definition after its name and lays it out
+	// Member functions aren't supported yet, only data members
+	CppType* parseClassDecl(Scope* scope, std::string_view type, std::string_view name) {
 		// started with "class" or "struct"
 		// not parsing attributes
 
-		auto name = consumeName();
-
 		if (scanner.peek().first.str == "final") {
-		
+			scanner.consume();
 		}
 		
 		// Ignore inheritance
 		while (scanner.peek().first.str != "{") {
-			scanner.consume();
+			if (scanner.consume().str == "") {
+				throw nullptr;
+			}
 		}
+
+		matchToken("{");
+
+		// Declared first so that members can point to the class
+		ClassLayout* layout = types().declareClass(name);
+		layout->exported = exporting;
+		Scope* classScope = new Scope(name, Scope::Type::CLASS, scope);
+
+		std::vector<std::pair<std::string_view, CppType*>> members;
+
+		while (scanner.peek().first.str != "}") {
+			auto next = scanner.peek().first.str;
+
+			if (next == "public" || next == "private" || next == "protected") {
+				// Every member is accessible for now
+				scanner.consume();
+				if (scanner.consume().str != ":") {
+					throw nullptr;
+				}
+				continue;
+			}
+
+			CppType* memberType = resolveType(classScope, consumeType());
+
+			while (true) {
+				members.push_back({ consumeName(), memberType });
+
+				auto sep = scanner.consume().str;
+				if (sep == ";") {
+					break;
+				}
+				else if (sep != ",") {
+					throw nullptr;
+				}
+			}
+		}
+
+		matchToken("}");
+		matchToken(";");
+
+		CppType* classType = types().completeClass(layout, members);
+
+		scope->addChildScope(classScope);
+		scope->addType(classType);
+
+		return classType;
 	}
 
 	void parseEnumDecl() {
-		bool isNamespace = false;
-
 		// started with "enum"
 		// may be class or struct to create a namespace
 		auto firstTok = scanner.peek();
 
 		if (firstTok.first.str == "class" || firstTok.first.str == "struct") {
-			isNamespace = true;
 			scanner.readCursor = firstTok.second;
 		}
 
 		// no attribute parsing for now
 
 		if (scanner.peek().first.str != ":" && scanner.peek().first.str != "{") {
-			auto name = consumeName();
+			consumeName();
 		}
 
 		if (scanner.peek().first.str != "{") {
@@ -589,11 +1103,13 @@ struct Parser {
 
 			Declaration decl;
 
+			auto specifiers = consumeConstantSpecifiers();
+
 			auto type = consumeType();
-			CppType* cppType = strToType(type);
+			CppType* cppType = resolveType(scope, type);
 
 			if (cppType == nullptr) {
-				std::cout << "Invalid type " << type << "\n";
+				diagnostics().report(DiagId::INVALID_TYPE, type.data(), { type });
 			}
 
 			auto name = consumeName();
@@ -601,22 +1117,35 @@ struct Parser {
 
 			auto next = scanner.consume();
 
-			VariableDeclaration* varDecl = new VariableDeclaration{ name, cppType, new IntegerLiteral(0) };
+			// Class objects are left uninitialized, everything else starts out zeroed
+			Expression* defaultInit = cppType->isClass() ? nullptr : makeNode<IntegerLiteral>(0);
+			VariableDeclaration* varDecl = makeNode<VariableDeclaration>(name, cppType, defaultInit);
+			varDecl->_constexpr = specifiers.isConstexpr;
+			varDecl->_constantInit = specifiers.isConstexpr || specifiers.isConstinit;
 			decl.data = varDecl;
 
 			if (next.str == "=") {
 				auto exp = parseExpression(scope);
 				varDecl->initializer = exp;
-			}
 
-			VariableDeclExp* exp = new VariableDeclExp(varDecl);
+				matchToken(";");
+			}
+			else if (next.str != ";") {
+				throw nullptr;
+			}
 
-			matchToken(";");
+			virtualScanner.keep();
 
-			scope->addDeclaration(decl);
-			scope->addExpression(exp);
+			// A redeclaration is still a whole statement, so it is reported rather than parsed some other way
+			try {
+				scope->addDeclaration(decl);
+			}
+			catch (SourceError& err) {
+				err.at(name.data()).report();
+				return true;
+			}
 
-			virtualScanner.keep();
+			scope->addExpression(makeNode<VariableDeclExp>(varDecl));
 			return true;
 		}
 		catch (...) {}
@@ -626,21 +1155,30 @@ struct Parser {
 
 	bool parseFunction(Scope* scope) {
 		try {
-			if (!scope->isFile() && !scope->isClass()) {
+			if (!scope->isFile() && !scope->isClass() && !scope->isTemplate()) {
 				return false;
 			}
 
 			auto virtualScanner = scanner.startVirtualScan();
 			Function* fn = new Function(scope);
+			auto arena = fn->nodes.activate();
+			fn->_moduleExport = exporting;
 
 			if (scanner.peek().first.str == "__export") {
 				fn->_export = true;
 			}
 
-			auto type = consumeName();
-			fn->decl.returnType = strToType(type);
+			auto specifiers = consumeConstantSpecifiers();
+			fn->_constexpr = specifiers.isConstexpr;
+			fn->_consteval = specifiers.isConsteval;
+
+			auto type = consumeType();
+			fn->decl.returnType = resolveType(scope, type);
 
 			auto name = consumeName();
+
+			// Parameters stay bound for the whole body
+			auto parameters = fn->body.enter();
 			consumeFunctionParameters(*fn);
 
 			auto next = scanner.consume();
@@ -659,19 +1197,59 @@ struct Parser {
 				// Just a declaration
 			}
 			else {
-				throw NULL;
+				throw nullptr;
 			}
 
 			virtualScanner.keep();
 			scope->addFunction(fn);
+
+			// Instantiations are reported once they have their final name
+			if (!scope->isTemplate()) {
+				functionParsed(fn);
+			}
+
 			return true;
 		}
+		catch (const SourceError& err) {
+			err.report();
+		}
 		catch (...) {}
 
 		return false;
 	}
 
-	std::vector<Expression*> consumeFunctionPassedParameters(Function* fn) {
+	struct ConstantSpecifiers {
+		bool isConstexpr = false;
+		bool isConsteval = false;
+		bool isConstinit = false;
+	};
+
+	// constexpr, consteval and constinit in front of a declaration, in any order
+	ConstantSpecifiers consumeConstantSpecifiers() {
+		ConstantSpecifiers specifiers;
+
+		while (true) {
+			auto next = scanner.peek();
+
+			if (next.first.str == "constexpr") {
+				specifiers.isConstexpr = true;
+			}
+			else if (next.first.str == "consteval") {
+				specifiers.isConsteval = true;
+			}
+			else if (next.first.str == "constinit") {
+				specifiers.isConstinit = true;
+			}
+			else {
+				return specifiers;
+			}
+
+			scanner.readCursor = next.second;
+		}
+	}
+
+	// Consumes the parenthesized, comma separated arguments passed to a call
+	std::vector<Expression*> consumeCallArguments(Scope* scope) {
 		matchToken("(");
 
 		std::vector<Expression*> args;
@@ -679,45 +1257,58 @@ struct Parser {
 		auto next = scanner.peek();
 		while (next.first.str != ")" && next.first.str != "") {
 			// Parse the argument
-			Expression* arg = parseExpression(scopes.back());
+			Expression* arg = parseExpression(scope);
 
 			if (arg == nullptr) {
 				// Failed to parse the argument
-				throw NULL;
+				throw nullptr;
 			}
 
-			if (fn->decl.arguments.size() <= args.size()) {
-				// Found more arguments than function supports
-				throw NULL;
+			args.push_back(arg);
+
+			next = scanner.peek();
+			if (next.first.str == ",") {
+				scanner.readCursor = next.second;
+				next = scanner.peek();
 			}
+		}
+
+		matchToken(")");
+
+		return args;
+	}
+
+	// Matches call arguments with the parameters of fn
+	std::vector<Expression*> convertCallArguments(Function* fn, std::vector<Expression*> args) {
+		if (fn->decl.arguments.size() != args.size()) {
+			// Found a different number of arguments than the function takes
+			throw nullptr;
+		}
 
+		for (size_t i = 0; i < args.size(); i++) {
 			// Get which argument of the function this entry corresponds with
-			FunctionArgument* slot = fn->decl.arguments[args.size()];
+			FunctionArgument* slot = fn->decl.arguments[i];
 
 			// Insert an intermediary cast expression if they don't match
-			if (*arg->getResultType() != *(slot->type)) {
-				args.push_back(new Cast(arg, slot->type));
-			}
-			else {
-				args.push_back(arg);
+			if (args[i]->getResultType() != slot->type) {
+				args[i] = makeNode<Cast>(args[i], slot->type);
 			}
-
-			next = scanner.peek();
 		}
 
-		matchToken(")");
-
 		return args;
 	}
 
-	void consumeFunctionParameters(Function& fn) {
+	// Consumes a parenthesized parameter list, returning the type spelling and name of each parameter
+	std::vector<std::pair<std::string_view, std::string_view>> consumeParameterList() {
 		matchToken("(");
 
+		std::vector<std::pair<std::string_view, std::string_view>> params;
+
 		auto next = scanner.peek();
 
 		if (next.first.str == ")") {
 			scanner.readCursor = next.second;
-			return;
+			return params;
 		}
 
 		while (next.first.str != ")") {
@@ -727,46 +1318,326 @@ struct Parser {
 				if (next.first.str == ")") {
 					break;
 				}
+				else if (next.first.str == "") {
+					throw nullptr;
+				}
 
 				toks.push_back(next.first.str);
 				scanner.readCursor = next.second;
 				next = scanner.peek();
 			}
 
-			if (next.first.str == "," && toks.size() == 0) {
+			if (toks.size() == 0) {
 				// void func(int i,)
-				throw NULL;
+				throw nullptr;
 			}
 
+			// Everything before the name is part of the type, like char *
 			auto name = toks.back();
-			auto type = toks.front();
+			auto typeEnd = toks.size() > 1 ? toks[toks.size() - 2] : toks.back();
+			auto type = std::string_view(toks.front().data(), typeEnd.data() + typeEnd.size() - toks.front().data());
+
+			params.push_back({ type, name });
+
+			scanner.readCursor = next.second;
 
+			if (next.first.str == ")") {
+				break;
+			}
+
+			next = scanner.peek();
+		}
+
+		return params;
+	}
+
+	void consumeFunctionParameters(Function& fn) {
+		for (auto& [type, name] : consumeParameterList()) {
 			Declaration decl;
 			decl.name = name;
 
 			fn.decl.arguments.push_back(new FunctionArgument);
 			FunctionArgument* arg = fn.decl.arguments.back();
 			arg->name = name;
-			arg->type = strToType(type);
+			arg->type = resolveType(&fn.body, type);
 
-			VariableDeclaration* varDecl = new VariableDeclaration{ name, arg->type, new FunctionArgumentInitializer(arg) };
+			VariableDeclaration* varDecl = makeNode<VariableDeclaration>(name, arg->type, makeNode<FunctionArgumentInitializer>(arg));
 			decl.data = varDecl;
 
-			VariableDeclExp* exp = new VariableDeclExp(varDecl);
+			VariableDeclExp* exp = makeNode<VariableDeclExp>(varDecl);
 
 			fn.body.addDeclaration(decl);
 			fn.body.addExpression(exp);
+		}
+	}
 
-			scanner.readCursor = next.second;
+	// template <typename T, ...> followed by a function or class
+	// Only the parameter names and the extent of the declaration are recorded, the rest is parsed on instantiation
+	bool parseTemplate(Scope* scope) {
+		try {
+			auto virtualScanner = scanner.startVirtualScan();
 
-			if (next.first.str == ")") {
+			if (consumeName() != "template") {
+				return false;
+			}
+
+			forceFail = true;
+
+			matchToken("<");
+
+			std::vector<std::string_view> parameters;
+
+			while (true) {
+				auto keyword = consumeName();
+				if (keyword != "typename" && keyword != "class") {
+					throw nullptr;
+				}
+
+				parameters.push_back(consumeName());
+
+				auto next = scanner.consume();
+				if (next.str == ">") {
+					break;
+				}
+				else if (next.str != ",") {
+					throw nullptr;
+				}
+			}
+
+			Template* tmpl = nullptr;
+			const char* declBegin = scanner.skipws();
+			auto next = scanner.peek().first.str;
+
+			if (next == "struct" || next == "class") {
+				scanner.consume();
+
+				tmpl = new Template(Template::Kind::CLASS, consumeName(), scope, declBegin);
+
+				matchToken("{");
+				skipBlock();
+				matchToken(";");
+			}
+			else {
+				consumeConstantSpecifiers();
+				auto returnType = consumeType();
+
+				tmpl = new Template(Template::Kind::FUNCTION, consumeName(), scope, declBegin);
+				tmpl->returnType = returnType;
+
+				for (auto& [type, name] : consumeParameterList()) {
+					tmpl->argumentTypes.push_back(type);
+				}
+
+				matchToken("{");
+				skipBlock();
+			}
+
+			tmpl->parameters = parameters;
+			scope->addDeclaration(Declaration{ tmpl->name, tmpl });
+
+			forceFail = false;
+			virtualScanner.keep();
+			return true;
+		}
+		catch (const SourceError& err) {
+			err.report();
+		}
+		catch (...) {}
+
+		return false;
+	}
+
+	// Consumes an explicit template argument list like <int, char*>, if there is one
+	std::vector<CppType*> consumeTemplateArguments(Scope* scope) {
+		std::vector<CppType*> args;
+
+		if (scanner.peek().first.str != "<") {
+			return args;
+		}
+
+		scanner.consume();
+
+		while (true) {
+			args.push_back(resolveType(scope, consumeType()));
+
+			auto next = scanner.consume();
+			if (next.str == ">") {
 				break;
 			}
+			else if (next.str != ",") {
+				throw nullptr;
+			}
+		}
 
-			next = scanner.peek();
+		return args;
+	}
+
+	// Fills in the template arguments that weren't given explicitly from the types of the call's arguments
+	void deduceTemplateArguments(Template* tmpl, std::vector<CppType*>& templateArgs, const std::vector<Expression*>& args) {
+		if (templateArgs.size() > tmpl->parameters.size()) {
+			throw SourceError(DiagId::TOO_MANY_TEMPLATE_ARGUMENTS, tmpl->name);
+		}
+
+		// Explicit arguments stand as given; the call's arguments are converted to them instead
+		size_t given = templateArgs.size();
+		templateArgs.resize(tmpl->parameters.size(), nullptr);
+
+		for (size_t i = 0; i < tmpl->argumentTypes.size() && i < args.size(); i++) {
+			deduceFromType(tmpl, tmpl->argumentTypes[i], args[i]->getResultType(), templateArgs, given);
+		}
+
+		if (std::find(templateArgs.begin(), templateArgs.end(), nullptr) != templateArgs.end()) {
+			throw SourceError(DiagId::CANT_DEDUCE, tmpl->name);
 		}
 	}
 
+	// Matches a parameter's spelling against the type passed for it, filling in the template parameters it names
+	void deduceFromType(Template* tmpl, std::string_view spelling, CppType* argType, std::vector<CppType*>& templateArgs, size_t given) {
+		CppTypeKey key = TypeContext::parseSpelling(spelling);
+
+		// T* deduces T from an int* argument by removing the layers the parameter adds
+		if (argType->_pointerLayers < key.pointerLayers) {
+			throw nullptr;
+		}
+
+		CppType* deduced = types().adjustPointerLayers(argType, -key.pointerLayers);
+
+		// Neither the const a parameter like const T* adds nor the top-level cv-qualifiers of a by-value argument are part of T
+		if (key.isConst || (key.pointerLayers == 0 && !key.isReference)) {
+			CppTypeKey unqualified = types().keyOf(deduced);
+
+			if (unqualified.pointerLayers) {
+				unqualified.pointerLayerConstMask &= ~(uint64_t(1) << (unqualified.pointerLayers - 1));
+			}
+			else {
+				unqualified.isConst = false;
+				unqualified.isVolatile = false;
+			}
+
+			deduced = types().get(unqualified);
+		}
+
+		// Box<T>* deduces T from a Box<int>* argument through the arguments its class was instantiated with
+		auto open = key.coreName.find('<');
+		if (open != std::string_view::npos) {
+			ClassLayout* layout = deduced->layout();
+			if (!layout || layout->templateName != key.coreName.substr(0, open)) {
+				return;
+			}
+
+			auto inner = splitTemplateArguments(key.coreName);
+			for (size_t i = 0; i < inner.size() && i < layout->templateArgs.size(); i++) {
+				deduceFromType(tmpl, inner[i], layout->templateArgs[i], templateArgs, given);
+			}
+
+			return;
+		}
+
+		auto param = std::find(tmpl->parameters.begin(), tmpl->parameters.end(), key.coreName);
+
+		if (param == tmpl->parameters.end() || size_t(param - tmpl->parameters.begin()) < given) {
+			return;
+		}
+
+		CppType*& slot = templateArgs[param - tmpl->parameters.begin()];
+
+		if (slot == nullptr) {
+			slot = deduced;
+		}
+		else if (slot != deduced) {
+			throw SourceError(DiagId::CONFLICTING_DEDUCTION, *param);
+		}
+	}
+
+	// Parses the template's declaration again with its parameters bound to args
+	// Every distinct argument tuple is only parsed and emitted once per translation unit
+	Function* instantiate(Template* tmpl, const std::vector<CppType*>& args) {
+		std::string key = Template::makeKey(args);
+
+		if (Template::Instance* cached = tmpl->findInstance(key)) {
+			return cached->fn;
+		}
+
+		if (tmpl->kind != Template::Kind::FUNCTION) {
+			throw SourceError(DiagId::CLASS_TEMPLATE_CALLED, tmpl->name);
+		}
+
+		Scope* bindings = tmpl->bindArguments(args);
+
+		auto savedCursor = scanner.readCursor;
+		bool savedForceFail = forceFail;
+		scanner.readCursor = tmpl->declBegin;
+
+		bool parsed = parseFunction(bindings);
+
+		scanner.readCursor = savedCursor;
+		forceFail = savedForceFail;
+
+		if (!parsed) {
+			throw SourceError(DiagId::INSTANTIATION_FAILED, tmpl->name, key);
+		}
+
+		Function* fn = bindings->getFunctions().back();
+
+		Template::Instance* instance = tmpl->addInstance(key);
+		instance->fn = fn;
+		fn->decl.name = instance->name;
+		fn->templateName = tmpl->name;
+		fn->templateArgs = args;
+		fn->_template = tmpl;
+
+		tmpl->scope->global()->addInstantiation(fn);
+		functionParsed(fn);
+
+		return fn;
+	}
+
+	// Parses the class template's definition again with its parameters bound to args
+	// Returns the instance's class name, like Box<int>, which is declared before its members are parsed
+	std::string_view instantiateClass(Template* tmpl, const std::vector<CppType*>& args) {
+		if (args.size() != tmpl->parameters.size()) {
+			throw SourceError(DiagId::WRONG_TEMPLATE_ARGUMENT_COUNT, tmpl->name);
+		}
+
+		std::string key = Template::makeKey(args);
+
+		if (Template::Instance* cached = tmpl->findInstance(key)) {
+			return cached->name;
+		}
+
+		Scope* bindings = tmpl->bindArguments(args);
+		Template::Instance* instance = tmpl->addInstance(key);
+
+		// Lets the definition refer to pointers to its own instance
+		ClassLayout* layout = types().declareClass(instance->name);
+		layout->templateName = tmpl->name;
+		layout->templateArgs = args;
+
+		auto savedCursor = scanner.readCursor;
+		bool savedForceFail = forceFail;
+		scanner.readCursor = tmpl->declBegin;
+
+		bool parsed = false;
+		try {
+			auto keyword = scanner.consume().str;
+			consumeName();
+
+			parseClassDecl(bindings, keyword, instance->name);
+			parsed = true;
+		}
+		catch (...) {}
+
+		scanner.readCursor = savedCursor;
+		forceFail = savedForceFail;
+
+		if (!parsed) {
+			tmpl->instances.erase(key);
+			throw SourceError(DiagId::INSTANTIATION_FAILED, tmpl->name, key);
+		}
+
+		return instance->name;
+	}
+
 	void parseMemberFunction(Scope* scope) {
 		if (scope->isClass()) {
 
@@ -780,13 +1651,12 @@ struct Parser {
 
 	bool isTypeSpecifier(std::string_view type) {
 		// Simple, individual word level analysis
-
-		bool valid = false;
-
 		if (type == "auto" || 
 			std::find(std::begin(SIMPLE_TYPE_SPECIFIERS_STR), std::end(SIMPLE_TYPE_SPECIFIERS_STR), type) != std::end(SIMPLE_TYPE_SPECIFIERS_STR)) {
 			return true;
 		}
+
+		return false;
 	}
 
 	bool parseTypeSpecifierSeq(Scope* scope) {
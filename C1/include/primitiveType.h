@@ -0,0 +1,116 @@
+#ifndef COMPILER_PRIMITIVETYPE_H
+#define COMPILER_PRIMITIVETYPE_H
+
+#include <array>
+#include <string_view>
+#include <optional>
+#include <utility>
+
+#include "token.h"
+#include "HashMap.h"
+
+enum class BuiltinType {
+	VOID,
+	BOOL,
+	CHAR,
+	SHORT,
+	INT,
+	LONG,
+	LONG_LONG,
+	FLOAT,
+	DOUBLE,
+	LONG_DOUBLE,
+	CONDITION, // Result of a comparison, an i1
+	NULLPTR_T,
+
+	COUNT
+};
+constexpr std::string_view BUILTIN_TYPE_STR[] = {
+	"void",
+	"bool",
+	"char",
+	"short",
+	"int",
+	"long",
+	"long long",
+	"float",
+	"double",
+	"long double",
+	"_condition",
+	"nullptr_t",
+};
+
+struct PrimitiveTypeInfo {
+	BuiltinType type;
+	bool isSigned;
+	bool isInteger;
+	int width; // Bits
+	int align; // Bytes
+};
+
+// Every builtin type's layout under one data model, indexed by BuiltinType
+struct PrimitiveTable {
+	std::array<PrimitiveTypeInfo, (size_t)BuiltinType::COUNT> types;
+
+	int pointerWidth;
+	int pointerAlign;
+
+	constexpr const PrimitiveTypeInfo& operator[](BuiltinType type) const {
+		return types[(size_t)type];
+	}
+};
+
+constexpr PrimitiveTable makePrimitiveTable(const DataModel& model) {
+	auto integer = [](BuiltinType type, bool isSigned, int width) {
+		return PrimitiveTypeInfo{ type, isSigned, true, width, width / 8 };
+	};
+
+	return { {
+		PrimitiveTypeInfo{ BuiltinType::VOID, false, false, 0, 1 },
+		integer(BuiltinType::BOOL, false, model.charWidth),
+		integer(BuiltinType::CHAR, true, model.charWidth),
+		integer(BuiltinType::SHORT, true, model.shortWidth),
+		integer(BuiltinType::INT, true, model.intWidth),
+		integer(BuiltinType::LONG, true, model.longWidth),
+		integer(BuiltinType::LONG_LONG, true, model.longLongWidth),
+		PrimitiveTypeInfo{ BuiltinType::FLOAT, true, false, 32, 4 },
+		PrimitiveTypeInfo{ BuiltinType::DOUBLE, true, false, 64, 8 },
+		PrimitiveTypeInfo{ BuiltinType::LONG_DOUBLE, true, false, model.longDoubleWidth, 16 },
+		PrimitiveTypeInfo{ BuiltinType::CONDITION, false, true, 1, 1 },
+		PrimitiveTypeInfo{ BuiltinType::NULLPTR_T, false, true, model.pointerWidth, model.pointerWidth / 8 },
+	}, model.pointerWidth, model.pointerWidth / 8 };
+}
+
+template <std::size_t... Is>
+constexpr auto makePrimitiveTables(std::index_sequence<Is...>) {
+	return std::array<PrimitiveTable, sizeof...(Is)>{ makePrimitiveTable(DATA_MODELS[Is])... };
+}
+
+// One table per entry in DATA_MODELS, in the same order
+constexpr auto PRIMITIVE_TABLES = makePrimitiveTables(std::make_index_sequence<std::size(DATA_MODELS)>());
+
+static_assert(PRIMITIVE_TABLES[(int)DataModels::LP64][BuiltinType::LONG].width == 64);
+static_assert(PRIMITIVE_TABLES[(int)DataModels::LLP64][BuiltinType::LONG].width == 32);
+
+inline const PrimitiveTable& primitiveTableFor(const DataModel* model) {
+	return PRIMITIVE_TABLES[model - DATA_MODELS];
+}
+
+// Every type a program names is looked up here first, so it is hashed rather than compared against each name
+inline std::optional<BuiltinType> findBuiltinType(std::string_view name) {
+	static HashMap<BuiltinType> builtins = [] {
+		HashMap<BuiltinType> map;
+		for (int i = 0; i < (int)BuiltinType::COUNT; i++) {
+			map.insert(BUILTIN_TYPE_STR[i], (BuiltinType)i);
+		}
+		return map;
+	}();
+
+	if (BuiltinType* type = builtins.get(name)) {
+		return *type;
+	}
+
+	return std::nullopt;
+}
+
+#endif // ifndef COMPILER_PRIMITIVETYPE_H
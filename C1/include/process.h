@@ -0,0 +1,136 @@
+#ifndef COMPILER_PROCESS_H
+#define COMPILER_PROCESS_H
+
+#include <string>
+#include <vector>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <spawn.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <cerrno>
+
+extern char** environ;
+#endif
+
+// A program started with a pipe to its stdin, like clang reading the module the compiler writes
+class ChildProcess {
+#ifdef _WIN32
+	FILE* pipe = nullptr;
+#else
+	pid_t pid = -1;
+#endif
+
+	int input = -1;
+
+public:
+	ChildProcess() = default;
+	ChildProcess(const ChildProcess&) = delete;
+
+	~ChildProcess() {
+		if (running()) {
+			wait();
+		}
+	}
+
+	// Looks args[0] up in the path, and returns false if it couldn't be started
+	bool start(const std::vector<std::string>& args) {
+#ifdef _WIN32
+		std::string command;
+		for (auto& i : args) {
+			command += command.empty() ? "\"" : " \"";
+			command += i;
+			command += '"';
+		}
+
+		pipe = _popen(command.c_str(), "wb");
+		if (!pipe) {
+			return false;
+		}
+
+		input = _fileno(pipe);
+		return true;
+#else
+		int fds[2];
+		if (::pipe(fds)) {
+			return false;
+		}
+
+		// The child only gets the reading end, or it would never see the end of its input
+		fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+		posix_spawn_file_actions_t actions;
+		posix_spawn_file_actions_init(&actions);
+		posix_spawn_file_actions_adddup2(&actions, fds[0], 0);
+		posix_spawn_file_actions_addclose(&actions, fds[0]);
+
+		std::vector<char*> argv;
+		for (auto& i : args) {
+			argv.push_back(const_cast<char*>(i.c_str()));
+		}
+		argv.push_back(nullptr);
+
+		int err = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+
+		posix_spawn_file_actions_destroy(&actions);
+		close(fds[0]);
+
+		if (err) {
+			close(fds[1]);
+			pid = -1;
+			return false;
+		}
+
+		// A child that exits early should fail the write, not kill the compiler
+		signal(SIGPIPE, SIG_IGN);
+
+		input = fds[1];
+		return true;
+#endif
+	}
+
+	bool running() const {
+#ifdef _WIN32
+		return pipe;
+#else
+		return pid > 0;
+#endif
+	}
+
+	// The writing end of the pipe to its stdin
+	int inputFd() const {
+		return input;
+	}
+
+	// Ends its input and waits for it to exit
+	// Returns its exit code, or -1 if it didn't exit normally
+	int wait() {
+#ifdef _WIN32
+		int code = _pclose(pipe);
+		pipe = nullptr;
+		input = -1;
+		return code;
+#else
+		close(input);
+		input = -1;
+
+		int status = 0;
+		while (waitpid(pid, &status, 0) < 0) {
+			if (errno != EINTR) {
+				pid = -1;
+				return -1;
+			}
+		}
+
+		pid = -1;
+		return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+#endif
+	}
+};
+
+#endif // ifndef COMPILER_PROCESS_H
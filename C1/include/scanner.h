@@ -423,8 +423,9 @@ struct LiteralParser {
 		return true;
 	}
 
+	// Reads the characters between two double quotes, replacing escape sequences
 	static bool parseStringLiteral(const char*& r, const char* end, LiteralContainer& container) {
-		if (!testRegex(R"(^"[a-zA-Z\\0-9]*")", r, end)) {
+		if (r == end || *r != '"') {
 			return false;
 		}
 
@@ -445,25 +446,30 @@ struct LiteralParser {
 
 		std::string out;
 
-		for (; r < end; r++) {
-			int c = *r;
-
-			auto next = [&]() { return (r < end - 1) ? (int)(*(r + 1)) : EOF; };
+		const char* c = r + 1;
+		for (; c < end && *c != '"' && *c != '\n'; c++) {
+			if (*c == '\\' && c + 1 < end) {
+				auto simpleReplacement = std::find_if(std::begin(SIMPLE_ESCAPE_SEQUENCES), std::end(SIMPLE_ESCAPE_SEQUENCES),
+					[&](const std::pair<std::string_view, char> i) {
+						return i.first[1] == c[1];
+					});
+				if (simpleReplacement != std::end(SIMPLE_ESCAPE_SEQUENCES)) {
+					out += simpleReplacement->second;
+					c++;
+					continue;
+				}
+			}
 
-			auto simpleReplacement = std::find_if(std::begin(SIMPLE_ESCAPE_SEQUENCES), std::end(SIMPLE_ESCAPE_SEQUENCES),
-				[&](const std::pair<std::string_view, char> i) {
-					return i.first[1] == next();
-				});
-			if (c == '\\' && simpleReplacement != std::end(SIMPLE_ESCAPE_SEQUENCES)) {
-				out += simpleReplacement->second;
+			out += *c;
+		}
 
-				r++;
-			}
-			else {
-				out += c;
-			}
+		// Unterminated
+		if (c == end || *c != '"') {
+			return false;
 		}
 
+		r = c + 1;
+
 		out += '\0';
 		container = out;
 		return true;
@@ -571,7 +577,7 @@ public:
 			};
 		}
 		else {
-			throw SourceError("Unexpected token beginning", makeSourcePos(r, r));
+			throw SourceError(DiagId::UNEXPECTED_CHARACTER, makeSourcePos(r, r));
 		}
 
 		while (true) {
@@ -624,9 +630,11 @@ public:
 	}
 
 	// Stores a snapshot of scanner state and restores it upon leaving scope
+	// Diagnostics reported during the scan are rolled back along with it
 	struct VirtualScanner {
 		ItrT _orig;
 		Scanner* _scanner;
+		Diagnostics::Mark _diagnostics;
 		bool _keep = false;
 
 		void keep() {
@@ -636,13 +644,14 @@ public:
 		~VirtualScanner() {
 			if (!_keep) {
 				_scanner->readCursor = _orig;
+				diagnostics().rollback(_diagnostics);
 			}
 		}
 	};
 
 	// Returns a snapshot of parser state and restores it when it leaves scope, unless .keep() is called
 	VirtualScanner startVirtualScan() {
-		return { readCursor, this };
+		return { readCursor, this, diagnostics().mark() };
 	}
 };
 
@@ -29,8 +29,8 @@ struct SourcePos {
 	SourceOffset findPtr(const char* where) const {
 		int64_t line = 1;
 		int64_t column = 1;
-		for (const char* i = file.data(); i < file.data() + file.size(); i++) {
-			if (i == file.data()) {
+		for (const char* i = file.data(); i <= file.data() + file.size(); i++) {
+			if (i == where) {
 				return { line, column };
 			}
 
@@ -55,7 +55,7 @@ struct SourcePos {
 		SourceSnippet location = resolve();
 
 		std::stringstream out;
-		out << "in file " << file << ", line " << location.begin.line << ", column " << location.begin.col;
+		out << "in file " << filename << ", line " << location.begin.line << ", column " << location.begin.col;
 		return out.str();
 	}
 
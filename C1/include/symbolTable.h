@@ -0,0 +1,94 @@
+#ifndef COMPILER_SYMBOLTABLE_H
+#define COMPILER_SYMBOLTABLE_H
+
+#include <deque>
+#include <vector>
+#include <string>
+
+#include "type.h"
+#include "HashMap.h"
+#include "util.h"
+
+class Scope;
+
+// Every name visible at the point a function body has been parsed up to
+// Each name maps to a stack of bindings with the innermost on top, so lookup doesn't depend on how deeply blocks nest
+struct SymbolTable {
+	struct Binding {
+		Declaration decl;
+		Binding* shadowed; // Binding of the same name in an enclosing block, if any
+	};
+
+	// Undoes the bindings made since it was created when it leaves scope
+	struct Frame {
+		SymbolTable* table;
+
+		Frame(SymbolTable* table_) : table(table_) {}
+		Frame(const Frame&) = delete;
+
+		~Frame() {
+			if (table) {
+				table->pop();
+			}
+		}
+	};
+
+	HashMap<Binding*> innermost;
+
+	// Every live binding in the order it was made
+	std::deque<Binding> bindings;
+	std::vector<size_t> frames; // Size of bindings when each open frame was pushed
+
+	// Where lookups continue once the function's own names are exhausted
+	Scope* outer = nullptr;
+
+	// Locals declared by each name so far, including those of blocks that have ended
+	HashMap<int> declared;
+
+	Frame push() {
+		frames.push_back(bindings.size());
+		return Frame(this);
+	}
+
+	void pop() {
+		size_t begin = frames.back();
+		frames.pop_back();
+
+		while (bindings.size() > begin) {
+			Binding& binding = bindings.back();
+
+			if (binding.shadowed) {
+				innermost.update(binding.decl.name, binding.shadowed);
+			}
+			else {
+				innermost.erase(binding.decl.name);
+			}
+
+			bindings.pop_back();
+		}
+	}
+
+	void bind(const Declaration& decl) {
+		Binding** top = innermost.get(decl.name);
+		Binding& binding = bindings.emplace_back(Binding{ decl, top ? *top : nullptr });
+		innermost.update(decl.name, &binding);
+	}
+
+	// The name for a local's registers if it can't have its own, which only the first local by that name can
+	std::string localName(std::string_view name) {
+		int* count = declared.get(name);
+		if (!count) {
+			declared.insert(name, 0);
+			return "";
+		}
+
+		return buildStr(name, ".s", ++*count);
+	}
+
+	Declaration* find(std::string_view name, std::size_t hash) {
+		Binding** binding = innermost.get(name, hash);
+		return binding ? &(*binding)->decl : nullptr;
+	}
+};
+
+#endif // ifndef COMPILER_SYMBOLTABLE_H
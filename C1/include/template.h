@@ -0,0 +1,86 @@
+#ifndef COMPILER_TEMPLATE_H
+#define COMPILER_TEMPLATE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <memory>
+
+#include "function.h"
+
+// A function or class template. Its body is kept as source and parsed again for every distinct set of arguments.
+struct Template {
+	enum class Kind {
+		FUNCTION,
+		CLASS
+	};
+
+	struct Instance {
+		std::string name; // Spelled like add<int>, storage for the instantiated function's or class's name
+		Function* fn = nullptr; // Only for function templates
+	};
+
+	Kind kind;
+	std::string_view name;
+
+	// Names of the typename/class parameters, in declaration order
+	std::vector<std::string_view> parameters;
+
+	// Spelling of each function parameter's type, used to deduce arguments from a call
+	std::vector<std::string_view> argumentTypes;
+
+	// Spelling of a function template's return type, which its instances are mangled with
+	std::string_view returnType;
+
+	// Scope the template was declared in
+	Scope* scope;
+
+	// Start of the templated declaration, just after template<...>
+	const char* declBegin;
+
+	// Every instantiation made so far, keyed by the canonical spelling of its argument tuple
+	std::map<std::string, std::unique_ptr<Instance>> instances;
+
+	Template(Kind kind_, std::string_view name_, Scope* scope_, const char* declBegin_) :
+		kind(kind_), name(name_), scope(scope_), declBegin(declBegin_) {}
+
+	static std::string makeKey(const std::vector<CppType*>& args) {
+		std::string key;
+
+		for (auto& i : args) {
+			if (&i != &args.front()) {
+				key += ", ";
+			}
+			key += i->getName();
+		}
+
+		return key;
+	}
+
+	// Returns the cached instantiation for these arguments, or nullptr if it hasn't been made yet
+	Instance* findInstance(const std::string& key) {
+		auto itr = instances.find(key);
+		return itr == instances.end() ? nullptr : itr->second.get();
+	}
+
+	Instance* addInstance(const std::string& key) {
+		auto& inst = instances[key];
+		inst = std::make_unique<Instance>();
+		inst->name = buildStr(name, "<", key, ">");
+		return inst.get();
+	}
+
+	// Creates the scope that binds each parameter name to its argument while the body is parsed
+	Scope* bindArguments(const std::vector<CppType*>& args) {
+		Scope* bindings = new Scope(name, Scope::Type::TEMPLATE, scope);
+
+		for (size_t i = 0; i < parameters.size(); i++) {
+			bindings->addDeclaration(Declaration{ parameters[i], args[i] });
+		}
+
+		return bindings;
+	}
+};
+
+#endif // ifndef COMPILER_TEMPLATE_H
@@ -21,11 +21,24 @@ enum class DataModels {
 	ARDUINO_OLD, // 2/4/4
 	ARDUINO, // 4/8/4
 };
+constexpr std::string_view DATA_MODELS_STR[] = {
+	"LP32",
+	"ILP32",
+	"LLP64",
+	"LP64",
+	"ILP64",
+	"ARDUINO_OLD",
+	"ARDUINO"
+};
 
 enum class Platform {
 	WINDOWS,
 	LINUX
 };
+constexpr std::string_view PLATFORM_STR[] = {
+	"windows",
+	"linux"
+};
 
 struct DataModel {
 	int charWidth;
@@ -50,8 +63,18 @@ constexpr const inline DataModel DATA_MODELS[] = {
 	{ 8, 16, 32, 64, 64, 80, 32 },
 };
 
-const static DataModel* currentDataModel = &DATA_MODELS[(int)DataModels::LP64];
-static Platform targetPlatform = Platform::WINDOWS;
+// Chosen once on the command line, before any type is made
+inline const DataModel* currentDataModel = &DATA_MODELS[(int)DataModels::LP64];
+
+#ifdef _WIN32
+inline Platform targetPlatform = Platform::WINDOWS;
+#else
+inline Platform targetPlatform = Platform::LINUX;
+#endif
+
+inline DataModels currentDataModelId() {
+	return (DataModels)(currentDataModel - DATA_MODELS);
+}
 
 
 enum class TokenType {
@@ -172,7 +195,7 @@ struct OperatorTrait {
 	Operator op;
 	std::string_view str;
 	int precedence;
-	OperatorBindingDirection direction;
+	OperatorBindingDirection direction = OperatorBindingDirection::LEFT;
 };
 
 constexpr OperatorTrait OPERATOR_TRAITS[] = {
@@ -268,8 +291,8 @@ public:
 
 	TokenType type = TokenType::UNKNOWN;
 	std::string_view str;
-	LiteralContainer value;
-	Operator op;
+	LiteralContainer value{};
+	Operator op = Operator::UNKNOWN;
 };
 
 #endif
\ No newline at end of file
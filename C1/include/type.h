@@ -2,12 +2,14 @@
 #define COMPILER_TYPE_H
 
 #include <vector>
+#include <string>
 #include <string_view>
 #include <variant>
 #include <memory>
 #include <functional>
 
 #include "cppType.h"
+#include "forward.h"
 
 struct PrimitiveType {
 	enum Subtype {
@@ -40,16 +42,28 @@ struct VariableDeclaration {
 	CppType* type;
 	Expression* initializer;
 
+	// constexpr or constinit, so the initializer is evaluated at compile time
+	bool _constantInit = false;
+
+	// constexpr, so constant expressions can read it too
+	bool _constexpr = false;
+
 	int valReg = 0;
-	std::string getValReg() {
-		std::string ret = "%";
-		ret.append(name);
-		ret.append(".");
-		ret.append(std::to_string(valReg));
-		return ret;
+
+	// Set when a block in the same function already declared a local by this name
+	std::string _irName{};
+
+	// The local's registers are named after this, since a shadowing local can't reuse the name it shadows
+	std::string_view irName() {
+		return _irName.empty() ? name : _irName;
+	}
+
+	// %name.N, the variable's value as of its latest load
+	Operand getValReg() {
+		return Operand::local(irName(), valReg);
 	}
 
-	std::string getNextValReg() {
+	Operand getNextValReg() {
 		valReg++;
 		return getValReg();
 	}
@@ -59,8 +73,8 @@ enum class DeclarationType {
 	FunctionDef, // Function*
 	FunctionDecl, // FunctionPrototype*
 
-	TemplateDecl,
-	TemplateInstantiation,
+	TemplateDecl, // Template*
+	TemplateInstantiation, // Function*, owned by its Template
 	TemplateSpecialization,
 
 	NamespaceDecl, // Scope*
@@ -82,9 +96,11 @@ class Scope;
 struct CppType;
 struct Expression;
 struct FunctionPrototype;
+struct Template;
+struct OverloadSet;
 
 struct Declaration {
-	using Data = std::variant<Function*, FunctionPrototype*, Scope*, CppType*, Expression*, VariableDeclaration*>;
+	using Data = std::variant<Function*, FunctionPrototype*, Scope*, CppType*, Expression*, VariableDeclaration*, Template*, OverloadSet*>;
 
 	std::string_view name;
 
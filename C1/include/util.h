@@ -81,7 +81,7 @@ void appendAll(BufT& buf, ArgsT &&... args) {
 	(impl(args), ...);
 }
 
-static constexpr const std::array<uint32_t, 6> WHITESPACE = { ' ', '\t', '\n', '\v', '\f', '\r' };
+static constexpr const std::array<char, 6> WHITESPACE = { ' ', '\t', '\n', '\v', '\f', '\r' };
 
 template <typename ItrT>
 ItrT skipWhiteSpace(ItrT readCursor, ItrT end) {
@@ -103,4 +103,15 @@ std::string buildStr(const DataTs&... data) {
 	return ret.str();
 }
 
+// Names like add<int> are only valid LLVM identifiers when quoted
+inline std::string quoteLlvmName(std::string name) {
+	for (char c : name) {
+		if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '.')) {
+			return "\"" + name + "\"";
+		}
+	}
+
+	return name;
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,827 @@
+#ifndef COMPILER_VM_H
+#define COMPILER_VM_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+
+#include "type.h"
+#include "function.h"
+#include "constantPool.h"
+#include "x86.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(C1_NO_COMPUTED_GOTO)
+#define C1_COMPUTED_GOTO 1
+#endif
+
+// Register bytecode, one instruction for about each IR instruction
+// Registers hold 64 bits, with narrower integers kept sign extended and i1 as 0 or 1, so most operations
+// only need a 32 and a 64 bit form, and NORM brings a result back to its width after one that can overflow it
+#define VM_OPS(X) \
+	X(MOV) /* dst = a */ \
+	X(ADDR) /* dst = this frame's memory + c */ \
+	X(ALLOCA) /* dst = c * a bytes from the memory stack */ \
+	X(LOAD8) X(LOAD16) X(LOAD32) X(LOAD64) /* dst = *a */ \
+	X(STORE8) X(STORE16) X(STORE32) X(STORE64) /* *b = a */ \
+	X(ADD32) X(SUB32) X(MUL32) X(SHL32) X(ASHR32) X(SDIV32) X(SREM32) /* dst = a op b */ \
+	X(ADD64) X(SUB64) X(MUL64) X(SHL64) X(ASHR64) X(SDIV64) X(SREM64) \
+	X(AND) X(OR) X(XOR) \
+	X(LSHR) /* dst = a >> b, as width bits */ \
+	X(NORM) /* dst = a truncated to width bits */ \
+	X(ZEXT) /* dst = a zero extended from width bits */ \
+	X(NEG) \
+	X(EQ) X(NE) X(SLT) X(SLE) X(SGT) X(SGE) X(ULT) X(ULE) X(UGT) X(UGE) /* dst = a cmp b, unsigned as width bits */ \
+	X(ADDI) /* dst = a + c */ \
+	X(MADD) /* dst = a + b * c */ \
+	X(CALL) /* dst = function a, with c arguments from the registers at b in the argument list */ \
+	X(NATIVE) /* Likewise for native a */ \
+	X(JMP) /* To b */ \
+	X(BR) /* To b if a, else to c */ \
+	X(RET) /* Returns a */ \
+	X(RETV)
+
+enum class VmOp : uint8_t {
+#define VM_ENUM(name) name,
+	VM_OPS(VM_ENUM)
+#undef VM_ENUM
+};
+
+struct VmInst {
+	VmOp op;
+	uint8_t width = 64; // Bits of the value, for the operations that depend on it
+	uint32_t dst = 0;
+	uint32_t a = 0;
+	uint32_t b = 0;
+	int32_t c = 0;
+};
+
+// Registers are arguments, then constants, then the value of each instruction
+struct VmFunction {
+	std::string name;
+	std::vector<VmInst> code;
+	std::vector<int64_t> constants; // Copied in after the arguments when the function is called
+	uint32_t argCount = 0;
+	uint32_t registerCount = 0;
+	uint32_t frameBytes = 0; // Allocas with a fixed size
+};
+
+// Compiles the IR of a function into bytecode
+class VmCompiler {
+public:
+	constexpr static uint32_t MAX_NATIVE_ARGS = 8;
+
+	// Where a call goes, given its callee
+	struct Callee {
+		VmOp op;
+		uint32_t index;
+	};
+
+private:
+	const IrFunction& ir;
+	VmFunction out;
+	ConstantPool* constants;
+	std::vector<uint32_t>& argLists;
+	std::function<Callee(std::string_view)> findCallee;
+
+	std::unordered_map<Operand, uint32_t, OperandHash> registers;
+	std::unordered_map<int64_t, uint32_t> constantRegisters;
+
+	// Where each block starts, and the branches to fill in once they are all placed
+	std::unordered_map<Operand, uint32_t, OperandHash> blocks;
+	std::vector<std::pair<size_t, Operand>> branchesB;
+	std::vector<std::pair<size_t, Operand>> branchesC;
+
+	constexpr static uint32_t NO_RESULT = UINT32_MAX;
+
+	static int bits(LlvmType* type) {
+		if (type->kind == LlvmType::Kind::INT) {
+			return static_cast<LlvmTypeInt*>(type)->width;
+		}
+		if (type->kind == LlvmType::Kind::POINTER) {
+			return 64;
+		}
+		throw SourceError(DiagId::VM_UNSUPPORTED, type->name());
+	}
+
+	void emit(VmOp op, uint32_t dst, uint32_t a = 0, uint32_t b = 0, int32_t c = 0, int width = 64) {
+		out.code.push_back({ op, (uint8_t)width, dst, a, b, c });
+	}
+
+	void constant(int64_t val) {
+		if (!constantRegisters.contains(val)) {
+			constantRegisters[val] = (uint32_t)out.constants.size();
+			out.constants.push_back(val);
+		}
+	}
+
+	// Strings are constants holding the address of their bytes in the pool
+	static int64_t constantValue(const Operand& op, ConstantPool* pool) {
+		if (op.kind == Operand::Kind::STRING) {
+			auto str = pool ? pool->find(op.name) : nullptr;
+			if (!str) {
+				throw SourceError(DiagId::VM_UNSUPPORTED, op.name);
+			}
+			return (int64_t)(uintptr_t)str->bytes.data();
+		}
+		return op.value;
+	}
+
+	static bool isConstant(const Operand& op) {
+		return op.kind == Operand::Kind::CONSTANT || op.kind == Operand::Kind::BOOL || op.kind == Operand::Kind::STRING;
+	}
+
+	uint32_t reg(const Operand& op) {
+		if (isConstant(op)) {
+			return out.argCount + constantRegisters.at(constantValue(op, constants));
+		}
+
+		auto found = registers.find(op);
+		if (found == registers.end()) {
+			throw SourceError(DiagId::VM_UNSUPPORTED, "a value used before it is made");
+		}
+		return found->second;
+	}
+
+	uint32_t result(const IrInstruction& inst) {
+		return registers[inst.result] = out.registerCount++;
+	}
+
+	// The result is the operand itself, for the casts that don't change the register
+	void alias(const IrInstruction& inst, const Operand& op) {
+		registers[inst.result] = reg(op);
+	}
+
+	void binary(const IrInstruction& inst, const IrOperand* ops) {
+		constexpr std::pair<std::string_view, VmOp> OPS32[] = {
+			{ "add", VmOp::ADD32 }, { "sub", VmOp::SUB32 }, { "mul", VmOp::MUL32 }, { "shl", VmOp::SHL32 },
+			{ "ashr", VmOp::ASHR32 }, { "sdiv", VmOp::SDIV32 }, { "srem", VmOp::SREM32 },
+			{ "and", VmOp::AND }, { "or", VmOp::OR }, { "xor", VmOp::XOR }, { "lshr", VmOp::LSHR },
+		};
+		constexpr std::pair<std::string_view, VmOp> OPS64[] = {
+			{ "add", VmOp::ADD64 }, { "sub", VmOp::SUB64 }, { "mul", VmOp::MUL64 }, { "shl", VmOp::SHL64 },
+			{ "ashr", VmOp::ASHR64 }, { "sdiv", VmOp::SDIV64 }, { "srem", VmOp::SREM64 },
+			{ "and", VmOp::AND }, { "or", VmOp::OR }, { "xor", VmOp::XOR }, { "lshr", VmOp::LSHR },
+		};
+
+		int width = bits(inst.type);
+		std::string_view opcode = inst.opcode.substr(0, inst.opcode.find(' '));
+
+		const auto& table = width == 64 ? OPS64 : OPS32;
+		auto op = std::find_if(std::begin(table), std::end(table), [&](auto& i) { return i.first == opcode; });
+		if (op == std::end(table)) {
+			throw SourceError(DiagId::VM_UNSUPPORTED, opcode);
+		}
+
+		uint32_t a = reg(ops[0].value);
+		uint32_t b = reg(ops[1].value);
+		uint32_t dst = result(inst);
+		emit(op->second, dst, a, b, 0, width);
+
+		// Bitwise operations can't leave the width, and the rest are exact in 32 bits
+		bool overflows = op->second == VmOp::ADD32 || op->second == VmOp::SUB32 || op->second == VmOp::MUL32 ||
+			op->second == VmOp::SHL32 || op->second == VmOp::SDIV32;
+		if (width < 32 && overflows) {
+			emit(VmOp::NORM, dst, dst, 0, 0, width);
+		}
+	}
+
+	void icmp(const IrInstruction& inst, const IrOperand* ops) {
+		constexpr std::pair<std::string_view, VmOp> CONDITIONS[] = {
+			{ "eq", VmOp::EQ }, { "ne", VmOp::NE },
+			{ "slt", VmOp::SLT }, { "sle", VmOp::SLE }, { "sgt", VmOp::SGT }, { "sge", VmOp::SGE },
+			{ "ult", VmOp::ULT }, { "ule", VmOp::ULE }, { "ugt", VmOp::UGT }, { "uge", VmOp::UGE },
+		};
+
+		auto condition = std::find_if(std::begin(CONDITIONS), std::end(CONDITIONS), [&](auto& i) { return i.first == inst.opcode; });
+		if (condition == std::end(CONDITIONS)) {
+			throw SourceError(DiagId::VM_UNSUPPORTED, inst.opcode);
+		}
+
+		uint32_t a = reg(ops[0].value);
+		uint32_t b = reg(ops[1].value);
+		emit(condition->second, result(inst), a, b, 0, bits(inst.type));
+	}
+
+	void cast(const IrInstruction& inst, const IrOperand* ops) {
+		int from = bits(ops[0].type);
+		int to = bits(inst.type);
+		const Operand& src = ops[0].value;
+
+		if (inst.opcode == "sext") {
+			if (from == 1) {
+				uint32_t a = reg(src);
+				emit(VmOp::NEG, result(inst), a);
+			}
+			else {
+				alias(inst, src);
+			}
+		}
+		else if (inst.opcode == "zext" || inst.opcode == "inttoptr") {
+			if (from == 1 || from == 64) {
+				alias(inst, src);
+			}
+			else {
+				uint32_t a = reg(src);
+				emit(VmOp::ZEXT, result(inst), a, 0, 0, from);
+			}
+		}
+		else if (inst.opcode == "trunc" || inst.opcode == "ptrtoint") {
+			if (to == 64) {
+				alias(inst, src);
+			}
+			else {
+				uint32_t a = reg(src);
+				emit(VmOp::NORM, result(inst), a, 0, 0, to);
+			}
+		}
+		else if (inst.opcode == "bitcast") {
+			alias(inst, src);
+		}
+		else {
+			throw SourceError(DiagId::VM_UNSUPPORTED, inst.opcode);
+		}
+	}
+
+	void gep(const IrInstruction& inst, const IrOperand* ops) {
+		uint32_t acc = reg(ops[0].value);
+		uint32_t dst = result(inst);
+		int64_t offset = 0;
+
+		LlvmType* type = inst.type;
+
+		for (uint32_t i = 1; i < inst.operandCount; i++) {
+			const Operand& index = ops[i].value;
+
+			if (i > 1 && (type->kind == LlvmType::Kind::IDENTIFIED_STRUCT || type->kind == LlvmType::Kind::LITERAL_STRUCT)) {
+				offset += X86Layout::offsetOf(type, index.value);
+				type = X86Layout::members(type)[index.value];
+				continue;
+			}
+
+			if (i > 1) {
+				if (type->kind != LlvmType::Kind::ARRAY) {
+					throw SourceError(DiagId::VM_UNSUPPORTED, type->name());
+				}
+				type = static_cast<LlvmTypeArray*>(type)->dataType;
+			}
+
+			int scale = X86Layout::sizeOf(type);
+
+			if (index.kind == Operand::Kind::CONSTANT) {
+				offset += index.value * scale;
+			}
+			else {
+				emit(VmOp::MADD, dst, acc, reg(index), scale);
+				acc = dst;
+			}
+		}
+
+		if (offset || acc != dst) {
+			emit(VmOp::ADDI, dst, acc, 0, (int32_t)offset);
+		}
+	}
+
+	void call(const IrInstruction& inst, const IrOperand* ops) {
+		Callee callee = findCallee(inst.opcode);
+		if (callee.op == VmOp::NATIVE && inst.operandCount > MAX_NATIVE_ARGS) {
+			throw SourceError(DiagId::VM_UNSUPPORTED, "a native call with more than 8 arguments");
+		}
+
+		uint32_t args = (uint32_t)argLists.size();
+		for (uint32_t i = 0; i < inst.operandCount; i++) {
+			argLists.push_back(reg(ops[i].value));
+		}
+
+		uint32_t dst = inst.result.kind != Operand::Kind::NONE ? result(inst) : NO_RESULT;
+		emit(callee.op, dst, callee.index, args, (int32_t)inst.operandCount);
+	}
+
+	static VmOp loadOp(int size) {
+		return size == 1 ? VmOp::LOAD8 : size == 2 ? VmOp::LOAD16 : size == 4 ? VmOp::LOAD32 : VmOp::LOAD64;
+	}
+
+	static VmOp storeOp(int size) {
+		return size == 1 ? VmOp::STORE8 : size == 2 ? VmOp::STORE16 : size == 4 ? VmOp::STORE32 : VmOp::STORE64;
+	}
+
+	void instruction(const IrInstruction& inst, const Operand& nextBlock) {
+		using IrOp = IrInstruction::Op;
+
+		const IrOperand* ops = ir.operandsOf(inst);
+
+		switch (inst.op) {
+		case IrOp::ALLOCA: {
+			int size = X86Layout::sizeOf(inst.type);
+
+			if (inst.operandCount) {
+				uint32_t count = reg(ops[0].value);
+				emit(VmOp::ALLOCA, result(inst), count, 0, size);
+			}
+			else {
+				uint32_t offset = (uint32_t)X86Layout::alignUp(out.frameBytes, X86Layout::alignOf(inst.type));
+				out.frameBytes = offset + size;
+				emit(VmOp::ADDR, result(inst), 0, 0, offset);
+			}
+			break;
+		}
+		case IrOp::LOAD: {
+			int size = X86Layout::sizeOf(inst.type);
+			if (size > 8) {
+				throw SourceError(DiagId::VM_UNSUPPORTED, inst.type->name());
+			}
+
+			uint32_t addr = reg(ops[0].value);
+			emit(loadOp(size), result(inst), addr);
+			break;
+		}
+		case IrOp::STORE: {
+			int size = X86Layout::sizeOf(ops[0].type);
+			if (size > 8) {
+				throw SourceError(DiagId::VM_UNSUPPORTED, ops[0].type->name());
+			}
+
+			emit(storeOp(size), 0, reg(ops[0].value), reg(ops[1].value));
+			break;
+		}
+		case IrOp::BINARY:
+			binary(inst, ops);
+			break;
+		case IrOp::ICMP:
+			icmp(inst, ops);
+			break;
+		case IrOp::CAST:
+			cast(inst, ops);
+			break;
+		case IrOp::GEP:
+			gep(inst, ops);
+			break;
+		case IrOp::CALL:
+			call(inst, ops);
+			break;
+		case IrOp::BR:
+			// Falling through to the next block needs no jump
+			if (ops[0].value != nextBlock) {
+				branchesB.emplace_back(out.code.size(), ops[0].value);
+				emit(VmOp::JMP, 0);
+			}
+			break;
+		case IrOp::COND_BR:
+			branchesB.emplace_back(out.code.size(), ops[1].value);
+			branchesC.emplace_back(out.code.size(), ops[2].value);
+			emit(VmOp::BR, 0, reg(ops[0].value));
+			break;
+		case IrOp::RET:
+			if (inst.operandCount) {
+				emit(VmOp::RET, 0, reg(ops[0].value));
+			}
+			else {
+				emit(VmOp::RETV, 0);
+			}
+			break;
+		}
+	}
+
+public:
+	VmCompiler(const IrFunction& ir_, ConstantPool* constants_, std::vector<uint32_t>& argLists_, std::function<Callee(std::string_view)> findCallee_) :
+		ir(ir_), constants(constants_), argLists(argLists_), findCallee(std::move(findCallee_)) {}
+
+	VmFunction compile() {
+		out.name = ir.name;
+		out.argCount = (uint32_t)ir.arguments.size();
+
+		for (uint32_t i = 0; i < out.argCount; i++) {
+			registers[ir.arguments[i].value] = i;
+		}
+
+		// Constants need their registers before the first instruction's result takes the next one
+		for (auto& block : ir.blocks) {
+			for (auto& inst : block.instructions) {
+				const IrOperand* ops = ir.operandsOf(inst);
+				for (uint32_t i = 0; i < inst.operandCount; i++) {
+					if (isConstant(ops[i].value)) {
+						constant(constantValue(ops[i].value, constants));
+					}
+				}
+			}
+		}
+
+		out.registerCount = out.argCount + (uint32_t)out.constants.size();
+
+		for (size_t i = 0; i < ir.blocks.size(); i++) {
+			const IrBlock& block = ir.blocks[i];
+			Operand nextBlock = i + 1 < ir.blocks.size() ? ir.blocks[i + 1].label : Operand();
+
+			if (block.label.kind != Operand::Kind::NONE) {
+				blocks[block.label] = (uint32_t)out.code.size();
+			}
+
+			for (auto& inst : block.instructions) {
+				instruction(inst, nextBlock);
+			}
+		}
+
+		for (auto& [at, label] : branchesB) {
+			out.code[at].b = blocks.at(label);
+		}
+		for (auto& [at, label] : branchesC) {
+			out.code[at].c = (int32_t)blocks.at(label);
+		}
+
+		return std::move(out);
+	}
+};
+
+// Interprets the bytecode of main and whatever it calls, compiled when it is first run
+// Frames are kept on two flat stacks, one of registers and one of memory for allocas, and builtins like print
+// are native calls, to which an embedder can add its own
+class Vm {
+public:
+	// Takes its arguments as they are held in registers, and returns its result the same way
+	using Native = int64_t (*)(const int64_t* args);
+
+	// String constants the functions refer to
+	ConstantPool* constants = nullptr;
+
+	// Run the IR passes on each function before it is compiled
+	bool optimize = false;
+
+	size_t registerStackSize = 1 << 20;
+	size_t memoryStackSize = 8 << 20;
+	size_t maxCallDepth = 1 << 16;
+
+private:
+	struct NativeEntry {
+		std::string name;
+		Native fn;
+	};
+
+	struct Frame {
+		const VmFunction* fn;
+		const VmInst* pc; // The call
+		int64_t* regs;
+		uint8_t* mem;
+		uint8_t* memTop;
+	};
+
+	std::vector<VmFunction> functions;
+	std::unordered_map<std::string_view, uint32_t> functionIndices;
+	std::vector<NativeEntry> natives;
+	std::vector<uint32_t> argLists;
+
+	std::unordered_map<std::string_view, Function*> sources;
+
+	// Functions given an index but not compiled yet
+	std::vector<uint32_t> pending;
+
+	std::unique_ptr<int64_t[]> registers;
+	std::unique_ptr<uint8_t[]> memory;
+	std::vector<Frame> frames;
+
+	static int64_t nativePrint(const int64_t* args) {
+		// printf gets an i32 whatever the data model, as in the IR preamble
+		printf("%d\n", (int32_t)args[0]);
+		return 0;
+	}
+
+	static int64_t nativePuts(const int64_t* args) {
+		return std::puts((const char*)(uintptr_t)args[0]);
+	}
+
+	static int64_t nativeMalloc(const int64_t* args) {
+		return (int64_t)(uintptr_t)std::malloc((size_t)args[0]);
+	}
+
+	static int64_t nativeFree(const int64_t* args) {
+		std::free((void*)(uintptr_t)args[0]);
+		return 0;
+	}
+
+	static int64_t signExtend(int64_t val, int width) {
+		if (width == 1) {
+			return val & 1;
+		}
+		if (width == 64) {
+			return val;
+		}
+		int shift = 64 - width;
+		return (int64_t)((uint64_t)val << shift) >> shift;
+	}
+
+	static uint64_t mask(int64_t val, int width) {
+		return width == 64 ? (uint64_t)val : (uint64_t)val & ((1ull << width) - 1);
+	}
+
+	[[noreturn]] static void trap(std::string_view why) {
+		throw SourceError(DiagId::VM_TRAP, why);
+	}
+
+	VmCompiler::Callee findCallee(std::string_view name) {
+		auto compiled = functionIndices.find(name);
+		if (compiled != functionIndices.end()) {
+			return { VmOp::CALL, compiled->second };
+		}
+
+		auto source = sources.find(name);
+		if (source != sources.end() && source->second->defined && name != "print") {
+			// Its index is known before it is compiled, so calls to it can be made while it is still pending
+			uint32_t index = (uint32_t)functions.size();
+			functions.emplace_back().name = name;
+			functionIndices[source->first] = index;
+			pending.push_back(index);
+			return { VmOp::CALL, index };
+		}
+
+		for (uint32_t i = 0; i < natives.size(); i++) {
+			if (natives[i].name == name) {
+				return { VmOp::NATIVE, i };
+			}
+		}
+
+		throw SourceError(DiagId::JIT_UNRESOLVED, name);
+	}
+
+	// Compiles the function called name and everything it can call
+	uint32_t compileReachable(std::string_view name) {
+		VmCompiler::Callee entry = findCallee(name);
+		if (entry.op != VmOp::CALL) {
+			throw SourceError(DiagId::JIT_UNRESOLVED, name);
+		}
+
+		while (!pending.empty()) {
+			uint32_t index = pending.back();
+			pending.pop_back();
+
+			FuncEmitter emitter;
+			emitter.optimize = optimize;
+			emitter.output = FuncEmitter::Output::NONE;
+			sources.at(functions[index].name)->emitFileScope(emitter);
+
+			VmFunction fn = VmCompiler(emitter.function, constants, argLists, [&](std::string_view callee) { return findCallee(callee); }).compile();
+			functions[index] = std::move(fn);
+		}
+
+		return entry.index;
+	}
+
+	int64_t execute(uint32_t entry, const std::vector<int64_t>& args) {
+		if (!registers) {
+			registers = std::make_unique<int64_t[]>(registerStackSize);
+			memory = std::make_unique<uint8_t[]>(memoryStackSize);
+			frames.reserve(maxCallDepth);
+		}
+
+		int64_t* const registersEnd = registers.get() + registerStackSize;
+		uint8_t* const memoryEnd = memory.get() + memoryStackSize;
+
+		const VmFunction* fn = &functions[entry];
+		int64_t* regs = registers.get();
+		uint8_t* mem = memory.get();
+		uint8_t* memTop = mem + fn->frameBytes;
+		int64_t val = 0;
+
+		if (args.size() != fn->argCount || regs + fn->registerCount > registersEnd || memTop > memoryEnd) {
+			trap("a bad call from the host");
+		}
+
+		std::copy(args.begin(), args.end(), regs);
+		std::copy(fn->constants.begin(), fn->constants.end(), regs + fn->argCount);
+
+		const VmInst* pc = fn->code.data();
+		frames.clear();
+
+#ifdef C1_COMPUTED_GOTO
+		static const void* const DISPATCH[] = {
+#define VM_LABEL(name) &&op_##name,
+			VM_OPS(VM_LABEL)
+#undef VM_LABEL
+		};
+
+#define VM_CASE(name) op_##name:
+#define VM_DISPATCH() goto *DISPATCH[(int)pc->op]
+#else
+#define VM_CASE(name) case VmOp::name:
+#define VM_DISPATCH() continue
+#endif
+
+#define VM_NEXT() pc++; VM_DISPATCH()
+#define R(field) regs[pc->field]
+
+#ifdef C1_COMPUTED_GOTO
+		VM_DISPATCH();
+#else
+		for (;;) {
+			switch (pc->op) {
+#endif
+
+		VM_CASE(MOV) R(dst) = R(a); VM_NEXT();
+		VM_CASE(ADDR) R(dst) = (int64_t)(uintptr_t)(mem + pc->c); VM_NEXT();
+		VM_CASE(ALLOCA) {
+			uint8_t* block = (uint8_t*)(((uintptr_t)memTop + 15) & ~(uintptr_t)15);
+			uint64_t bytes = (uint64_t)R(a) * (uint64_t)pc->c;
+			if (bytes > (uint64_t)(memoryEnd - block)) {
+				trap("stack overflow");
+			}
+			memTop = block + bytes;
+			R(dst) = (int64_t)(uintptr_t)block;
+			VM_NEXT();
+		}
+
+		VM_CASE(LOAD8) R(dst) = *(int8_t*)(uintptr_t)R(a); VM_NEXT();
+		VM_CASE(LOAD16) { int16_t v; std::memcpy(&v, (void*)(uintptr_t)R(a), 2); R(dst) = v; VM_NEXT(); }
+		VM_CASE(LOAD32) { int32_t v; std::memcpy(&v, (void*)(uintptr_t)R(a), 4); R(dst) = v; VM_NEXT(); }
+		VM_CASE(LOAD64) std::memcpy(&R(dst), (void*)(uintptr_t)R(a), 8); VM_NEXT();
+		VM_CASE(STORE8) *(int8_t*)(uintptr_t)R(b) = (int8_t)R(a); VM_NEXT();
+		VM_CASE(STORE16) { int16_t v = (int16_t)R(a); std::memcpy((void*)(uintptr_t)R(b), &v, 2); VM_NEXT(); }
+		VM_CASE(STORE32) { int32_t v = (int32_t)R(a); std::memcpy((void*)(uintptr_t)R(b), &v, 4); VM_NEXT(); }
+		VM_CASE(STORE64) std::memcpy((void*)(uintptr_t)R(b), &R(a), 8); VM_NEXT();
+
+		// Unsigned, so that overflow wraps as it does in the IR
+		VM_CASE(ADD32) R(dst) = (int32_t)((uint32_t)R(a) + (uint32_t)R(b)); VM_NEXT();
+		VM_CASE(SUB32) R(dst) = (int32_t)((uint32_t)R(a) - (uint32_t)R(b)); VM_NEXT();
+		VM_CASE(MUL32) R(dst) = (int32_t)((uint32_t)R(a) * (uint32_t)R(b)); VM_NEXT();
+		VM_CASE(SHL32) R(dst) = (int32_t)((uint32_t)R(a) << (R(b) & 31)); VM_NEXT();
+		VM_CASE(ASHR32) R(dst) = (int32_t)R(a) >> (R(b) & 31); VM_NEXT();
+		VM_CASE(SDIV32) {
+			int32_t a = (int32_t)R(a), b = (int32_t)R(b);
+			if (b == 0 || (a == INT32_MIN && b == -1)) {
+				trap("division overflow");
+			}
+			R(dst) = a / b;
+			VM_NEXT();
+		}
+		VM_CASE(SREM32) {
+			int32_t a = (int32_t)R(a), b = (int32_t)R(b);
+			if (b == 0 || (a == INT32_MIN && b == -1)) {
+				trap("division overflow");
+			}
+			R(dst) = a % b;
+			VM_NEXT();
+		}
+
+		VM_CASE(ADD64) R(dst) = (int64_t)((uint64_t)R(a) + (uint64_t)R(b)); VM_NEXT();
+		VM_CASE(SUB64) R(dst) = (int64_t)((uint64_t)R(a) - (uint64_t)R(b)); VM_NEXT();
+		VM_CASE(MUL64) R(dst) = (int64_t)((uint64_t)R(a) * (uint64_t)R(b)); VM_NEXT();
+		VM_CASE(SHL64) R(dst) = (int64_t)((uint64_t)R(a) << (R(b) & 63)); VM_NEXT();
+		VM_CASE(ASHR64) R(dst) = R(a) >> (R(b) & 63); VM_NEXT();
+		VM_CASE(SDIV64) {
+			if (R(b) == 0 || (R(a) == INT64_MIN && R(b) == -1)) {
+				trap("division overflow");
+			}
+			R(dst) = R(a) / R(b);
+			VM_NEXT();
+		}
+		VM_CASE(SREM64) {
+			if (R(b) == 0 || (R(a) == INT64_MIN && R(b) == -1)) {
+				trap("division overflow");
+			}
+			R(dst) = R(a) % R(b);
+			VM_NEXT();
+		}
+
+		VM_CASE(AND) R(dst) = R(a) & R(b); VM_NEXT();
+		VM_CASE(OR) R(dst) = R(a) | R(b); VM_NEXT();
+		VM_CASE(XOR) R(dst) = R(a) ^ R(b); VM_NEXT();
+		VM_CASE(LSHR) R(dst) = signExtend((int64_t)(mask(R(a), pc->width) >> (R(b) & (pc->width - 1))), pc->width); VM_NEXT();
+		VM_CASE(NORM) R(dst) = signExtend(R(a), pc->width); VM_NEXT();
+		VM_CASE(ZEXT) R(dst) = (int64_t)mask(R(a), pc->width); VM_NEXT();
+		VM_CASE(NEG) R(dst) = (int64_t)(0 - (uint64_t)R(a)); VM_NEXT();
+
+		VM_CASE(EQ) R(dst) = R(a) == R(b); VM_NEXT();
+		VM_CASE(NE) R(dst) = R(a) != R(b); VM_NEXT();
+		VM_CASE(SLT) R(dst) = R(a) < R(b); VM_NEXT();
+		VM_CASE(SLE) R(dst) = R(a) <= R(b); VM_NEXT();
+		VM_CASE(SGT) R(dst) = R(a) > R(b); VM_NEXT();
+		VM_CASE(SGE) R(dst) = R(a) >= R(b); VM_NEXT();
+		VM_CASE(ULT) R(dst) = mask(R(a), pc->width) < mask(R(b), pc->width); VM_NEXT();
+		VM_CASE(ULE) R(dst) = mask(R(a), pc->width) <= mask(R(b), pc->width); VM_NEXT();
+		VM_CASE(UGT) R(dst) = mask(R(a), pc->width) > mask(R(b), pc->width); VM_NEXT();
+		VM_CASE(UGE) R(dst) = mask(R(a), pc->width) >= mask(R(b), pc->width); VM_NEXT();
+
+		VM_CASE(ADDI) R(dst) = (int64_t)((uint64_t)R(a) + (uint64_t)(int64_t)pc->c); VM_NEXT();
+		VM_CASE(MADD) R(dst) = (int64_t)((uint64_t)R(a) + (uint64_t)R(b) * (uint64_t)(int64_t)pc->c); VM_NEXT();
+
+		VM_CASE(CALL) {
+			const VmFunction* callee = &functions[pc->a];
+			int64_t* calleeRegs = regs + fn->registerCount;
+			uint8_t* calleeMem = (uint8_t*)(((uintptr_t)memTop + 15) & ~(uintptr_t)15);
+
+			if (frames.size() == maxCallDepth || calleeRegs + callee->registerCount > registersEnd ||
+				callee->frameBytes > (size_t)(memoryEnd - calleeMem)) {
+				trap("stack overflow");
+			}
+
+			const uint32_t* args = argLists.data() + pc->b;
+			for (int32_t i = 0; i < pc->c; i++) {
+				calleeRegs[i] = regs[args[i]];
+			}
+			std::copy(callee->constants.begin(), callee->constants.end(), calleeRegs + callee->argCount);
+
+			frames.push_back({ fn, pc, regs, mem, memTop });
+
+			fn = callee;
+			regs = calleeRegs;
+			mem = calleeMem;
+			memTop = calleeMem + callee->frameBytes;
+			pc = callee->code.data();
+			VM_DISPATCH();
+		}
+
+		VM_CASE(NATIVE) {
+			int64_t args[VmCompiler::MAX_NATIVE_ARGS];
+			for (int32_t i = 0; i < pc->c; i++) {
+				args[i] = regs[argLists[pc->b + i]];
+			}
+
+			int64_t ret = natives[pc->a].fn(args);
+			if (pc->dst != UINT32_MAX) {
+				R(dst) = ret;
+			}
+			VM_NEXT();
+		}
+
+		VM_CASE(JMP) pc = fn->code.data() + pc->b; VM_DISPATCH();
+		VM_CASE(BR) pc = fn->code.data() + (R(a) ? pc->b : (uint32_t)pc->c); VM_DISPATCH();
+
+		VM_CASE(RET) val = R(a); goto doReturn;
+		VM_CASE(RETV) val = 0; goto doReturn;
+
+		doReturn: {
+			if (frames.empty()) {
+				return val;
+			}
+
+			Frame& caller = frames.back();
+			fn = caller.fn;
+			pc = caller.pc;
+			regs = caller.regs;
+			mem = caller.mem;
+			memTop = caller.memTop;
+			frames.pop_back();
+
+			if (pc->dst != UINT32_MAX) {
+				R(dst) = val;
+			}
+			VM_NEXT();
+		}
+
+#ifndef C1_COMPUTED_GOTO
+			}
+		}
+#endif
+
+#undef R
+#undef VM_NEXT
+#undef VM_DISPATCH
+#undef VM_CASE
+	}
+
+public:
+	Vm() {
+		addNative("print", &nativePrint);
+		addNative("puts", &nativePuts);
+		addNative("malloc", &nativeMalloc);
+		addNative("free", &nativeFree);
+	}
+
+	// Calls to a function the program declares but doesn't define go to the native of the same name
+	void addNative(std::string name, Native fn) {
+		natives.push_back({ std::move(name), fn });
+	}
+
+	// Makes the functions of global callable
+	void load(Scope* global) {
+		// Memory is laid out as on x86-64, and pointers are the compiler's own
+		if (types().primitiveTable().pointerWidth != 64 || sizeof(void*) != 8) {
+			throw SourceError(DiagId::VM_UNSUPPORTED, "code without 64 bit pointers");
+		}
+
+		for (auto& i : global->getFunctions()) {
+			auto& fn = sources[i->mangleName()];
+			if (!fn || i->defined) {
+				fn = i;
+			}
+		}
+	}
+
+	// Calls the function with this mangled name, compiling it first if it hasn't been
+	int64_t call(std::string_view name, const std::vector<int64_t>& args = {}) {
+		int64_t ret = execute(compileReachable(name), args);
+		fflush(stdout);
+		return ret;
+	}
+
+	// Returns what main returns
+	int run(Scope* global) {
+		load(global);
+		return (int)call("main");
+	}
+};
+
+#endif // ifndef COMPILER_VM_H
@@ -0,0 +1,859 @@
+#ifndef COMPILER_X86_H
+#define COMPILER_X86_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+
+#include "error.h"
+#include "outputBuffer.h"
+#include "llvmType.h"
+#include "ir.h"
+
+// Sizes and alignments of the LLVM types the x86-64 backend can lay out, as the System V ABI has them
+struct X86Layout {
+	static int sizeOf(LlvmType* type) {
+		switch (type->kind) {
+		case LlvmType::Kind::INT: {
+			int width = static_cast<LlvmTypeInt*>(type)->width;
+			return width <= 8 ? 1 : width <= 16 ? 2 : width <= 32 ? 4 : 8;
+		}
+		case LlvmType::Kind::POINTER:
+			return 8;
+		case LlvmType::Kind::ARRAY: {
+			auto array = static_cast<LlvmTypeArray*>(type);
+			return array->size * sizeOf(array->dataType);
+		}
+		case LlvmType::Kind::LITERAL_STRUCT:
+		case LlvmType::Kind::IDENTIFIED_STRUCT: {
+			int size = 0;
+			for (auto& i : members(type)) {
+				size = alignUp(size, alignOf(i)) + sizeOf(i);
+			}
+			return alignUp(size, alignOf(type));
+		}
+		default:
+			throw SourceError(DiagId::ASM_UNSUPPORTED, type->name());
+		}
+	}
+
+	static int alignOf(LlvmType* type) {
+		switch (type->kind) {
+		case LlvmType::Kind::ARRAY:
+			return alignOf(static_cast<LlvmTypeArray*>(type)->dataType);
+		case LlvmType::Kind::LITERAL_STRUCT:
+		case LlvmType::Kind::IDENTIFIED_STRUCT: {
+			int align = 1;
+			for (auto& i : members(type)) {
+				align = std::max(align, alignOf(i));
+			}
+			return align;
+		}
+		default:
+			return sizeOf(type);
+		}
+	}
+
+	// Bytes from the start of a struct to its indexth member
+	static int offsetOf(LlvmType* type, int64_t index) {
+		const std::vector<LlvmType*>& fields = members(type);
+
+		int offset = 0;
+		for (int64_t i = 0; i < index; i++) {
+			offset = alignUp(offset, alignOf(fields[i])) + sizeOf(fields[i]);
+		}
+		return alignUp(offset, alignOf(fields[index]));
+	}
+
+	static const std::vector<LlvmType*>& members(LlvmType* type) {
+		if (type->kind == LlvmType::Kind::IDENTIFIED_STRUCT) {
+			auto body = static_cast<LlvmTypeIdentifiedStruct*>(type)->type;
+			if (!body) {
+				throw SourceError(DiagId::ASM_UNSUPPORTED, type->name());
+			}
+			return body->members;
+		}
+		return static_cast<LlvmTypeLiteralStruct*>(type)->members;
+	}
+
+	static int alignUp(int val, int align) {
+		return (val + align - 1) / align * align;
+	}
+};
+
+enum class X86Reg : int8_t {
+	RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+	R8, R9, R10, R11, R12, R13, R14, R15,
+	NONE = -1
+};
+
+// Numbered as they are encoded in jcc and setcc
+enum class X86Cond : uint8_t {
+	O, NO, B, AE, E, NE, BE, A, S, NS, P, NP, L, GE, LE, G
+};
+constexpr std::string_view X86_COND_STR[] = {
+	"o", "no", "b", "ae", "e", "ne", "be", "a", "s", "ns", "p", "np", "l", "ge", "le", "g"
+};
+
+struct X86Operand {
+	enum class Kind : uint8_t {
+		NONE,
+		REG,
+		IMM,
+		MEM, // value(%reg)
+		SYMBOL, // A function to call, or a string constant addressed relative to rip
+		LABEL // A block of the same function
+	};
+
+	Kind kind = Kind::NONE;
+	X86Reg reg = X86Reg::NONE; // Register, or base of a memory operand
+	int64_t value = 0; // Immediate, or displacement of a memory operand
+	std::string_view symbol; // Owned by the function called or the constant pool
+	Operand label;
+
+	static X86Operand r(X86Reg reg) {
+		return { Kind::REG, reg, 0, {}, {} };
+	}
+
+	static X86Operand imm(int64_t val) {
+		return { Kind::IMM, X86Reg::NONE, val, {}, {} };
+	}
+
+	static X86Operand mem(X86Reg base, int64_t disp) {
+		return { Kind::MEM, base, disp, {}, {} };
+	}
+
+	static X86Operand sym(std::string_view name) {
+		return { Kind::SYMBOL, X86Reg::NONE, 0, name, {} };
+	}
+
+	static X86Operand block(Operand label) {
+		return { Kind::LABEL, X86Reg::NONE, 0, {}, label };
+	}
+};
+
+// One machine instruction, with its operands in AT&T order
+// An instruction with one operand keeps it in dst
+struct X86Inst {
+	enum class Op : uint8_t {
+		LABEL, // Starts the block dst
+		MOV,
+		MOVSX, // Extends fromSize bytes to size
+		MOVZX,
+		LEA,
+		ADD,
+		SUB,
+		AND,
+		OR,
+		XOR,
+		CMP,
+		TEST,
+		IMUL,
+		SHL, // Shifts by cl
+		SAR,
+		SHR,
+		NEG,
+		IDIV, // Divides dx:ax by dst
+		CONVERT, // Sign extends ax into dx:ax, cltd or cqto
+		SETCC,
+		PUSH,
+		POP,
+		CALL,
+		JMP,
+		JCC,
+		RET
+	};
+
+	Op op;
+	uint8_t size = 8; // Bytes operated on
+	uint8_t fromSize = 0;
+	X86Cond cond = X86Cond::O;
+	X86Operand src;
+	X86Operand dst;
+};
+
+// A function lowered to machine instructions, which can be printed as assembly or encoded
+struct X86Function {
+	std::string name;
+	std::vector<X86Inst> code;
+
+	// Every symbol called, in order
+	std::vector<std::string_view> callees() const {
+		std::vector<std::string_view> out;
+		for (auto& i : code) {
+			if (i.op == X86Inst::Op::CALL) {
+				out.push_back(i.dst.symbol);
+			}
+		}
+		return out;
+	}
+};
+
+// Lowers a function to x86-64 instructions for the System V ABI
+// Values are given callee-saved registers by a linear scan over the instructions in order, which is exact
+// since branches only go forward, and the ones that don't get a register are kept in stack slots
+// Each instruction loads its operands into rax, rcx and rdx, so those are never allocated
+class X86Writer {
+	using enum X86Reg;
+	using Op = X86Inst::Op;
+
+	constexpr static X86Reg ARGUMENT_REGS[] = { RDI, RSI, RDX, RCX, R8, R9 };
+	constexpr static X86Reg ALLOCATABLE_REGS[] = { RBX, R12, R13, R14, R15 };
+
+	struct Value {
+		int start;
+		int end; // Position of the last instruction that reads it
+		int size;
+		X86Reg reg = NONE;
+		int slot = 0; // Bytes below the saved registers, if it has no register
+	};
+
+	const IrFunction& fn;
+	X86Function out;
+
+	std::unordered_map<Operand, Value, OperandHash> values;
+
+	// Allocas with a fixed size live in the frame, at these depths below the saved registers
+	std::unordered_map<Operand, int, OperandHash> allocas;
+
+	std::vector<X86Reg> saved;
+	int frameDepth = 0;
+
+	static int sizeOf(LlvmType* type) {
+		return X86Layout::sizeOf(type);
+	}
+
+	// Registers hold at least 4 bytes of a value being computed on
+	static int widen(int size) {
+		return std::max(size, 4);
+	}
+
+	static X86Operand r(X86Reg reg) {
+		return X86Operand::r(reg);
+	}
+
+	static X86Operand imm(int64_t val) {
+		return X86Operand::imm(val);
+	}
+
+	void emit(Op op, int size, X86Operand src, X86Operand dst) {
+		out.code.push_back({ op, (uint8_t)size, 0, X86Cond::O, src, dst });
+	}
+
+	void emit(Op op, int size, X86Operand dst) {
+		emit(op, size, {}, dst);
+	}
+
+	void mov(int size, X86Operand src, X86Operand dst) {
+		emit(Op::MOV, size, src, dst);
+	}
+
+	int allocateSlot(int size, int align) {
+		frameDepth = X86Layout::alignUp(frameDepth + size, align);
+		return frameDepth;
+	}
+
+	X86Operand frameAddress(int depth) {
+		return X86Operand::mem(RBP, -(int64_t)(saved.size() * 8 + depth));
+	}
+
+	X86Operand location(const Value& value) {
+		return value.reg != NONE ? r(value.reg) : frameAddress(value.slot);
+	}
+
+	const Value& valueOf(const Operand& op) {
+		auto value = values.find(op);
+		if (value == values.end()) {
+			throw SourceError(DiagId::ASM_UNSUPPORTED, "a value used before it is made");
+		}
+		return value->second;
+	}
+
+	// Moves op, of size bytes, into reg as toSize bytes, extending it with or without its sign
+	void load(X86Reg reg, const Operand& op, int size, int toSize, bool sign = true) {
+		switch (op.kind) {
+		case Operand::Kind::CONSTANT:
+		case Operand::Kind::BOOL:
+			mov(toSize, imm(op.value), r(reg));
+			return;
+		case Operand::Kind::STRING:
+			emit(Op::LEA, 8, X86Operand::sym(op.name), r(reg));
+			return;
+		default:
+			break;
+		}
+
+		auto alloca = allocas.find(op);
+		if (alloca != allocas.end()) {
+			emit(Op::LEA, 8, frameAddress(alloca->second), r(reg));
+			return;
+		}
+
+		const Value& value = valueOf(op);
+
+		// Little endian, so the low bytes of a slot are at its address
+		if (toSize <= size) {
+			if (value.reg != reg) {
+				mov(toSize, location(value), r(reg));
+			}
+		}
+		// Writing the low half of a register clears the rest
+		else if (size == 4 && !sign) {
+			mov(4, location(value), r(reg));
+		}
+		else {
+			out.code.push_back({ sign ? Op::MOVSX : Op::MOVZX, (uint8_t)toSize, (uint8_t)size, X86Cond::O, location(value), r(reg) });
+		}
+	}
+
+	void store(X86Reg reg, const Operand& result, int size) {
+		const Value& value = valueOf(result);
+		if (value.reg != reg) {
+			mov(size, r(reg), location(value));
+		}
+	}
+
+	// Where a load or store goes: straight into the frame for an alloca, or through rcx
+	X86Operand memoryOperand(const Operand& addr) {
+		auto alloca = allocas.find(addr);
+		return alloca != allocas.end() ? frameAddress(alloca->second) : X86Operand::mem(RCX, 0);
+	}
+
+	void loadAddress(const Operand& addr) {
+		if (!allocas.contains(addr)) {
+			load(RCX, addr, 8, 8);
+		}
+	}
+
+	// Finds where each value is made and last read, and gives each a register or a slot
+	void allocate() {
+		for (auto& i : fn.arguments) {
+			values[i.value] = { -1, -1, sizeOf(i.type) };
+		}
+
+		int pos = 0;
+		for (auto& block : fn.blocks) {
+			for (auto& inst : block.instructions) {
+				const IrOperand* ops = fn.operandsOf(inst);
+
+				for (uint32_t i = 0; i < inst.operandCount; i++) {
+					auto value = values.find(ops[i].value);
+					if (value != values.end()) {
+						value->second.end = pos;
+					}
+				}
+
+				if (inst.op == IrInstruction::Op::ALLOCA && inst.operandCount == 0) {
+					allocas[inst.result] = allocateSlot(sizeOf(inst.type), X86Layout::alignOf(inst.type));
+				}
+				else if (inst.result.kind != Operand::Kind::NONE) {
+					int size = inst.op == IrInstruction::Op::ICMP ? 1 :
+						inst.op == IrInstruction::Op::ALLOCA || inst.op == IrInstruction::Op::GEP ? 8 : sizeOf(inst.type);
+					values[inst.result] = { pos, pos, size };
+				}
+
+				pos++;
+			}
+		}
+
+		std::vector<Value*> intervals;
+		for (auto& [op, value] : values) {
+			intervals.push_back(&value);
+		}
+		std::sort(intervals.begin(), intervals.end(), [](Value* a, Value* b) {
+			return a->start != b->start ? a->start < b->start : a->end < b->end;
+		});
+
+		std::vector<Value*> active;
+		std::vector<X86Reg> free(std::rbegin(ALLOCATABLE_REGS), std::rend(ALLOCATABLE_REGS));
+
+		for (auto& cur : intervals) {
+			// Registers of values that are no longer read are free again
+			// A value last read by the instruction that makes cur can share its register, since operands are read first
+			for (size_t i = 0; i < active.size();) {
+				if (active[i]->end <= cur->start && active[i]->end < cur->end) {
+					free.push_back(active[i]->reg);
+					active.erase(active.begin() + i);
+				}
+				else {
+					i++;
+				}
+			}
+
+			if (!free.empty()) {
+				cur->reg = free.back();
+				free.pop_back();
+				active.push_back(cur);
+				continue;
+			}
+
+			// Out of registers, so whichever value is needed for longest goes to the stack
+			auto longest = std::max_element(active.begin(), active.end(), [](Value* a, Value* b) { return a->end < b->end; });
+			if ((*longest)->end > cur->end) {
+				cur->reg = (*longest)->reg;
+				(*longest)->reg = NONE;
+				(*longest)->slot = allocateSlot(8, 8);
+				*longest = cur;
+			}
+			else {
+				cur->slot = allocateSlot(8, 8);
+			}
+		}
+
+		for (auto& i : ALLOCATABLE_REGS) {
+			if (std::any_of(values.begin(), values.end(), [&](auto& value) { return value.second.reg == i; })) {
+				saved.push_back(i);
+			}
+		}
+	}
+
+	void prologue() {
+		emit(Op::PUSH, 8, r(RBP));
+		mov(8, r(RSP), r(RBP));
+
+		for (auto& i : saved) {
+			emit(Op::PUSH, 8, r(i));
+		}
+
+		// Calls need the stack 16 byte aligned, which it was before the return address and rbp were pushed
+		int frame = X86Layout::alignUp(frameDepth + (int)saved.size() * 8, 16) - (int)saved.size() * 8;
+		if (frame) {
+			emit(Op::SUB, 8, imm(frame), r(RSP));
+		}
+
+		for (size_t i = 0; i < fn.arguments.size(); i++) {
+			const Value& value = valueOf(fn.arguments[i].value);
+
+			if (i < std::size(ARGUMENT_REGS)) {
+				mov(value.size, r(ARGUMENT_REGS[i]), location(value));
+			}
+			else {
+				mov(8, X86Operand::mem(RBP, 16 + (i - std::size(ARGUMENT_REGS)) * 8), r(RAX));
+				mov(value.size, r(RAX), location(value));
+			}
+		}
+	}
+
+	void epilogue() {
+		emit(Op::LEA, 8, frameAddress(0), r(RSP));
+
+		for (auto i = saved.rbegin(); i != saved.rend(); i++) {
+			emit(Op::POP, 8, r(*i));
+		}
+
+		emit(Op::POP, 8, r(RBP));
+		emit(Op::RET, 8, {});
+	}
+
+	void binary(const IrInstruction& inst, const IrOperand* ops) {
+		constexpr std::pair<std::string_view, Op> OPS[] = {
+			{ "add", Op::ADD }, { "sub", Op::SUB }, { "and", Op::AND }, { "or", Op::OR }, { "xor", Op::XOR },
+			{ "mul", Op::IMUL }, { "shl", Op::SHL }, { "ashr", Op::SAR }, { "lshr", Op::SHR },
+		};
+
+		int size = sizeOf(inst.type);
+		int opSize = widen(size);
+
+		// "add nsw" is an add, the flags only matter to LLVM's optimizer
+		std::string_view opcode = inst.opcode.substr(0, inst.opcode.find(' '));
+
+		load(RAX, ops[0].value, size, opSize);
+		load(RCX, ops[1].value, size, opSize);
+
+		X86Reg result = RAX;
+
+		auto op = std::find_if(std::begin(OPS), std::end(OPS), [&](auto& i) { return i.first == opcode; });
+		if (op != std::end(OPS)) {
+			emit(op->second, opSize, r(RCX), r(RAX));
+		}
+		else if (opcode == "sdiv" || opcode == "srem") {
+			emit(Op::CONVERT, opSize, {});
+			emit(Op::IDIV, opSize, r(RCX));
+			result = opcode == "srem" ? RDX : RAX;
+		}
+		else {
+			throw SourceError(DiagId::ASM_UNSUPPORTED, opcode);
+		}
+
+		store(result, inst.result, size);
+	}
+
+	void icmp(const IrInstruction& inst, const IrOperand* ops) {
+		constexpr std::pair<std::string_view, X86Cond> CONDITIONS[] = {
+			{ "eq", X86Cond::E }, { "ne", X86Cond::NE },
+			{ "slt", X86Cond::L }, { "sle", X86Cond::LE }, { "sgt", X86Cond::G }, { "sge", X86Cond::GE },
+			{ "ult", X86Cond::B }, { "ule", X86Cond::BE }, { "ugt", X86Cond::A }, { "uge", X86Cond::AE },
+		};
+
+		auto condition = std::find_if(std::begin(CONDITIONS), std::end(CONDITIONS), [&](auto& i) { return i.first == inst.opcode; });
+		if (condition == std::end(CONDITIONS)) {
+			throw SourceError(DiagId::ASM_UNSUPPORTED, inst.opcode);
+		}
+
+		int size = sizeOf(inst.type);
+		int opSize = widen(size);
+		bool sign = inst.opcode[0] != 'u';
+
+		load(RAX, ops[0].value, size, opSize, sign);
+		load(RCX, ops[1].value, size, opSize, sign);
+
+		emit(Op::CMP, opSize, r(RCX), r(RAX));
+		out.code.push_back({ Op::SETCC, 1, 0, condition->second, {}, r(RAX) });
+
+		store(RAX, inst.result, 1);
+	}
+
+	void cast(const IrInstruction& inst, const IrOperand* ops) {
+		int from = sizeOf(ops[0].type);
+		int to = sizeOf(inst.type);
+		bool fromBit = ops[0].type->kind == LlvmType::Kind::INT && static_cast<LlvmTypeInt*>(ops[0].type)->width == 1;
+		bool toBit = inst.type->kind == LlvmType::Kind::INT && static_cast<LlvmTypeInt*>(inst.type)->width == 1;
+
+		if (inst.opcode == "sext") {
+			load(RAX, ops[0].value, from, widen(to), !fromBit);
+
+			// An i1 is kept as 0 or 1, whose sign bit is the bit itself
+			if (fromBit) {
+				emit(Op::NEG, widen(to), r(RAX));
+			}
+		}
+		else if (inst.opcode == "zext" || inst.opcode == "inttoptr" || inst.opcode == "ptrtoint" || inst.opcode == "bitcast") {
+			load(RAX, ops[0].value, from, std::max(widen(to), from), false);
+		}
+		else if (inst.opcode == "trunc") {
+			load(RAX, ops[0].value, from, widen(to));
+
+			if (toBit) {
+				emit(Op::AND, 4, imm(1), r(RAX));
+			}
+		}
+		else {
+			throw SourceError(DiagId::ASM_UNSUPPORTED, inst.opcode);
+		}
+
+		store(RAX, inst.result, to);
+	}
+
+	void gep(const IrInstruction& inst, const IrOperand* ops) {
+		load(RAX, ops[0].value, 8, 8);
+
+		LlvmType* type = inst.type;
+
+		for (uint32_t i = 1; i < inst.operandCount; i++) {
+			const Operand& index = ops[i].value;
+
+			if (i > 1 && (type->kind == LlvmType::Kind::IDENTIFIED_STRUCT || type->kind == LlvmType::Kind::LITERAL_STRUCT)) {
+				// Struct members are always indexed by a constant
+				int offset = X86Layout::offsetOf(type, index.value);
+				if (offset) {
+					emit(Op::ADD, 8, imm(offset), r(RAX));
+				}
+				type = X86Layout::members(type)[index.value];
+				continue;
+			}
+
+			if (i > 1) {
+				if (type->kind != LlvmType::Kind::ARRAY) {
+					throw SourceError(DiagId::ASM_UNSUPPORTED, type->name());
+				}
+				type = static_cast<LlvmTypeArray*>(type)->dataType;
+			}
+
+			int scale = sizeOf(type);
+
+			if (index.kind == Operand::Kind::CONSTANT) {
+				if (index.value) {
+					emit(Op::ADD, 8, imm(index.value * scale), r(RAX));
+				}
+			}
+			else {
+				load(RCX, index, sizeOf(ops[i].type), 8);
+				emit(Op::IMUL, 8, imm(scale), r(RCX));
+				emit(Op::ADD, 8, r(RCX), r(RAX));
+			}
+		}
+
+		store(RAX, inst.result, 8);
+	}
+
+	void call(const IrInstruction& inst, const IrOperand* ops) {
+		uint32_t onStack = inst.operandCount > std::size(ARGUMENT_REGS) ? inst.operandCount - (uint32_t)std::size(ARGUMENT_REGS) : 0;
+		uint32_t padding = onStack % 2 ? 8 : 0;
+
+		if (padding) {
+			emit(Op::SUB, 8, imm(padding), r(RSP));
+		}
+
+		for (uint32_t i = inst.operandCount; i-- > std::size(ARGUMENT_REGS);) {
+			load(RAX, ops[i].value, sizeOf(ops[i].type), 8);
+			emit(Op::PUSH, 8, r(RAX));
+		}
+
+		// Arguments smaller than an int are extended to one by the caller
+		for (uint32_t i = 0; i < inst.operandCount && i < std::size(ARGUMENT_REGS); i++) {
+			int size = sizeOf(ops[i].type);
+			load(ARGUMENT_REGS[i], ops[i].value, size, widen(size));
+		}
+
+		// Variadic callees read the number of vector registers used from al
+		emit(Op::XOR, 4, r(RAX), r(RAX));
+		emit(Op::CALL, 8, X86Operand::sym(inst.opcode));
+
+		if (onStack) {
+			emit(Op::ADD, 8, imm(onStack * 8 + padding), r(RSP));
+		}
+
+		if (inst.result.kind != Operand::Kind::NONE) {
+			store(RAX, inst.result, sizeOf(inst.type));
+		}
+	}
+
+	void instruction(const IrInstruction& inst) {
+		using IrOp = IrInstruction::Op;
+
+		const IrOperand* ops = fn.operandsOf(inst);
+
+		switch (inst.op) {
+		case IrOp::ALLOCA:
+			// Only an alloca of a number of elements takes any code, the rest are laid out in the frame
+			if (inst.operandCount) {
+				load(RAX, ops[0].value, sizeOf(ops[0].type), 8);
+				emit(Op::IMUL, 8, imm(sizeOf(inst.type)), r(RAX));
+				emit(Op::ADD, 8, imm(15), r(RAX));
+				emit(Op::AND, 8, imm(-16), r(RAX));
+				emit(Op::SUB, 8, r(RAX), r(RSP));
+				mov(8, r(RSP), r(RAX));
+				store(RAX, inst.result, 8);
+			}
+			break;
+		case IrOp::LOAD: {
+			int size = sizeOf(inst.type);
+			if (size > 8) {
+				throw SourceError(DiagId::ASM_UNSUPPORTED, inst.type->name());
+			}
+
+			loadAddress(ops[0].value);
+			mov(size, memoryOperand(ops[0].value), r(RAX));
+			store(RAX, inst.result, size);
+			break;
+		}
+		case IrOp::STORE: {
+			int size = sizeOf(ops[0].type);
+			if (size > 8) {
+				throw SourceError(DiagId::ASM_UNSUPPORTED, ops[0].type->name());
+			}
+
+			load(RAX, ops[0].value, size, size);
+			loadAddress(ops[1].value);
+			mov(size, r(RAX), memoryOperand(ops[1].value));
+			break;
+		}
+		case IrOp::BINARY:
+			binary(inst, ops);
+			break;
+		case IrOp::ICMP:
+			icmp(inst, ops);
+			break;
+		case IrOp::CAST:
+			cast(inst, ops);
+			break;
+		case IrOp::GEP:
+			gep(inst, ops);
+			break;
+		case IrOp::CALL:
+			call(inst, ops);
+			break;
+		case IrOp::BR:
+			emit(Op::JMP, 8, X86Operand::block(ops[0].value));
+			break;
+		case IrOp::COND_BR:
+			load(RAX, ops[0].value, 1, 1);
+			emit(Op::TEST, 1, r(RAX), r(RAX));
+			out.code.push_back({ Op::JCC, 8, 0, X86Cond::NE, {}, X86Operand::block(ops[1].value) });
+			emit(Op::JMP, 8, X86Operand::block(ops[2].value));
+			break;
+		case IrOp::RET:
+			if (inst.operandCount) {
+				int size = sizeOf(ops[0].type);
+				load(RAX, ops[0].value, size, widen(size));
+			}
+			epilogue();
+			break;
+		}
+	}
+
+public:
+	X86Writer(const IrFunction& fn_) : fn(fn_) {}
+
+	X86Function write() {
+		out.name = fn.name;
+
+		allocate();
+		prologue();
+
+		for (auto& block : fn.blocks) {
+			if (block.label.kind != Operand::Kind::NONE) {
+				emit(Op::LABEL, 8, X86Operand::block(block.label));
+			}
+
+			for (auto& i : block.instructions) {
+				instruction(i);
+			}
+		}
+
+		return std::move(out);
+	}
+};
+
+// Writes an X86Function as GNU syntax assembly
+// Blocks are .L<function>.<label>, string constants .L<name>, and calls go through the PLT
+class X86Printer {
+	using Op = X86Inst::Op;
+
+	// By register and then by size: 1, 2, 4 and 8 bytes
+	constexpr static std::string_view REG_NAMES[16][4] = {
+		{ "%al", "%ax", "%eax", "%rax" },
+		{ "%cl", "%cx", "%ecx", "%rcx" },
+		{ "%dl", "%dx", "%edx", "%rdx" },
+		{ "%bl", "%bx", "%ebx", "%rbx" },
+		{ "%spl", "%sp", "%esp", "%rsp" },
+		{ "%bpl", "%bp", "%ebp", "%rbp" },
+		{ "%sil", "%si", "%esi", "%rsi" },
+		{ "%dil", "%di", "%edi", "%rdi" },
+		{ "%r8b", "%r8w", "%r8d", "%r8" },
+		{ "%r9b", "%r9w", "%r9d", "%r9" },
+		{ "%r10b", "%r10w", "%r10d", "%r10" },
+		{ "%r11b", "%r11w", "%r11d", "%r11" },
+		{ "%r12b", "%r12w", "%r12d", "%r12" },
+		{ "%r13b", "%r13w", "%r13d", "%r13" },
+		{ "%r14b", "%r14w", "%r14d", "%r14" },
+		{ "%r15b", "%r15w", "%r15d", "%r15" },
+	};
+
+	constexpr static std::string_view MNEMONICS[] = {
+		"", "mov", "movs", "movz", "lea", "add", "sub", "and", "or", "xor", "cmp", "test", "imul",
+		"shl", "sar", "shr", "neg", "idiv", "", "set", "push", "pop", "call", "jmp", "j", "ret"
+	};
+
+	OutputBuffer& out;
+	const X86Function& fn;
+
+	static int sizeIndex(int size) {
+		return size == 1 ? 0 : size == 2 ? 1 : size == 4 ? 2 : 3;
+	}
+
+	static char suffix(int size) {
+		return "bwlq"[sizeIndex(size)];
+	}
+
+	void operand(const X86Operand& op, int size, bool call) {
+		switch (op.kind) {
+		case X86Operand::Kind::NONE:
+			break;
+		case X86Operand::Kind::REG:
+			out << REG_NAMES[(int)op.reg][sizeIndex(size)];
+			break;
+		case X86Operand::Kind::IMM:
+			out << '$' << op.value;
+			break;
+		case X86Operand::Kind::MEM:
+			if (op.value) {
+				out << op.value;
+			}
+			out << '(' << REG_NAMES[(int)op.reg][3] << ')';
+			break;
+		case X86Operand::Kind::SYMBOL:
+			if (call) {
+				out << op.symbol << "@PLT";
+			}
+			else {
+				// @.str.N is .L.str.N, local to the object file
+				out << ".L" << op.symbol.substr(1) << "(%rip)";
+			}
+			break;
+		case X86Operand::Kind::LABEL:
+			out << ".L" << fn.name << '.';
+			op.label.writeTo(out, false);
+			break;
+		}
+	}
+
+	void instruction(const X86Inst& inst) {
+		if (inst.op == Op::LABEL) {
+			operand(inst.dst, 8, false);
+			out << ":\n";
+			return;
+		}
+
+		out << '\t';
+
+		switch (inst.op) {
+		case Op::MOV:
+			if (inst.size == 8 && inst.src.kind == X86Operand::Kind::IMM && (inst.src.value < INT32_MIN || inst.src.value > INT32_MAX)) {
+				out << "movabsq";
+			}
+			else {
+				out << "mov" << suffix(inst.size);
+			}
+			break;
+		case Op::MOVSX:
+		case Op::MOVZX:
+			out << MNEMONICS[(int)inst.op] << suffix(inst.fromSize) << suffix(inst.size);
+			break;
+		case Op::CONVERT:
+			out << (inst.size == 8 ? "cqto" : "cltd");
+			break;
+		case Op::SETCC:
+		case Op::JCC:
+			out << MNEMONICS[(int)inst.op] << X86_COND_STR[(int)inst.cond];
+			break;
+		case Op::CALL:
+		case Op::JMP:
+		case Op::RET:
+			out << MNEMONICS[(int)inst.op];
+			break;
+		default:
+			out << MNEMONICS[(int)inst.op] << suffix(inst.size);
+			break;
+		}
+
+		// Shifts count in cl, and extensions read the smaller size
+		int srcSize = inst.op == Op::MOVSX || inst.op == Op::MOVZX ? inst.fromSize :
+			inst.op == Op::SHL || inst.op == Op::SAR || inst.op == Op::SHR ? 1 : inst.size;
+
+		bool call = inst.op == Op::CALL;
+
+		if (inst.src.kind != X86Operand::Kind::NONE) {
+			out << ' ';
+			operand(inst.src, srcSize, call);
+			out << ',';
+		}
+
+		if (inst.dst.kind != X86Operand::Kind::NONE) {
+			out << ' ';
+			operand(inst.dst, inst.size, call);
+		}
+
+		out << '\n';
+	}
+
+public:
+	X86Printer(OutputBuffer& out_, const X86Function& fn_) : out(out_), fn(fn_) {}
+
+	void print() {
+		out << "\t.globl " << fn.name << '\n'
+			<< "\t.type " << fn.name << ", @function\n"
+			<< fn.name << ":\n";
+
+		for (auto& i : fn.code) {
+			instruction(i);
+		}
+
+		out << "\t.size " << fn.name << ", .-" << fn.name << "\n\n";
+	}
+};
+
+#endif // ifndef COMPILER_X86_H
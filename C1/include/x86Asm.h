@@ -0,0 +1,129 @@
+#ifndef COMPILER_X86ASM_H
+#define COMPILER_X86ASM_H
+
+#include <string>
+#include <string_view>
+
+#include "type.h"
+#include "function.h"
+#include "outputSink.h"
+#include "process.h"
+#include "constantPool.h"
+#include "x86.h"
+
+// Writes the module as GNU syntax x86-64 assembly, so that as and ld can build it without LLVM
+// Only for System V targets with 64 bit pointers, and only as far as X86Writer can lower each function
+class X86AsmGenerator {
+public:
+	OutputBuffer out;
+	std::string_view origFile;
+
+	OutputSink sink;
+	std::string outName;
+
+	// Run the IR passes on each function before it is written
+	bool optimize = false;
+
+	// String constants the functions refer to
+	ConstantPool* constants = nullptr;
+
+	// If set, the assembly is written into this process's stdin instead of a file
+	ChildProcess* pipeTo = nullptr;
+
+	X86AsmGenerator(std::string_view origFile_) : origFile(origFile_) {}
+
+	void generate(std::string_view outFileName, Scope* global) {
+		if (targetPlatform != Platform::LINUX) {
+			throw SourceError(DiagId::ASM_UNSUPPORTED, "code for Windows");
+		}
+		if (types().primitiveTable().pointerWidth != 64) {
+			throw SourceError(DiagId::ASM_UNSUPPORTED, "32 bit pointers");
+		}
+
+		outName = outFileName;
+		if (pipeTo) {
+			sink.attach(pipeTo->inputFd());
+		}
+		else if (!sink.open(outName)) {
+			throw SourceError(DiagId::OUTPUT_WRITE_FAILED, outName);
+		}
+
+		genPreamble();
+		sink.write(std::move(out));
+
+		for (auto& i : global->getFunctions()) {
+			FuncEmitter emitter;
+			emitter.optimize = optimize;
+			emitter.output = FuncEmitter::Output::X86_ASM;
+			i->emitFileScope(emitter);
+			sink.write(std::move(emitter.codeOut));
+		}
+
+		genConstants();
+		out << "\t.section .note.GNU-stack,\"\",@progbits\n";
+		sink.write(std::move(out));
+
+		sink.close();
+		if (sink.hasFailed()) {
+			throw SourceError(DiagId::OUTPUT_WRITE_FAILED, outName);
+		}
+	}
+
+	// print(int), which the IR preamble defines as linkonce_odr and so is weak here
+	void genPreamble() {
+		std::string_view widen = types().intType()->width() < 32 ? "\tmovswl %di, %esi\n" : "\tmovl %edi, %esi\n";
+
+		appendAll(out, "\t.file \"", origFile, "\"\n",
+			"\t.section .rodata\n",
+			".Lprint_int_fstring:\n",
+			"\t.string \"%d\\n\"\n",
+			"\n",
+			"\t.text\n",
+			"\t.weak print\n",
+			"\t.type print, @function\n",
+			"print:\n",
+			"\tpushq %rbp\n",
+			"\tmovq %rsp, %rbp\n",
+			widen,
+			"\tleaq .Lprint_int_fstring(%rip), %rdi\n",
+			"\txorl %eax, %eax\n",
+			"\tcall printf@PLT\n",
+			"\tpopq %rbp\n",
+			"\tret\n",
+			"\t.size print, .-print\n",
+			"\n"
+		);
+	}
+
+	// @.str.N is .L.str.N, local to the object file
+	void genConstants() {
+		if (!constants || constants->getStrings().empty()) {
+			return;
+		}
+
+		out << "\t.section .rodata\n";
+
+		for (auto& i : constants->getStrings()) {
+			out << ".L" << std::string_view(i.name).substr(1) << ":\n"
+				<< "\t.ascii \"";
+			writeAsmStr(i.bytes);
+			out << "\"\n";
+		}
+
+		out << '\n';
+	}
+
+	// Like LLVM strings, but as takes octal escapes
+	void writeAsmStr(std::string_view bytes) {
+		for (unsigned char c : bytes) {
+			if (c >= 0x20 && c < 0x7F && c != '"' && c != '\\') {
+				out << (char)c;
+			}
+			else {
+				out << '\\' << (char)('0' + (c >> 6)) << (char)('0' + ((c >> 3) & 7)) << (char)('0' + (c & 7));
+			}
+		}
+	}
+};
+
+#endif // ifndef COMPILER_X86ASM_H
@@ -0,0 +1,275 @@
+#ifndef COMPILER_X86ENCODER_H
+#define COMPILER_X86ENCODER_H
+
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <initializer_list>
+#include <cstdint>
+
+#include "x86.h"
+
+// A 32 bit displacement to symbol, relative to the end of the field at offset, to fill in once it is placed
+struct X86Relocation {
+	size_t offset;
+	std::string_view symbol;
+};
+
+// Encodes X86Functions into machine code one after another
+// Jumps within a function are resolved here, and calls and string addresses are left as relocations
+class X86Encoder {
+	using enum X86Reg;
+	using Op = X86Inst::Op;
+
+	std::vector<uint8_t>& code;
+	std::vector<X86Relocation>& relocations;
+
+	// Blocks of the function being encoded, and the jumps to them
+	std::unordered_map<Operand, size_t, OperandHash> labels;
+	std::vector<std::pair<size_t, Operand>> jumps;
+
+	static bool fitsByte(int64_t val) {
+		return val >= INT8_MIN && val <= INT8_MAX;
+	}
+
+	void byte(uint8_t b) {
+		code.push_back(b);
+	}
+
+	void imm(int64_t val, int bytes) {
+		for (int i = 0; i < bytes; i++) {
+			byte((uint8_t)(val >> (i * 8)));
+		}
+	}
+
+	// The ModRM byte, and the SIB byte and displacement if it needs them
+	void modrm(int reg, const X86Operand& rm) {
+		int regBits = (reg & 7) << 3;
+
+		switch (rm.kind) {
+		case X86Operand::Kind::REG:
+			byte(0xC0 | regBits | ((int)rm.reg & 7));
+			break;
+		case X86Operand::Kind::SYMBOL:
+			// Relative to rip, which no instruction with an immediate uses
+			byte(0x05 | regBits);
+			relocations.push_back({ code.size(), rm.symbol });
+			imm(0, 4);
+			break;
+		case X86Operand::Kind::MEM: {
+			// rbp and r13 can't be a base without a displacement, and rsp and r12 only with a SIB byte
+			int base = (int)rm.reg & 7;
+			int mod = rm.value == 0 && base != 5 ? 0 : fitsByte(rm.value) ? 1 : 2;
+
+			byte((mod << 6) | regBits | base);
+			if (base == 4) {
+				byte(0x24);
+			}
+
+			if (mod) {
+				imm(rm.value, mod == 1 ? 1 : 4);
+			}
+			break;
+		}
+		default:
+			throw SourceError(DiagId::ASM_UNSUPPORTED, "an operand that isn't a register or in memory");
+		}
+	}
+
+	// An instruction on reg, a register or an opcode extension, and rm, a register or memory
+	// Byte registers are always given a REX prefix, which makes 4 to 7 spl to dil rather than the unused ah to bh
+	void rm(std::initializer_list<uint8_t> opcode, int size, int reg, const X86Operand& operand, bool byteOperand = false) {
+		if (size == 2) {
+			byte(0x66);
+		}
+
+		int base = operand.kind == X86Operand::Kind::REG || operand.kind == X86Operand::Kind::MEM ? (int)operand.reg : 0;
+		uint8_t rex = 0x40 | (size == 8 ? 8 : 0) | (reg & 8 ? 4 : 0) | (base & 8 ? 1 : 0);
+
+		if (rex != 0x40 || size == 1 || byteOperand) {
+			byte(rex);
+		}
+
+		for (auto& i : opcode) {
+			byte(i);
+		}
+
+		modrm(reg, operand);
+	}
+
+	void jump(const Operand& label) {
+		jumps.emplace_back(code.size(), label);
+		imm(0, 4);
+	}
+
+	// ADD, OR, AND, SUB, XOR and CMP, by their opcode with a register source and their extension with an immediate
+	void arithmetic(const X86Inst& inst, uint8_t opcode, int extension) {
+		int size = inst.size;
+
+		if (inst.src.kind != X86Operand::Kind::IMM) {
+			rm({ (uint8_t)(size == 1 ? opcode - 1 : opcode) }, size, (int)inst.src.reg, inst.dst);
+		}
+		else if (size == 1) {
+			rm({ 0x80 }, size, extension, inst.dst);
+			imm(inst.src.value, 1);
+		}
+		else if (fitsByte(inst.src.value)) {
+			rm({ 0x83 }, size, extension, inst.dst);
+			imm(inst.src.value, 1);
+		}
+		else {
+			rm({ 0x81 }, size, extension, inst.dst);
+			imm(inst.src.value, size == 2 ? 2 : 4);
+		}
+	}
+
+	void instruction(const X86Inst& inst) {
+		int size = inst.size;
+		const X86Operand& src = inst.src;
+		const X86Operand& dst = inst.dst;
+
+		switch (inst.op) {
+		case Op::LABEL:
+			labels[dst.label] = code.size();
+			break;
+		case Op::MOV:
+			if (src.kind == X86Operand::Kind::IMM) {
+				if (size == 8 && (src.value < INT32_MIN || src.value > INT32_MAX)) {
+					// movabs, the only instruction with a 64 bit immediate
+					byte(0x48 | ((int)dst.reg & 8 ? 1 : 0));
+					byte(0xB8 + ((int)dst.reg & 7));
+					imm(src.value, 8);
+				}
+				else {
+					rm({ (uint8_t)(size == 1 ? 0xC6 : 0xC7) }, size, 0, dst);
+					imm(src.value, std::min(size, 4));
+				}
+			}
+			else if (src.kind == X86Operand::Kind::REG) {
+				rm({ (uint8_t)(size == 1 ? 0x88 : 0x89) }, size, (int)src.reg, dst);
+			}
+			else {
+				rm({ (uint8_t)(size == 1 ? 0x8A : 0x8B) }, size, (int)dst.reg, src);
+			}
+			break;
+		case Op::MOVSX:
+			if (inst.fromSize == 4) {
+				rm({ 0x63 }, size, (int)dst.reg, src);
+			}
+			else {
+				rm({ 0x0F, (uint8_t)(inst.fromSize == 1 ? 0xBE : 0xBF) }, size, (int)dst.reg, src, inst.fromSize == 1);
+			}
+			break;
+		case Op::MOVZX:
+			rm({ 0x0F, (uint8_t)(inst.fromSize == 1 ? 0xB6 : 0xB7) }, size, (int)dst.reg, src, inst.fromSize == 1);
+			break;
+		case Op::LEA:
+			rm({ 0x8D }, 8, (int)dst.reg, src);
+			break;
+		case Op::ADD:
+			arithmetic(inst, 0x01, 0);
+			break;
+		case Op::OR:
+			arithmetic(inst, 0x09, 1);
+			break;
+		case Op::AND:
+			arithmetic(inst, 0x21, 4);
+			break;
+		case Op::SUB:
+			arithmetic(inst, 0x29, 5);
+			break;
+		case Op::XOR:
+			arithmetic(inst, 0x31, 6);
+			break;
+		case Op::CMP:
+			arithmetic(inst, 0x39, 7);
+			break;
+		case Op::TEST:
+			rm({ (uint8_t)(size == 1 ? 0x84 : 0x85) }, size, (int)src.reg, dst);
+			break;
+		case Op::IMUL:
+			if (src.kind == X86Operand::Kind::IMM) {
+				bool small = fitsByte(src.value);
+				rm({ (uint8_t)(small ? 0x6B : 0x69) }, size, (int)dst.reg, dst);
+				imm(src.value, small ? 1 : size == 2 ? 2 : 4);
+			}
+			else {
+				rm({ 0x0F, 0xAF }, size, (int)dst.reg, src);
+			}
+			break;
+		case Op::SHL:
+		case Op::SHR:
+		case Op::SAR:
+			rm({ (uint8_t)(size == 1 ? 0xD2 : 0xD3) }, size, inst.op == Op::SHL ? 4 : inst.op == Op::SHR ? 5 : 7, dst);
+			break;
+		case Op::NEG:
+			rm({ (uint8_t)(size == 1 ? 0xF6 : 0xF7) }, size, 3, dst);
+			break;
+		case Op::IDIV:
+			rm({ (uint8_t)(size == 1 ? 0xF6 : 0xF7) }, size, 7, dst);
+			break;
+		case Op::CONVERT:
+			if (size == 8) {
+				byte(0x48);
+			}
+			byte(0x99);
+			break;
+		case Op::SETCC:
+			rm({ 0x0F, (uint8_t)(0x90 + (int)inst.cond) }, 1, 0, dst);
+			break;
+		case Op::PUSH:
+		case Op::POP:
+			if ((int)dst.reg & 8) {
+				byte(0x41);
+			}
+			byte((inst.op == Op::PUSH ? 0x50 : 0x58) + ((int)dst.reg & 7));
+			break;
+		case Op::CALL:
+			byte(0xE8);
+			relocations.push_back({ code.size(), dst.symbol });
+			imm(0, 4);
+			break;
+		case Op::JMP:
+			byte(0xE9);
+			jump(dst.label);
+			break;
+		case Op::JCC:
+			byte(0x0F);
+			byte(0x80 + (int)inst.cond);
+			jump(dst.label);
+			break;
+		case Op::RET:
+			byte(0xC3);
+			break;
+		}
+	}
+
+public:
+	X86Encoder(std::vector<uint8_t>& code_, std::vector<X86Relocation>& relocations_) : code(code_), relocations(relocations_) {}
+
+	// Appends fn's code, and returns where it starts
+	size_t encode(const X86Function& fn) {
+		size_t start = code.size();
+
+		labels.clear();
+		jumps.clear();
+
+		for (auto& i : fn.code) {
+			instruction(i);
+		}
+
+		for (auto& [offset, label] : jumps) {
+			imm32At(offset, (int64_t)labels.at(label) - (int64_t)(offset + 4));
+		}
+
+		return start;
+	}
+
+	void imm32At(size_t offset, int64_t val) {
+		for (int i = 0; i < 4; i++) {
+			code[offset + i] = (uint8_t)(val >> (i * 8));
+		}
+	}
+};
+
+#endif // ifndef COMPILER_X86ENCODER_H
@@ -8,13 +8,22 @@
 #include <functional>
 #include <any>
 #include <algorithm>
+#include <deque>
+#include <optional>
+#include <cctype>
+#include <thread>
+#include <cstdlib>
 
 #include "token.h"
 #include "util.h"
 #include "parser.h"
 #include "llvmAsm.h"
+#include "x86Asm.h"
+#include "jit.h"
+#include "vm.h"
 #include "type.h"
 #include "HashMap.h"
+#include "module.h"
 
 struct Compiler {
 	//todo: unicode
@@ -22,6 +31,55 @@ struct Compiler {
 	std::string_view codeFilename;
 
 	Scope globalScope;
+
+	// Directories searched for the .c1m of an imported module, after the source file's own
+	std::vector<std::string> modulePath;
+
+	// Imported modules stay mapped until the compile ends, since their declarations refer to them
+	std::deque<ModuleFile> modules;
+
+	// String literals of the file being compiled
+	ConstantPool constants;
+
+	// Set by export module, if this is a module interface unit
+	std::string_view moduleName;
+
+	// Set while the parser is working rather than a module it imports or a function it streams out, so an error
+	// thrown meanwhile is one the furthest point parsing reached can explain
+	bool parsing = false;
+
+	// Threads used to emit functions
+	unsigned jobs = 1;
+
+	EmitKind emit = EmitKind::LL;
+
+	// Run the IR passes before writing each function
+	bool optimize = false;
+
+	// Modules to divide the output between
+	unsigned split = 1;
+
+	// Set by -o, to have clang build an executable from the module as it is written, without an intermediate file
+	std::string_view executable;
+	std::vector<std::string> clangFlags;
+	ChildProcess clang;
+
+	// Started before parsing, so that clang loads while the source is still being compiled
+	void startClang() {
+		std::vector<std::string> args = { "clang", "-x", emit == EmitKind::ASM ? "assembler" : "ir", "-", "-o", std::string(executable) };
+		args.insert(args.end(), clangFlags.begin(), clangFlags.end());
+
+		if (!clang.start(args)) {
+			throw SourceError(DiagId::TOOL_START_FAILED, "clang");
+		}
+	}
+
+	void finishClang() {
+		int code = clang.wait();
+		if (code != 0) {
+			throw SourceError(DiagId::TOOL_FAILED, "clang", std::to_string(code));
+		}
+	}
 	
 	Compiler() :
 		globalScope("::", Scope::Type::GLOBAL)
@@ -31,23 +89,27 @@ struct Compiler {
 
 	void makeGlobalScope() {
 		Scope* standard = new Scope("std", Scope::Type::NAMESPACE);
-		standard->addType(new CppType("nullptr_t")); // std::nullptr_t, the type of nullptr
+		standard->addType(strToType("nullptr_t")); // std::nullptr_t, the type of nullptr
 		globalScope.addChildScope(standard);
 
 		Function* print = new Function(&globalScope);
-		print->decl = FunctionPrototype{ "print", { new FunctionArgument{ "target", strToType("int") } }, strToType("void") };
+		print->decl = FunctionPrototype{ "print", { new FunctionArgument{ "target", strToType("int"), nullptr } }, strToType("void") };
+		print->_externC = true;
 		globalScope.addFunction(print);
 
 		Function* printStr = new Function(&globalScope);
-		printStr->decl = FunctionPrototype{ "puts", { new FunctionArgument{ "target", strToType("char*") } }, strToType("int") };
+		printStr->decl = FunctionPrototype{ "puts", { new FunctionArgument{ "target", strToType("char*"), nullptr } }, strToType("int") };
+		printStr->_externC = true;
 		globalScope.addFunction(printStr);
 
 		Function* malloc = new Function(&globalScope);
-		malloc->decl = FunctionPrototype{ "malloc", { new FunctionArgument{ "size", strToType("int") } }, strToType("void*") };
+		malloc->decl = FunctionPrototype{ "malloc", { new FunctionArgument{ "size", strToType("int"), nullptr } }, strToType("void*") };
+		malloc->_externC = true;
 		globalScope.addFunction(malloc);
 
 		Function* free = new Function(&globalScope);
-		free->decl = FunctionPrototype{ "free", { new FunctionArgument{ "ptr", strToType("void*") } }, strToType("void") };
+		free->decl = FunctionPrototype{ "free", { new FunctionArgument{ "ptr", strToType("void*"), nullptr } }, strToType("void") };
+		free->_externC = true;
 		globalScope.addFunction(free);
 	}
 
@@ -78,38 +140,328 @@ struct Compiler {
 
 			i--;
 		}
+
+		diagnostics().setSource(codeFilename, sourceCode);
+	}
+
+	// Maps in a module interface and declares what it exports, returning the functions it declared
+	// A module that has already been imported declares nothing new
+	std::vector<Function*> importModule(std::string_view name) {
+		for (auto& i : modules) {
+			if (i.name() == name) {
+				return {};
+			}
+		}
+
+		std::vector<std::filesystem::path> dirs = { std::filesystem::path(codeFilename).parent_path() };
+		dirs.insert(dirs.end(), modulePath.begin(), modulePath.end());
+
+		for (auto& dir : dirs) {
+			auto path = (dir / (std::string(name) + ".c1m")).string();
+
+			ModuleFile& module = modules.emplace_back();
+			if (module.open(path)) {
+				return module.importInto(&globalScope);
+			}
+
+			modules.pop_back();
+		}
+
+		throw SourceError(DiagId::MODULE_NOT_FOUND, name);
+	}
+
+	// Writes name.c1m next to the output, for the units that import this one
+	void writeModule(std::string_view outputFilename) {
+		if (moduleName.empty()) {
+			return;
+		}
+
+		auto path = (std::filesystem::path(outputFilename).parent_path() / (std::string(moduleName) + ".c1m")).string();
+
+		ModuleWriter writer;
+		writer.addExports(&globalScope);
+
+		if (!writer.write(path, moduleName)) {
+			throw SourceError(DiagId::MODULE_WRITE_FAILED, path);
+		}
 	}
 
 	void parse() {
 		// Produce an AST
 		Parser parser(sourceCode, codeFilename);
+		parser.constants = &constants;
+		parser.onImport = [&](std::string_view name) {
+			parsing = false;
+			importModule(name);
+			parsing = true;
+		};
 
+		parsing = true;
 		parser.parse(&globalScope);
+		parsing = false;
+		moduleName = parser.moduleName;
 	}
 
 	void generateIr(std::string_view outputFilename) {
+		if (emit == EmitKind::ASM) {
+			X86AsmGenerator gen(codeFilename);
+			gen.constants = &constants;
+			gen.optimize = optimize;
+			gen.pipeTo = clang.running() ? &clang : nullptr;
+			gen.generate(outputFilename, &globalScope);
+			return;
+		}
+
 		LlvmAsmGenerator gen(codeFilename);
+		gen.constants = &constants;
+		gen.jobs = jobs;
+		gen.emit = emit;
+		gen.optimize = optimize;
+		gen.split = split;
+		gen.pipeTo = clang.running() ? &clang : nullptr;
 		gen.generate(outputFilename, &globalScope);
 	}
+
+	// Compile main and what it calls into memory and run it, returning its exit code
+	int run() {
+		Jit jit;
+		jit.constants = &constants;
+		jit.optimize = optimize;
+		return jit.run(&globalScope);
+	}
+
+	// Compile main and what it calls to bytecode and interpret it, returning its exit code
+	int interpret() {
+		Vm vm;
+		vm.constants = &constants;
+		vm.optimize = optimize;
+		return vm.run(&globalScope);
+	}
+
+	// Parse and generate together, writing out and freeing each function as soon as it has been parsed
+	void parseStreaming(std::string_view outputFilename) {
+		LlvmAsmGenerator gen(codeFilename);
+		gen.constants = &constants;
+		gen.emit = emit;
+		gen.optimize = optimize;
+		gen.pipeTo = clang.running() ? &clang : nullptr;
+		gen.beginStream(outputFilename, &globalScope);
+
+		Parser parser(sourceCode, codeFilename);
+		parser.constants = &constants;
+		parser.onFunctionParsed = [&](Function* fn) {
+			parsing = false;
+			gen.streamFunction(fn);
+			if (!fn->keepsBody()) {
+				fn->releaseBody();
+			}
+			parsing = true;
+		};
+		parser.onImport = [&](std::string_view name) {
+			parsing = false;
+			for (auto& i : importModule(name)) {
+				gen.streamFunction(i);
+			}
+			parsing = true;
+		};
+
+		parsing = true;
+		parser.parse(&globalScope);
+		parsing = false;
+		moduleName = parser.moduleName;
+
+		gen.endStream();
+	}
 };
 
+// Finds value in one of the NAME_STR arrays, ignoring case
+template <size_t N>
+std::optional<int> findOptionValue(const std::string_view (&names)[N], std::string_view value) {
+	for (int i = 0; i < (int)N; i++) {
+		if (std::equal(names[i].begin(), names[i].end(), value.begin(), value.end(),
+			[](char a, char b) { return std::tolower((unsigned char)a) == std::tolower((unsigned char)b); })) {
+			return i;
+		}
+	}
+
+	return std::nullopt;
+}
+
 int main(int argc, char** argv)
 {
 	auto defaultFile = "C:/Users/nickk/dev/Compiler/tests/test_1.cpp";
 	auto defaultOut = "C:/Users/nickk/dev/Compiler/build/out.ll";
 
-	if (argc >= 2) {
-		defaultFile = argv[1];
+	bool streaming = false;
+	bool run = false;
+	bool interpret = false;
+	std::vector<std::string> modulePath;
+	unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+	EmitKind emit = EmitKind::LL;
+	bool optimize = false;
+	unsigned split = 1;
+	std::string_view executable;
+	std::vector<std::string> clangFlags;
+
+	std::vector<std::string_view> positional;
+	for (int i = 1; i < argc; i++) {
+		std::string_view arg = argv[i];
+
+		if (arg == "--stream") {
+			streaming = true;
+		}
+		else if (arg == "--run") {
+			run = true;
+		}
+		else if (arg == "--interpret") {
+			interpret = true;
+		}
+		else if ((arg == "--jobs" || arg == "-j") && i + 1 < argc) {
+			jobs = std::max(1, std::atoi(argv[++i]));
+		}
+		else if (arg == "-O" || arg == "--optimize") {
+			optimize = true;
+		}
+		else if (arg == "--constexpr-steps" && i + 1 < argc) {
+			constCache().maxSteps = (size_t)std::max(1, std::atoi(argv[++i]));
+		}
+		else if (arg.starts_with("-O")) {
+			// An optimization level, for clang when it builds the executable
+			clangFlags.push_back(std::string(arg));
+		}
+		else if (arg == "-o" && i + 1 < argc) {
+			executable = argv[++i];
+		}
+		else if (arg.starts_with("--split=")) {
+			split = std::max(1, std::atoi(arg.substr(arg.find('=') + 1).data()));
+		}
+		else if (arg.starts_with("--emit=")) {
+			std::string_view value = arg.substr(arg.find('=') + 1);
+
+			auto kind = findOptionValue(EMIT_KINDS_STR, value);
+			if (!kind) {
+				diagnostics().report(DiagId::UNKNOWN_OPTION_VALUE, nullptr, { "output kind", value });
+				diagnostics().flush(std::cerr, false);
+				return -1;
+			}
+
+			emit = (EmitKind)*kind;
+		}
+		else if (arg == "--module-path" && i + 1 < argc) {
+			modulePath.push_back(argv[++i]);
+		}
+		else if (arg == "--data-model" && i + 1 < argc) {
+			std::string_view value = argv[++i];
+
+			// x32 is ILP32 on x86-64 Linux
+			if (value == "x32") {
+				currentDataModel = &DATA_MODELS[(int)DataModels::ILP32];
+				targetPlatform = Platform::LINUX;
+				continue;
+			}
+
+			auto model = findOptionValue(DATA_MODELS_STR, value);
+			if (!model) {
+				diagnostics().report(DiagId::UNKNOWN_OPTION_VALUE, nullptr, { "data model", value });
+				diagnostics().flush(std::cerr, false);
+				return -1;
+			}
+
+			currentDataModel = &DATA_MODELS[*model];
+		}
+		else if (arg == "--platform" && i + 1 < argc) {
+			std::string_view value = argv[++i];
+
+			auto platform = findOptionValue(PLATFORM_STR, value);
+			if (!platform) {
+				diagnostics().report(DiagId::UNKNOWN_OPTION_VALUE, nullptr, { "platform", value });
+				diagnostics().flush(std::cerr, false);
+				return -1;
+			}
+
+			targetPlatform = (Platform)*platform;
+		}
+		else {
+			positional.push_back(arg);
+		}
 	}
 
-	if (argc >= 3) {
-		defaultOut = argv[2];
+	if (positional.size() >= 1) {
+		defaultFile = positional[0].data();
+	}
+
+	if (positional.size() >= 2) {
+		defaultOut = positional[1].data();
 	}
 
 	Compiler compiler;
+	compiler.modulePath = modulePath;
+	compiler.jobs = jobs;
+	compiler.emit = emit;
+	compiler.optimize = optimize;
+	compiler.split = split;
+	compiler.executable = executable;
+	compiler.clangFlags = clangFlags;
+
+	// The module goes down a single pipe
+	if (!executable.empty()) {
+		compiler.split = 1;
+	}
 	compiler.loadFile(defaultFile);
-	compiler.parse();
-	compiler.generateIr(defaultOut);
 
-	return 0;
+	try {
+		// Nothing is written, the program's exit code is the compiler's
+		if (run || interpret) {
+			compiler.parse();
+			if (diagnostics().hasErrors()) {
+				diagnostics().flush(std::cerr, false);
+				return -1;
+			}
+
+			int code = interpret ? compiler.interpret() : compiler.run();
+			diagnostics().flush(std::cerr, false);
+			return code;
+		}
+
+		if (!executable.empty()) {
+			compiler.startClang();
+		}
+
+		try {
+			// Splitting balances the modules over the whole file, so it can't stream
+			// Assembly is only written whole, it is meant for small debug builds
+			if (streaming && compiler.split == 1 && emit != EmitKind::ASM) {
+				compiler.parseStreaming(defaultOut);
+			}
+			else {
+				compiler.parse();
+				compiler.generateIr(defaultOut);
+			}
+		}
+		catch (const SourceError&) {
+			// A write fails if clang stopped reading, and how clang failed explains why
+			if (!executable.empty()) {
+				compiler.finishClang();
+			}
+			throw;
+		}
+
+		if (!executable.empty()) {
+			compiler.finishClang();
+		}
+
+		// Importers shouldn't see a module that failed to compile
+		if (!diagnostics().hasErrors()) {
+			compiler.writeModule(executable.empty() ? defaultOut : executable);
+		}
+	}
+	catch (const SourceError& err) {
+		err.report();
+		diagnostics().flush(std::cerr, compiler.parsing);
+		return -1;
+	}
+
+	diagnostics().flush(std::cerr, false);
+
+	return diagnostics().hasErrors() ? -1 : 0;
 }
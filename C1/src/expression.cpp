@@ -1,37 +1,112 @@
 #include "util.h"
 #include "expression.h"
 #include "function.h"
+#include "constEval.h"
 
 void FunctionCall::emitDependency(FuncEmitter& out) {
+	// A constexpr call whose arguments are all constant is emitted as its result
+	if (_fn->_constexpr || _fn->_consteval) {
+		try {
+			ConstEvaluator eval;
+			_retReg = Operand::constant(eval.value(this));
+			return;
+		}
+		catch (SourceError& err) {
+			if (_fn->_consteval) {
+				throw err.at(_where);
+			}
+		}
+	}
+
+	std::vector<IrOperand> args;
+
 	for (auto& i : arguments) {
 		i->emitDependency(out);
+		args.push_back({ i->getResultType()->llvmType(), i->getOperand() });
 	}
 
-	if (_fn->decl.returnType->getName() != "void") {
-		_retReg = out.nextReg();
-		out.indent() << "%" << _retReg << " = ";
+	_retReg = out.call(_fn->decl.returnType->llvmType(), _fn->mangleName(), args);
+}
+
+Operand FunctionCall::getOperand() {
+	return _retReg;
+}
+
+CppType* FunctionCall::getResultType() {
+	return _fn->decl.returnType;
+}
+
+int64_t FunctionCall::evaluate(ConstEvaluator& eval) {
+	if (!_fn->_constexpr && !_fn->_consteval) {
+		throw SourceError(DiagId::NOT_CONSTANT, buildStr("a call to ", _fn->getName()));
 	}
-	else {
-		out.indent();
+
+	std::vector<int64_t> args;
+	for (auto& i : arguments) {
+		args.push_back(ConstEvaluator::normalize(eval.value(i), i->getResultType()));
 	}
 
-	out << "call " << _fn->decl.returnType->getLlvmName() << " @" << _fn->mangleName() << "(";
+	return eval.call(_fn, std::move(args));
+}
 
-	for (auto& i : arguments) {
-		out << i->getResultType()->getLlvmName() << " " << i->getOperand();
+int64_t ConstEvaluator::run(Function* fn, const std::vector<int64_t>& args) {
+	// A call to a function declared before it is defined evaluates the definition
+	Function* definition = fn->defined ? fn : fn->_definition;
+	CppType* returnType = fn->decl.returnType;
+
+	if (!definition || !definition->defined) {
+		throw SourceError(DiagId::NOT_CONSTANT, buildStr(fn->getName(), " without its definition"));
+	}
 
-		if (&i != &arguments.back()) {
-			out << ", ";
+	// Only integers are held as constants
+	for (auto& i : fn->decl.arguments) {
+		if (i->type->_pointerLayers || !i->type->isInteger() || i->type->isClass()) {
+			throw SourceError(DiagId::NOT_CONSTANT, buildStr("a call to ", fn->getName(), " with an argument of type ", i->type->getName()));
 		}
 	}
+	if (returnType->_pointerLayers || !returnType->isInteger() || returnType->isClass()) {
+		throw SourceError(DiagId::NOT_CONSTANT, buildStr("a call to ", fn->getName(), " returning ", returnType->getName()));
+	}
 
-	out << ")\n";
-}
+	pushFrame(definition, args);
+
+	try {
+		run(definition->body.getExpressions());
+	}
+	catch (...) {
+		returning = false;
+		popFrame();
+		throw;
+	}
+
+	bool returned = returning;
+	int64_t result = returnValue;
+	returning = false;
+	popFrame();
+
+	if (returnType == types().voidType()) {
+		return 0;
+	}
+	if (!returned) {
+		undefined("reaching the end of a function without a return");
+	}
 
-std::string FunctionCall::getOperand() {
-	return buildStr("%", _retReg);
+	return normalize(result, returnType);
 }
 
-CppType* FunctionCall::getResultType() {
-	return _fn->decl.returnType;
-}
\ No newline at end of file
+int64_t ConstEvaluator::argument(FunctionArgument* arg) {
+	if (frames.empty()) {
+		throw SourceError(DiagId::NOT_CONSTANT, arg->name);
+	}
+
+	Frame& frame = frames.back();
+	auto& params = frame.fn->decl.arguments;
+
+	for (size_t i = 0; i < params.size(); i++) {
+		if (params[i] == arg) {
+			return (*frame.args)[i];
+		}
+	}
+
+	throw SourceError(DiagId::NOT_CONSTANT, arg->name);
+}
@@ -0,0 +1,36 @@
+#!/bin/bash
+# Times each program under --interpret and --run against a clang -O0 build of the same module
+# The compiler's times include parsing the program, the clang build's only running it
+# Usage: bench.sh <path to C1> [programs...], by default every .cpp next to this script
+set -e
+
+c1=${1:?usage: bench.sh <path to C1> [programs...]}
+shift
+
+dir=$(dirname "$0")
+programs=("$@")
+if [ ${#programs[@]} -eq 0 ]; then
+	programs=("$dir"/*.cpp)
+fi
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+TIMEFORMAT=%R
+
+seconds() {
+	{ time "$@" >/dev/null 2>&1; } 2>&1
+}
+
+printf '%-20s %12s %12s %12s\n' program interpret run clang-O0
+
+for program in "${programs[@]}"; do
+	name=$(basename "$program" .cpp)
+
+	"$c1" "$program" -o "$work/$name" -O0 >/dev/null 2>&1 || { echo "$name: clang build failed" >&2; continue; }
+
+	printf '%-20s %12s %12s %12s\n' "$name" \
+		"$(seconds "$c1" "$program" --interpret)" \
+		"$(seconds "$c1" "$program" --run)" \
+		"$(seconds "$work/$name")"
+done
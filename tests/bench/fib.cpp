@@ -0,0 +1,14 @@
+int fib(int n);
+
+int fib(int n) {
+	int r = n;
+	if (n > 1) {
+		r = fib(n - 1) + fib(n - 2);
+	}
+	return r;
+}
+
+int main() {
+	print(fib(32));
+	return 0;
+}
@@ -0,0 +1,59 @@
+template <typename T>
+T twice(T a) {
+	T b = a + a;
+	return b;
+}
+
+template <typename T, typename U>
+T pick(T a, U b) {
+	return a;
+}
+
+template <typename T>
+T first(T* items) {
+	return *(items + 0);
+}
+
+template <typename T>
+T keep(const T* item) {
+	const T copy = *item;
+	return copy;
+}
+
+template <class T>
+struct Box {
+	T value;
+};
+
+template <typename T>
+T unbox(Box<T>* box) {
+	return box->value;
+}
+
+template <typename K, typename V>
+V second(Box<K>* key, Box<V>* value, V fallback) {
+	return value->value + fallback;
+}
+
+int add(int a, int b) {
+	return a + b;
+}
+
+int main() {
+	print(twice(21));
+	print(twice<int>(5));
+	print(twice(add(1, 2)));
+	char* p = (char*)malloc(4);
+	print(pick(7, p));
+	*(p + 0) = 'A';
+	print(first(p));
+	int n = 6;
+	print(keep(&n));
+	Box<int> box;
+	box.value = 8;
+	print(unbox(&box));
+	Box<char> tag;
+	print(second(&tag, &box, 3));
+	print(add(twice(3) + 1, 4));
+	return 0;
+}
@@ -0,0 +1,53 @@
+struct Point {
+	int x;
+	int y;
+};
+
+struct Mixed {
+	char tag;
+	long value;
+	char flag;
+};
+
+struct Node {
+	int value;
+	Node* next;
+};
+
+template <typename T>
+struct Box {
+	T value;
+	char mark;
+};
+
+int sum(Point* p) {
+	return p->x + p->y;
+}
+
+int main() {
+	Point p;
+	p.x = 3;
+	p.y = 4;
+	print(p.x);
+	print(sum(&p));
+	print(sizeof(Point));
+	print(sizeof(Mixed));
+	Mixed m;
+	m.value = 40;
+	m.tag = 2;
+	print(m.value + m.tag);
+	Node* n = (Node*)malloc(sizeof(Node));
+	n->value = 9;
+	n->next = n;
+	print(n->next->value);
+	Box<long> b;
+	b.value = 12;
+	print(b.value);
+	print(sizeof(Box<long>));
+	Box<Point> bp;
+	bp.value.y = 7;
+	print(bp.value.y);
+	Point* pp = &p;
+	print((*pp).y);
+	return 0;
+}
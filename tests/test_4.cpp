@@ -0,0 +1,13 @@
+int f(int a) { return a + 1; }
+int f(int a, int b) { return a * b; }
+int f(int* p) { return 7; }
+int g(long x);
+int g(long x) { return 3; }
+int main() {
+	int x = 4;
+	print(f(x));
+	print(f(x, 5));
+	print(f(&x));
+	print(g(2));
+	return 0;
+}
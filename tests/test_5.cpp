@@ -0,0 +1,27 @@
+constexpr int fib(int n);
+
+constexpr int fib(int n) {
+	if (n < 2) {
+		return n;
+	}
+	return fib(n - 1) + fib(n - 2);
+}
+
+constexpr int mix(int h, int c) {
+	int x = h * 31 + c;
+	return x ^ (x >> 3);
+}
+
+consteval int cube(int x) {
+	return x * x * x;
+}
+
+int main() {
+	print(fib(40));
+	print(mix(mix(mix(0, 104), 105), 33));
+	constexpr int table = cube(3) + fib(10);
+	print(table);
+	int n = 12;
+	print(fib(n));
+	return 0;
+}